@@ -21,16 +21,29 @@ for_each(std::tuple<Tp...> &tp, FuncT func)
     for_each<I + 1, FuncT, Tp...>(tp, func);
 }
 
+template<std::size_t I = 0, typename FuncT, typename... Tp>
+inline typename std::enable_if<I == sizeof...(Tp), void>::type
+for_each(const std::tuple<Tp...> &, FuncT)
+{}
+
+template<std::size_t I = 0, typename FuncT, typename... Tp>
+inline typename std::enable_if<I < sizeof...(Tp), void>::type
+for_each(const std::tuple<Tp...> &tp, FuncT func)
+{
+    func(std::get<I>(tp));
+    for_each<I + 1, FuncT, Tp...>(tp, func);
+}
+
 class HttpReq;
 class HttpResp;
 
 template<typename Tuple>
-inline bool aop_before(const HttpReq *req, HttpResp *resp, Tuple &tp)
+inline bool aop_before(const HttpReq *req, HttpResp *resp, const Tuple &tp)
 {
     bool ret = true;
     for_each(
             tp,
-            [&ret, req, resp](Aspect &item)
+            [&ret, req, resp](const Aspect &item)
             {
                 if (!ret)
                     return;
@@ -40,12 +53,12 @@ inline bool aop_before(const HttpReq *req, HttpResp *resp, Tuple &tp)
 }
 
 template<typename Tuple>
-inline bool aop_after(const HttpReq *req, HttpResp *resp, Tuple &tp)
+inline bool aop_after(const HttpReq *req, HttpResp *resp, const Tuple &tp)
 {
     bool ret = true;
     for_each(
             tp,
-            [&ret, req, resp](Aspect &item)
+            [&ret, req, resp](const Aspect &item)
             {
                 if (!ret)
                     return;
@@ -54,6 +67,27 @@ inline bool aop_after(const HttpReq *req, HttpResp *resp, Tuple &tp)
     return ret;
 }
 
+// The aspects given to a route, constructed once and kept as long as the route,
+// shared by its concurrent requests : only their const before() and after() are called.
+// Their calls are not virtual, the types are known here.
+template<typename... AP>
+class RouteAspectChain : public AspectChain
+{
+public:
+    explicit RouteAspectChain(const AP &... ap) : aspects_(ap...)
+    {}
+
+protected:
+    bool route_before(const HttpReq *req, HttpResp *resp) const override
+    { return aop_before(req, resp, aspects_); }
+
+    bool route_after(const HttpReq *req, HttpResp *resp) const override
+    { return aop_after(req, resp, aspects_); }
+
+private:
+    const std::tuple<AP...> aspects_;
+};
+
 } // namespace wfrest
 
 
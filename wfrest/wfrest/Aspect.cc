@@ -14,4 +14,37 @@ GlobalAspect::~GlobalAspect()
     {
         delete asp;
     }
-}
\ No newline at end of file
+}
+
+const std::vector<Aspect *> &AspectChain::global_aspects() const
+{
+    if (!built_.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!built_.load(std::memory_order_relaxed))
+        {
+            global_aspects_ = GlobalAspect::get_instance()->aspect_list;
+            built_.store(true, std::memory_order_release);
+        }
+    }
+    return global_aspects_;
+}
+
+bool AspectChain::before(const HttpReq *req, HttpResp *resp) const
+{
+    if (!this->route_before(req, resp))
+        return false;
+    for (Aspect *asp : this->global_aspects())
+    {
+        if (!asp->before(req, resp))
+            return false;
+    }
+    return true;
+}
+
+void AspectChain::after(const HttpReq *req, HttpResp *resp) const
+{
+    this->route_after(req, resp);
+    for (Aspect *asp : this->global_aspects())
+        asp->after(req, resp);
+}
@@ -1,7 +1,14 @@
 ﻿#ifndef WFREST_ASPECT_H_
 #define WFREST_ASPECT_H_
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
+#include "wfrest/Noncopyable.h"
+
+class SeriesWork;
 
 namespace wfrest
 {
@@ -10,12 +17,19 @@ class HttpReq;
 
 class HttpResp;
 
+class HttpServer;
+
+class HttpServerTask;
+
+// One instance serves every request of its route, concurrently, so before() and
+// after() are const : what a request needs between them goes in the request,
+// what requests share must be thread safe (atomics, or a shared object of its own).
 class Aspect
 {
 public:
-    virtual bool before(const HttpReq *req, HttpResp *resp) = 0;
+    virtual bool before(const HttpReq *req, HttpResp *resp) const = 0;
 
-    virtual bool after(const HttpReq *req, HttpResp *resp) = 0;
+    virtual bool after(const HttpReq *req, HttpResp *resp) const = 0;
 };
 
 class GlobalAspect
@@ -36,6 +50,84 @@ private:
     ~GlobalAspect();
 };
 
+// The decision of an AsyncAspect, given once : pass() or stop().
+// Call it from before() or from the callback of a task of the request's series.
+// A series ending before the decision is answered 500 (fail closed),
+// a decision after that is ignored. The gate lives as long as the request.
+class AspectGate : public Noncopyable
+{
+public:
+    // the next async aspect, then the route
+    void pass();
+
+    // the request ends here with the response set by the aspect
+    void stop();
+
+private:
+    AspectGate(HttpServer *server, HttpServerTask *server_task, const std::string &verb,
+               const std::string &route)
+        : server_(server), server_task_(server_task), verb_(verb), route_(route)
+    {}
+
+    HttpServer *server_;
+    HttpServerTask *server_task_;
+    std::string verb_;
+    std::string route_;
+    // the aspect deciding
+    size_t index_ = 0;
+    // stopped, routed, or answered for want of a decision
+    bool closed_ = false;
+
+    // the reply is going out and no decision came
+    void fail();
+
+    friend class HttpServer;
+    friend class HttpServerTask;
+};
+
+// Middleware which may wait for tasks before the route is called, an auth or quota
+// check against Redis or MySQL for example, without blocking a handler thread.
+// Registered with HttpServer::UseAsync(), run in order before the aspects of the route.
+// One instance serves every request, concurrently.
+class AsyncAspect
+{
+public:
+    virtual ~AsyncAspect() = default;
+
+    // Push the tasks to series (series->push_back()), and decide with gate
+    // in their callback, or right away.
+    virtual void before(const HttpReq *req, HttpResp *resp, SeriesWork *series, AspectGate *gate) = 0;
+};
+
+// The aspects of one route, then the global ones copied into a flat array on the
+// first request of the route (Use() may come after the route is added).
+// A request costs no allocation.
+class AspectChain : public Noncopyable
+{
+public:
+    virtual ~AspectChain() = default;
+
+    // false as soon as an aspect refuses, the handler is not called
+    bool before(const HttpReq *req, HttpResp *resp) const;
+
+    // the route aspects until one returns false, then all the global ones
+    void after(const HttpReq *req, HttpResp *resp) const;
+
+protected:
+    // RouteAspectChain, with the types of the route aspects known
+    virtual bool route_before(const HttpReq *req, HttpResp *resp) const = 0;
+
+    virtual bool route_after(const HttpReq *req, HttpResp *resp) const = 0;
+
+private:
+    const std::vector<Aspect *> &global_aspects() const;
+
+private:
+    mutable std::atomic<bool> built_{false};
+    mutable std::mutex mutex_;
+    mutable std::vector<Aspect *> global_aspects_;
+};
+
 } // namespace wfrest
 
 
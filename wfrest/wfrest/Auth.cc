@@ -0,0 +1,50 @@
+﻿#include "wfrest/Auth.h"
+#include "wfrest/HttpMsg.h"
+#include "wfrest/ErrorCode.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+void decide(bool allowed, HttpResp *resp, AspectGate *gate)
+{
+    if (allowed)
+    {
+        gate->pass();
+        return;
+    }
+    resp->Error(StatusUnauthorized);
+    gate->stop();
+}
+
+}  // namespace
+
+AuthAspect::AuthAspect(const AuthOptions &options)
+    : options_(options),
+    cache_(options.cache_size)
+{
+}
+
+void AuthAspect::before(const HttpReq *req, HttpResp *resp, SeriesWork *series, AspectGate *gate)
+{
+    std::string credential = options_.credential ? options_.credential(req) : req->header("Authorization");
+    if (credential.empty() || !options_.lookup)
+    {
+        decide(false, resp, gate);
+        return;
+    }
+
+    bool allowed;
+    if (cache_.get(credential, &allowed))
+    {
+        decide(allowed, resp, gate);
+        return;
+    }
+
+    options_.lookup(credential, series, [this, credential, resp, gate](bool allowed)
+    {
+        cache_.put(credential, allowed, allowed ? options_.allow_ms : options_.deny_ms);
+        decide(allowed, resp, gate);
+    });
+}
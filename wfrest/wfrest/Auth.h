@@ -0,0 +1,55 @@
+﻿#ifndef WFREST_AUTH_H_
+#define WFREST_AUTH_H_
+
+#include <functional>
+#include <string>
+
+#include "wfrest/Aspect.h"
+#include "wfrest/ShardedCache.h"
+
+namespace wfrest
+{
+
+// AuthAspect
+struct AuthOptions
+{
+    using Done = std::function<void (bool allowed)>;
+
+    // The credential of a request, the Authorization header when not set.
+    // An empty credential is refused without a lookup.
+    std::function<std::string (const HttpReq *req)> credential;
+    // Push the tasks checking credential to series (a Redis GET, a MySQL query),
+    // and call done from their callback, or right away.
+    std::function<void (const std::string &credential, SeriesWork *series, const Done &done)> lookup;
+    // decisions kept, in all
+    size_t cache_size = 64 * 1024;
+    // how long a decision is reused, 0 does not keep it
+    int allow_ms = 60 * 1000;
+    // short, a credential granted since is not refused for long
+    int deny_ms = 5 * 1000;
+};
+
+// Allows or refuses (401) a request by its credential, with the decisions of the lookup
+// cached : most requests do not wait for the backend.
+class AuthAspect : public AsyncAspect
+{
+public:
+    explicit AuthAspect(const AuthOptions &options);
+
+    void before(const HttpReq *req, HttpResp *resp, SeriesWork *series, AspectGate *gate) override;
+
+    ShardedCacheStats stats() const
+    { return cache_.stats(); }
+
+    // a credential revoked, or granted, before its decision expires
+    void forget(const std::string &credential)
+    { cache_.remove(credential); }
+
+private:
+    AuthOptions options_;
+    ShardedCache<bool> cache_;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_AUTH_H_
@@ -0,0 +1,264 @@
+﻿#ifndef WFREST_BATCHER_H_
+#define WFREST_BATCHER_H_
+
+#include "workflow/WFTaskFactory.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "wfrest/ComputePool.h"
+#include "wfrest/ErrorCode.h"
+#include "wfrest/HttpMsg.h"
+#include "wfrest/Noncopyable.h"
+
+namespace wfrest
+{
+
+struct BatcherOptions
+{
+    // a batch runs once it has max_items, or max_wait_us after its first item
+    size_t max_items = 32;
+    int max_wait_us = 1000;
+    // the ComputePool of the batch function
+    int compute_queue_id = 0;
+};
+
+struct BatcherStats
+{
+    size_t batches;
+    size_t items;
+    size_t max_batch_size;
+    // batches their compute pool refused
+    size_t rejected;
+    // from an item coming in to its batch running, us
+    int64_t total_wait_us;
+    int64_t max_wait_us;
+};
+
+// Runs the items of concurrent requests as one batch :
+//
+//  static Batcher<std::string, Embedding> batcher(options, [](std::vector<std::string> &texts,
+//                                                          std::vector<Embedding> *out) { ... });
+//  svr.GET("/embed", [](const HttpReq *req, HttpResp *resp)
+//  {
+//      batcher.submit(resp, req->query("text"), [resp](Embedding &embedding) { ... });
+//  });
+//
+// The request waits in its series for the batch, at most max_wait_us for the others.
+// The batch function runs on the compute pool, the outputs come sized as the inputs,
+// (*outputs)[i] is the result of inputs[i]. Each series then goes on with its own output.
+// The batcher is to outlive the requests, a static or one made before the server starts.
+// Thread safety: YES
+template<typename In, typename Out>
+class Batcher : public Noncopyable
+{
+public:
+    using BatchFunc = std::function<void (std::vector<In> &inputs, std::vector<Out> *outputs)>;
+    // out is nullptr when the compute pool refused the batch
+    using DoneFunc = std::function<void (Out *out)>;
+
+    Batcher(const BatcherOptions &options, BatchFunc func)
+        : options_(options),
+        func_(std::move(func))
+    {
+        if (options_.max_items == 0)
+            options_.max_items = 1;
+    }
+
+    // A task waiting for the batch of in, then done in its series
+    WFCounterTask *create_task(In in, DoneFunc done)
+    {
+        auto *item = new Item;
+        item->in = std::move(in);
+        item->done = std::move(done);
+        item->submit_us = now_us();
+        item->task = WFTaskFactory::create_counter_task(1, [item](WFCounterTask *)
+        {
+            item->done(item->ok ? &item->out : nullptr);
+            delete item;
+        });
+
+        std::vector<Item *> batch;
+        bool start_timer = false;
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(item);
+            generation = generation_;
+            if (pending_.size() >= options_.max_items || options_.max_wait_us <= 0)
+                batch = this->take_pending();
+            else
+                start_timer = pending_.size() == 1;
+        }
+        // the counter may be done before the series starts it
+        WFCounterTask *task = item->task;
+        if (!batch.empty())
+            this->run(std::move(batch));
+        else if (start_timer)
+            this->start_timer(generation);
+        return task;
+    }
+
+    // in the series of resp, a refused batch answers 503
+    void submit(HttpResp *resp, In in, std::function<void (Out &out)> done)
+    {
+        resp->add_task(this->create_task(std::move(in), [resp, done](Out *out)
+        {
+            if (out)
+                done(*out);
+            else
+                resp->Error(StatusComputeQueueFull);
+        }));
+    }
+
+    // run the items waiting, not waiting for more
+    void flush()
+    {
+        std::vector<Item *> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch = this->take_pending();
+        }
+        if (!batch.empty())
+            this->run(std::move(batch));
+    }
+
+    BatcherStats stats() const
+    {
+        BatcherStats stats;
+        stats.batches = batches_;
+        stats.items = items_;
+        stats.max_batch_size = max_batch_size_;
+        stats.rejected = rejected_;
+        stats.total_wait_us = total_wait_us_;
+        stats.max_wait_us = max_wait_us_;
+        return stats;
+    }
+
+private:
+    struct Item
+    {
+        In in;
+        Out out;
+        bool ok = false;
+        DoneFunc done;
+        int64_t submit_us;
+        WFCounterTask *task;
+    };
+
+    // with mutex_ held, the timer of these items is left with nothing to do
+    std::vector<Item *> take_pending()
+    {
+        std::vector<Item *> batch;
+        batch.swap(pending_);
+        generation_++;
+        return batch;
+    }
+
+    void start_timer(uint64_t generation)
+    {
+        WFTimerTask *timer = WFTaskFactory::create_timer_task(options_.max_wait_us,
+                [this, generation](WFTimerTask *)
+        {
+            std::vector<Item *> batch;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                // a full batch ran them already
+                if (generation != generation_)
+                    return;
+                batch = this->take_pending();
+            }
+            this->run(std::move(batch));
+        });
+        timer->start();
+    }
+
+    void run(std::vector<Item *> &&batch)
+    {
+        int64_t now = now_us();
+        int64_t max_wait = 0;
+        int64_t total_wait = 0;
+        for (Item *item : batch)
+        {
+            int64_t wait = now - item->submit_us;
+            total_wait += wait;
+            max_wait = std::max(max_wait, wait);
+        }
+        batches_++;
+        items_ += batch.size();
+        total_wait_us_ += total_wait;
+        update_max(max_batch_size_, batch.size());
+        update_max(max_wait_us_, max_wait);
+
+        WFGoTask *go_task = ComputePool::get(options_.compute_queue_id)->create_go_task([this, batch]
+        {
+            std::vector<In> inputs;
+            inputs.reserve(batch.size());
+            for (Item *item : batch)
+                inputs.emplace_back(std::move(item->in));
+            std::vector<Out> outputs(inputs.size());
+            func_(inputs, &outputs);
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                batch[i]->out = std::move(outputs[i]);
+                batch[i]->ok = true;
+            }
+            complete(batch);
+        });
+        if (go_task)
+        {
+            go_task->start();
+        }
+        else
+        {
+            rejected_++;
+            complete(batch);
+        }
+    }
+
+    // each series goes on with its item
+    static void complete(const std::vector<Item *> &batch)
+    {
+        for (Item *item : batch)
+            item->task->count();
+    }
+
+    template<typename T>
+    static void update_max(std::atomic<T> &max, T value)
+    {
+        T cur = max;
+        while (value > cur && !max.compare_exchange_weak(cur, value))
+            ;
+    }
+
+    static int64_t now_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    BatcherOptions options_;
+    BatchFunc func_;
+
+    std::mutex mutex_;
+    std::vector<Item *> pending_;
+    // of pending_, bumped each time it is taken
+    uint64_t generation_ = 0;
+
+    std::atomic<size_t> batches_{0};
+    std::atomic<size_t> items_{0};
+    std::atomic<size_t> max_batch_size_{0};
+    std::atomic<size_t> rejected_{0};
+    std::atomic<int64_t> total_wait_us_{0};
+    std::atomic<int64_t> max_wait_us_{0};
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_BATCHER_H_
@@ -5,31 +5,17 @@ using namespace wfrest;
 
 void BluePrint::ROUTE(const char *route, const Handler &handler, Verb verb)
 {
+    // no aspects of its own, the chain runs the global ones
+    auto aspects = std::make_shared<RouteAspectChain<>>();
     WrapHandler wrap_handler =
-            [handler](const HttpReq *req,
-                            HttpResp *resp,
-                            SeriesWork *) -> WFGoTask *
+            [handler, aspects](const HttpReq *req,
+                               HttpResp *resp,
+                               SeriesWork *) -> WFGoTask *
             {
-                GlobalAspect *global_aspect = GlobalAspect::get_instance();
-                for(auto asp : global_aspect->aspect_list)
-                {
-                    asp->before(req, resp);
-                }
-
-                handler(req, resp);
-
-                if(!global_aspect->aspect_list.empty())
-                {
-                    HttpServerTask *server_task = task_of(resp);
-                    server_task->add_callback([req, resp, global_aspect](HttpTask *)
-                    {
-                        for(auto asp : global_aspect->aspect_list)
-                        {
-                            asp->after(req, resp);
-                        }
-                    });
-                }
-                return nullptr;
+                return detail::aop_process(handler,
+                                           req,
+                                           resp,
+                                           aspects.get());
             };
 
     router_.handle(route, -1, wrap_handler, verb);
@@ -37,33 +23,18 @@ void BluePrint::ROUTE(const char *route, const Handler &handler, Verb verb)
 
 void BluePrint::ROUTE(const char *route, int compute_queue_id, const Handler &handler, Verb verb)
 {
+    auto aspects = std::make_shared<RouteAspectChain<>>();
+    ComputePool *pool = ComputePool::get(compute_queue_id);
     WrapHandler wrap_handler =
-            [handler, compute_queue_id](HttpReq *req,
-                                        HttpResp *resp,
-                                        SeriesWork *) -> WFGoTask *
+            [handler, pool, aspects](HttpReq *req,
+                                     HttpResp *resp,
+                                     SeriesWork *) -> WFGoTask *
             {
-                GlobalAspect *global_aspect = GlobalAspect::get_instance();
-                for(auto asp : global_aspect->aspect_list)
-                {
-                    asp->before(req, resp);
-                }
-                WFGoTask *go_task = WFTaskFactory::create_go_task(
-                        "wfrest" + std::to_string(compute_queue_id),
-                        handler,
-                        req,
-                        resp);
-                if(!global_aspect->aspect_list.empty())
-                {
-                    HttpServerTask *server_task = task_of(resp);
-                    server_task->add_callback([req, resp, global_aspect](HttpTask *)
-                    {
-                        for(auto asp : global_aspect->aspect_list)
-                        {
-                            asp->after(req, resp);
-                        }
-                    });
-                }
-                return go_task;
+                return detail::aop_compute_process(handler,
+                                                   pool,
+                                                   req,
+                                                   resp,
+                                                   aspects.get());
             };
 
     router_.handle(route, compute_queue_id, wrap_handler, verb);
@@ -147,29 +118,17 @@ void BluePrint::HEAD(const char *route, int compute_queue_id, const Handler &han
 
 void BluePrint::ROUTE(const char *route, const SeriesHandler &handler, Verb verb)
 {
+    auto aspects = std::make_shared<RouteAspectChain<>>();
     WrapHandler wrap_handler =
-            [handler, this](const HttpReq *req,
-                            HttpResp *resp,
-                            SeriesWork *series) -> WFGoTask *
+            [handler, aspects](const HttpReq *req,
+                               HttpResp *resp,
+                               SeriesWork *series) -> WFGoTask *
             {
-                GlobalAspect *global_aspect = GlobalAspect::get_instance();
-                for(auto asp : global_aspect->aspect_list)
-                {
-                    asp->before(req, resp);
-                }
-                handler(req, resp, series);
-                if(!global_aspect->aspect_list.empty())
-                {
-                    HttpServerTask *server_task = task_of(resp);
-                    server_task->add_callback([req, resp, global_aspect](HttpTask *) 
-                    {
-                        for(auto asp : global_aspect->aspect_list)
-                        {
-                            asp->after(req, resp);
-                        }
-                    });
-                }
-                return nullptr;
+                return detail::aop_process(handler,
+                                           req,
+                                           resp,
+                                           series,
+                                           aspects.get());
             };
 
     router_.handle(route, -1, wrap_handler, verb);
@@ -177,34 +136,19 @@ void BluePrint::ROUTE(const char *route, const SeriesHandler &handler, Verb verb
 
 void BluePrint::ROUTE(const char *route, int compute_queue_id, const SeriesHandler &handler, Verb verb)
 {
+    auto aspects = std::make_shared<RouteAspectChain<>>();
+    ComputePool *pool = ComputePool::get(compute_queue_id);
     WrapHandler wrap_handler =
-            [handler, compute_queue_id, this](HttpReq *req,
-                                        HttpResp *resp,
-                                        SeriesWork *series) -> WFGoTask *
+            [handler, pool, aspects](HttpReq *req,
+                                     HttpResp *resp,
+                                     SeriesWork *series) -> WFGoTask *
             {
-                GlobalAspect *global_aspect = GlobalAspect::get_instance();
-                for(auto asp : global_aspect->aspect_list)
-                {
-                    asp->before(req, resp);
-                }
-                WFGoTask *go_task = WFTaskFactory::create_go_task(
-                        "wfrest" + std::to_string(compute_queue_id),
-                        handler,
-                        req,
-                        resp,
-                        series);
-                if(!global_aspect->aspect_list.empty())
-                {
-                    HttpServerTask *server_task = task_of(resp);
-                    server_task->add_callback([req, resp, global_aspect](HttpTask *) 
-                    {
-                        for(auto asp : global_aspect->aspect_list)
-                        {
-                            asp->after(req, resp);
-                        }
-                    });
-                }
-                return go_task;
+                return detail::aop_compute_process(handler,
+                                                   pool,
+                                                   req,
+                                                   resp,
+                                                   series,
+                                                   aspects.get());
             };
 
     router_.handle(route, compute_queue_id, wrap_handler, verb);
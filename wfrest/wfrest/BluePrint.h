@@ -2,6 +2,7 @@
 #define WFREST_BLUEPRINT_H_
 
 #include <functional>
+#include <memory>
 #include <utility>
 #include "wfrest/Noncopyable.h"
 #include "wfrest/Aspect.h"
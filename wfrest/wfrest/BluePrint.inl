@@ -7,172 +7,87 @@ namespace detail
 {
 
 // In order to reduce the use of generic programming, add some redundant code
-template<typename Tuple>
-WFGoTask *aop_process(const Handler &handler,
-                      const HttpReq *req,
-                      HttpResp *resp,
-                      Tuple *tp)
-{
-    bool ret = aop_before(req, resp, *tp);
-    if (!ret)
+inline WFGoTask *aop_process(const Handler &handler,
+                             const HttpReq *req,
+                             HttpResp *resp,
+                             const AspectChain *aspects)
+{
+    if (!aspects->before(req, resp))
     {
         return nullptr;
     }
-    GlobalAspect *global_aspect = GlobalAspect::get_instance();
-    for(auto asp : global_aspect->aspect_list)
-    {
-        ret = asp->before(req, resp);
-        if(!ret) return nullptr;
-    }
     handler(req, resp);
-    HttpServerTask *server_task = task_of(resp);
-    server_task->add_callback([req, resp, tp, global_aspect](HttpTask *) 
-    {
-        aop_after(req, resp, *tp);
-        for(auto asp : global_aspect->aspect_list)
-        {
-            asp->after(req, resp);
-        }
-        delete tp;
-    });
-
+    task_of(resp)->set_aspects(aspects);
     return nullptr;
 }
 
-template<typename Tuple>
-WFGoTask *aop_process(const SeriesHandler &handler,
-                      const HttpReq *req,
-                      HttpResp *resp,
-                      SeriesWork *series,
-                      Tuple *tp)
+inline WFGoTask *aop_process(const SeriesHandler &handler,
+                             const HttpReq *req,
+                             HttpResp *resp,
+                             SeriesWork *series,
+                             const AspectChain *aspects)
 {
-    bool ret = aop_before(req, resp, *tp);
-    if (!ret)
+    if (!aspects->before(req, resp))
     {
         return nullptr;
     }
-    GlobalAspect *global_aspect = GlobalAspect::get_instance();
-    for(auto asp : global_aspect->aspect_list)
-    {
-        ret = asp->before(req, resp);
-        if(!ret) return nullptr;
-    }
     handler(req, resp, series);
-
-    HttpServerTask *server_task = task_of(resp);
-
-    server_task->add_callback([req, resp, tp, global_aspect](HttpTask *) 
-    {
-        aop_after(req, resp, *tp);
-        for(auto asp : global_aspect->aspect_list)
-        {
-            asp->after(req, resp);
-        }
-        delete tp;
-    });
-
+    task_of(resp)->set_aspects(aspects);
     return nullptr;
 }
 
-template<typename Tuple>
-WFGoTask *aop_compute_process(const Handler &handler,
-                              int compute_queue_id,
-                              const HttpReq *req,
-                              HttpResp *resp,
-                              Tuple *tp)
+inline WFGoTask *aop_compute_process(const Handler &handler,
+                                     ComputePool *pool,
+                                     const HttpReq *req,
+                                     HttpResp *resp,
+                                     const AspectChain *aspects)
 {
-    bool ret = aop_before(req, resp, *tp);
-    if (!ret)
+    if (!aspects->before(req, resp))
     {
         return nullptr;
     }
-    GlobalAspect *global_aspect = GlobalAspect::get_instance();
-    for(auto asp : global_aspect->aspect_list)
-    {
-        ret = asp->before(req, resp);
-        if(!ret) return nullptr;
-    }
-    WFGoTask *go_task = WFTaskFactory::create_go_task(
-            "wfrest" + std::to_string(compute_queue_id),
-            handler,
-            req,
-            resp);
-
-    HttpServerTask *server_task = task_of(resp);
-
-    server_task->add_callback([req, resp, tp, global_aspect](HttpTask *) 
-    {
-        aop_after(req, resp, *tp);
-        for(auto asp : global_aspect->aspect_list)
-        {
-            asp->after(req, resp);
-        }
-        delete tp;
-    });
-
+    WFGoTask *go_task = pool->create_go_task(resp->before_deadline(std::bind(handler, req, resp)));
+    if (!go_task)
+        resp->Error(StatusComputeQueueFull);
+    task_of(resp)->set_aspects(aspects);
     return go_task;
 }
 
-
-template<typename Tuple>
-WFGoTask *aop_compute_process(const SeriesHandler &handler,
-                              int compute_queue_id,
-                              const HttpReq *req,
-                              HttpResp *resp,
-                              SeriesWork *series,
-                              Tuple *tp)
+inline WFGoTask *aop_compute_process(const SeriesHandler &handler,
+                                     ComputePool *pool,
+                                     const HttpReq *req,
+                                     HttpResp *resp,
+                                     SeriesWork *series,
+                                     const AspectChain *aspects)
 {
-    bool ret = aop_before(req, resp, *tp);
-    if (!ret)
+    if (!aspects->before(req, resp))
     {
         return nullptr;
     }
-    GlobalAspect *global_aspect = GlobalAspect::get_instance();
-    for(auto asp : global_aspect->aspect_list)
-    {
-        ret = asp->before(req, resp);
-        if(!ret) return nullptr;
-    }
-    WFGoTask *go_task = WFTaskFactory::create_go_task(
-            "wfrest" + std::to_string(compute_queue_id),
-            handler,
-            req,
-            resp,
-            series);
-
-    HttpServerTask *server_task = task_of(resp);
-
-    server_task->add_callback([req, resp, tp, global_aspect](HttpTask *) 
-    {
-        aop_after(req, resp, *tp);
-        for(auto asp : global_aspect->aspect_list)
-        {
-            asp->after(req, resp);
-        }
-        delete tp;
-    });
-    
+    WFGoTask *go_task = pool->create_go_task(resp->before_deadline(std::bind(handler, req, resp, series)));
+    if (!go_task)
+        resp->Error(StatusComputeQueueFull);
+    task_of(resp)->set_aspects(aspects);
     return go_task;
 }
 
-
 }  // namespace detail
 
 template<typename... AP>
 void BluePrint::ROUTE(const char *route, const Handler &handler, 
             Verb verb, const AP &... ap)
 {
+    // shared by the copies of the handler, alive as long as the route
+    auto aspects = std::make_shared<RouteAspectChain<AP...>>(ap...);
     WrapHandler wrap_handler =
-            [handler, this, ap...](const HttpReq *req,
-                             HttpResp *resp,
-                             SeriesWork *) -> WFGoTask *
+            [handler, aspects](const HttpReq *req,
+                               HttpResp *resp,
+                               SeriesWork *) -> WFGoTask *
             {
-                auto *tp = new std::tuple<AP...>(std::move(ap)...);
-                WFGoTask *go_task = detail::aop_process(handler,
-                                                        req,
-                                                        resp,
-                                                        tp);
-                return go_task;
+                return detail::aop_process(handler,
+                                           req,
+                                           resp,
+                                           aspects.get());
             };
 
     router_.handle(route, -1, wrap_handler, verb);
@@ -182,18 +97,18 @@ template<typename... AP>
 void BluePrint::ROUTE(const char *route, int compute_queue_id, 
             const Handler &handler, Verb verb, const AP &... ap)
 {
+    auto aspects = std::make_shared<RouteAspectChain<AP...>>(ap...);
+    ComputePool *pool = ComputePool::get(compute_queue_id);
     WrapHandler wrap_handler =
-            [handler, compute_queue_id, this, ap...](HttpReq *req,
-                                               HttpResp *resp,
-                                               SeriesWork *) -> WFGoTask *
+            [handler, pool, aspects](HttpReq *req,
+                                     HttpResp *resp,
+                                     SeriesWork *) -> WFGoTask *
             {
-                auto *tp = new std::tuple<AP...>(std::move(ap)...);
-                WFGoTask *go_task = detail::aop_compute_process(handler,
-                                                                compute_queue_id,
-                                                                req,
-                                                                resp,
-                                                                tp);
-                return go_task;
+                return detail::aop_compute_process(handler,
+                                                   pool,
+                                                   req,
+                                                   resp,
+                                                   aspects.get());
             };
 
     router_.handle(route, compute_queue_id, wrap_handler, verb);
@@ -302,18 +217,17 @@ template<typename... AP>
 void BluePrint::ROUTE(const char *route, const SeriesHandler &handler, 
             Verb verb, const AP &... ap)
 {
+    auto aspects = std::make_shared<RouteAspectChain<AP...>>(ap...);
     WrapHandler wrap_handler =
-            [handler, this, ap...](const HttpReq *req,
-                             HttpResp *resp,
-                             SeriesWork *series) -> WFGoTask *
+            [handler, aspects](const HttpReq *req,
+                               HttpResp *resp,
+                               SeriesWork *series) -> WFGoTask *
             {
-                auto *tp = new std::tuple<AP...>(std::move(ap)...);
-                WFGoTask *go_task = detail::aop_process(handler,
-                                                        req,
-                                                        resp,
-                                                        series,
-                                                        tp);
-                return go_task;
+                return detail::aop_process(handler,
+                                           req,
+                                           resp,
+                                           series,
+                                           aspects.get());
             };
 
     router_.handle(route, -1, wrap_handler, verb);
@@ -323,19 +237,19 @@ template<typename... AP>
 void BluePrint::ROUTE(const char *route, int compute_queue_id, 
             const SeriesHandler &handler, Verb verb, const AP &... ap)
 {
+    auto aspects = std::make_shared<RouteAspectChain<AP...>>(ap...);
+    ComputePool *pool = ComputePool::get(compute_queue_id);
     WrapHandler wrap_handler =
-            [handler, compute_queue_id, this, ap...](HttpReq *req,
-                                               HttpResp *resp,
-                                               SeriesWork *series) -> WFGoTask *
+            [handler, pool, aspects](HttpReq *req,
+                                     HttpResp *resp,
+                                     SeriesWork *series) -> WFGoTask *
             {
-                auto *tp = new std::tuple<AP...>(std::move(ap)...);
-                WFGoTask *go_task = detail::aop_compute_process(handler,
-                                                                compute_queue_id,
-                                                                req,
-                                                                resp,
-                                                                series,
-                                                                tp);
-                return go_task;
+                return detail::aop_compute_process(handler,
+                                                   pool,
+                                                   req,
+                                                   resp,
+                                                   series,
+                                                   aspects.get());
             };
 
     router_.handle(route, compute_queue_id, wrap_handler, verb);  
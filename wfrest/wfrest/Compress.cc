@@ -1,7 +1,16 @@
 ﻿
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <map>
+#include <memory>
+#ifdef USE_ZSTD
+#include <zdict.h>
+#endif
 #include "wfrest/Compress.h"
 #include "wfrest/ErrorCode.h"
+#include "wfrest/StrUtil.h"
+#include "wfrest/FileUtil.h"
 #include "XLogger.h"
 
 namespace wfrest
@@ -14,10 +23,15 @@ const char* compress_method_to_str(const Compress& compress_method)
             return "gzip";
         case Compress::BROTLI:
             return "br";
+        case Compress::ZSTD:
+            return "zstd";
         default:
             return "unsupport compression";
     }
 }
+
+const std::string Compressor::k_zstd_dict_header = "Zstd-Dictionary-Id";
+
 }  // namespace wfrest
 
 using namespace wfrest;
@@ -89,83 +103,171 @@ int Compressor::gzip(const char *data, const size_t len, std::string *dest)
     }
     return StatusCompressError;
 }
-int Compressor::ungzip(const std::string * const src, std::string *dest)
+namespace
 {
-    const char *data = src->c_str();
-    const size_t len = src->size();
-    return ungzip(data, len, dest);
-}
 
-int Compressor::ungzip(const char *data, const size_t len, std::string *dest)
+// Every thread keeps one inflate stream, inflateReset2() reuses its 32 KB window
+// instead of allocating a new one per request body.
+struct InflateContext
 {
-    dest->clear();
-    if (len == 0)
-        return StatusOK;
+    z_stream strm;
+    bool inited = false;
 
-    auto full_length = len;
+    ~InflateContext()
+    {
+        if (inited)
+            inflateEnd(&strm);
+    }
+};
 
-    auto decompressed = std::string(full_length * 2, 0);
-    bool done = false;
+// deflate can not expand data more than 1032 : 1
+const size_t k_max_inflate_ratio = 1032;
 
-    z_stream strm = {nullptr,
-                     0,
-                     0,
-                     nullptr,
-                     0,
-                     0,
-                     nullptr,
-                     nullptr,
-                     nullptr,
-                     nullptr,
-                     nullptr,
-                     0,
-                     0,
-                     0};
-    strm.next_in = (Bytef *)data;
-    strm.avail_in = static_cast<uInt>(len);
-    strm.total_out = 0;
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    if (inflateInit2(&strm, (15 + 32)) != Z_OK)
+// We need room for one byte more than max_size to tell 
+// "exactly max_size" from "too large"
+size_t output_limit(size_t max_size)
+{
+    return max_size == static_cast<size_t>(-1) ? max_size : max_size + 1;
+}
+
+size_t grow_size(size_t size, size_t limit)
+{
+    size_t new_size = size > limit / 2 ? limit : size * 2;
+    return new_size > 0 ? new_size : 1;
+}
+
+int inflate_data(const char *data, const size_t len, int window_bits,
+                 size_t size_hint, size_t max_size, std::string *dest)
+{
+    thread_local InflateContext kContext;
+    z_stream *strm = &kContext.strm;
+    if (!kContext.inited)
     {
-        XLOG_ERROR("deflateInit2 error!");
+        memset(strm, 0, sizeof (z_stream));
+        if (inflateInit2(strm, window_bits) != Z_OK)
+        {
+            XLOG_ERROR("inflateInit2 error!");
+            return StatusUncompressError;
+        }
+        kContext.inited = true;
+    }
+    else if (inflateReset2(strm, window_bits) != Z_OK)
+    {
+        XLOG_ERROR("inflateReset2 error!");
         return StatusUncompressError;
     }
-    while (!done)
+
+    size_t limit = output_limit(max_size);
+    size_t capacity = size_hint > 0 ? size_hint : len * 2;
+    if (capacity > limit)
+        capacity = limit;
+
+    std::string decompressed(capacity > 0 ? capacity : 1, 0);
+    size_t total_out = 0;
+
+    strm->next_in = (Bytef *)data;
+    strm->avail_in = static_cast<uInt>(len);
+    while (true)
     {
-        // Make sure we have enough room and reset the lengths.
-        if (strm.total_out >= decompressed.length())
+        if (total_out == decompressed.size())
         {
-            decompressed.resize(decompressed.length() * 2);
+            if (decompressed.size() >= limit)
+                return StatusUncompressTooLarge;
+            decompressed.resize(grow_size(decompressed.size(), limit));
         }
-        strm.next_out = (Bytef *)decompressed.data() + strm.total_out;
-        strm.avail_out =
-                static_cast<uInt>(decompressed.length() - strm.total_out);
-        // Inflate another chunk.
-        int status = inflate(&strm, Z_SYNC_FLUSH);
+        strm->next_out = (Bytef *)&decompressed[total_out];
+        strm->avail_out = static_cast<uInt>(decompressed.size() - total_out);
+
+        int status = inflate(strm, Z_NO_FLUSH);
+        total_out = decompressed.size() - strm->avail_out;
         if (status == Z_STREAM_END)
-        {
-            done = true;
-        }
-        else if (status != Z_OK)
-        {
             break;
+        if (status == Z_BUF_ERROR && strm->avail_out == 0)
+            continue;
+        if (status != Z_OK || (strm->avail_in == 0 && strm->avail_out > 0))
+        {
+            // corrupted or truncated stream
+            return StatusUncompressError;
         }
     }
-    if (inflateEnd(&strm) != Z_OK)
-        return StatusUncompressError;
-    // Set real length.
-    int status = StatusOK;
-    if (done)
+    if (total_out > max_size)
+        return StatusUncompressTooLarge;
+
+    decompressed.resize(total_out);
+    *dest = std::move(decompressed);
+    return StatusOK;
+}
+
+}  // namespace
+
+int Compressor::ungzip(const std::string * const src, std::string *dest)
+{
+    const char *data = src->c_str();
+    const size_t len = src->size();
+    return ungzip(data, len, dest);
+}
+
+int Compressor::ungzip(const char *data, const size_t len, std::string *dest)
+{
+    return ungzip(data, len, dest, static_cast<size_t>(-1));
+}
+
+int Compressor::ungzip(const char *data, const size_t len, std::string *dest, size_t max_size)
+{
+    dest->clear();
+    if (len == 0)
+        return StatusOK;
+
+    // The gzip trailer ends with ISIZE, the uncompressed size modulo 2^32.
+    // It is only a hint (the sender controls it), so it is clamped by
+    // the deflate ratio and max_size before we allocate once for it.
+    size_t size_hint = 0;
+    if (len >= 18 && static_cast<unsigned char>(data[0]) == 0x1f &&
+        static_cast<unsigned char>(data[1]) == 0x8b)
     {
-        decompressed.resize(strm.total_out);
-        *dest = std::move(decompressed);
+        const unsigned char *isize = reinterpret_cast<const unsigned char *>(data + len - 4);
+        size_hint = static_cast<size_t>(isize[0]) |
+                    static_cast<size_t>(isize[1]) << 8 |
+                    static_cast<size_t>(isize[2]) << 16 |
+                    static_cast<size_t>(isize[3]) << 24;
+        if (size_hint / k_max_inflate_ratio > len)
+            size_hint = 0;
+        else
+            size_hint += 1;     // let inflate() see the end of stream without growing
     }
-    else
+    // 15 + 32 : gzip or zlib format with automatic header detection
+    return inflate_data(data, len, 15 + 32, size_hint, max_size, dest);
+}
+
+int Compressor::undeflate(const std::string * const src, std::string *dest)
+{
+    const char *data = src->c_str();
+    const size_t len = src->size();
+    return undeflate(data, len, dest);
+}
+
+int Compressor::undeflate(const char *data, const size_t len, std::string *dest)
+{
+    return undeflate(data, len, dest, static_cast<size_t>(-1));
+}
+
+int Compressor::undeflate(const char *data, const size_t len, std::string *dest, size_t max_size)
+{
+    dest->clear();
+    if (len == 0)
+        return StatusOK;
+
+    // "deflate" in http means the zlib format (RFC 1950), 
+    // but some clients send a raw deflate stream, so accept both
+    int window_bits = -15;
+    if (len >= 2)
     {
-        status = StatusUncompressError;
+        unsigned int cmf = static_cast<unsigned char>(data[0]);
+        unsigned int flg = static_cast<unsigned char>(data[1]);
+        if ((cmf & 0x0f) == Z_DEFLATED && (cmf * 256 + flg) % 31 == 0)
+            window_bits = 15;
     }
-    return status;
+    return inflate_data(data, len, window_bits, 0, max_size, dest);
 }
 
 #ifdef USE_BROTLI
@@ -213,15 +315,21 @@ int Compressor::unbrotli(const std::string * const src, std::string *dest)
 }
 
 int Compressor::unbrotli(const char *data, const size_t len, std::string *dest)
+{
+    return unbrotli(data, len, dest, static_cast<size_t>(-1));
+}
+
+int Compressor::unbrotli(const char *data, const size_t len, std::string *dest, size_t max_size)
 {
     dest->clear();
     int status = StatusOK;
     if (len == 0)
         return StatusOK;
 
+    size_t limit = output_limit(max_size);
     size_t availableIn = len;
     auto nextIn = (const uint8_t *)(data);
-    auto decompressed = std::string(availableIn * 3, 0);
+    auto decompressed = std::string(std::min(availableIn * 3, limit), 0);
     size_t availableOut = decompressed.size();
     auto nextOut = (uint8_t *)(decompressed.data());
     size_t totalOut{0};
@@ -233,16 +341,27 @@ int Compressor::unbrotli(const char *data, const size_t len, std::string *dest)
             s, &availableIn, &nextIn, &availableOut, &nextOut, &totalOut);
         if (result == BROTLI_DECODER_RESULT_SUCCESS)
         {
-            decompressed.resize(totalOut);
             done = true;
+            if (totalOut > max_size)
+            {
+                status = StatusUncompressTooLarge;
+                break;
+            }
+            decompressed.resize(totalOut);
             *dest = std::move(decompressed);
         }
         else if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT)
         {
             assert(totalOut == decompressed.size());
-            decompressed.resize(totalOut * 2);
+            if (totalOut >= limit)
+            {
+                done = true;
+                status = StatusUncompressTooLarge;
+                break;
+            }
+            decompressed.resize(grow_size(totalOut, limit));
             nextOut = (uint8_t *)(decompressed.data() + totalOut);
-            availableOut = totalOut;
+            availableOut = decompressed.size() - totalOut;
         }
         else
         {
@@ -280,4 +399,352 @@ int Compressor::unbrotli(const char *, const size_t, std::string *)
     return StatusUncompressNotSupport;
 }
 
-#endif
\ No newline at end of file
+int Compressor::unbrotli(const char *, const size_t, std::string *, size_t)
+{
+    XLOG_ERROR("If you do not have the brotli package installed, you cannot use brotli()!");
+    return StatusUncompressNotSupport;
+}
+
+#endif
+
+#ifdef USE_ZSTD
+
+namespace
+{
+
+struct ZstdDict
+{
+    ZSTD_CDict *cdict = nullptr;
+    ZSTD_DDict *ddict = nullptr;
+
+    ~ZstdDict()
+    {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
+};
+
+// dict id -> digested dictionary
+// Only written by zstd_load_dict() at startup, read-only while serving.
+std::map<unsigned int, std::unique_ptr<ZstdDict>> &zstd_dicts()
+{
+    static std::map<unsigned int, std::unique_ptr<ZstdDict>> kDicts;
+    return kDicts;
+}
+
+const ZstdDict *find_zstd_dict(unsigned int dict_id)
+{
+    auto &dicts = zstd_dicts();
+    auto it = dicts.find(dict_id);
+    if (it == dicts.end())
+        return nullptr;
+    return it->second.get();
+}
+
+// Creating a context costs more than compressing a 2 KB json, 
+// so every thread keeps its own pair.
+struct ZstdContext
+{
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+
+    ~ZstdContext()
+    {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+};
+
+ZstdContext &zstd_context()
+{
+    thread_local ZstdContext kContext;
+    return kContext;
+}
+
+}  // namespace
+
+int Compressor::zstd(const std::string * const src, std::string *dest)
+{
+    const char *data = src->c_str();
+    const size_t len = src->size();
+    return zstd(data, len, dest, 0);
+}
+
+int Compressor::zstd(const char *data, const size_t len, std::string *dest)
+{
+    return zstd(data, len, dest, 0);
+}
+
+int Compressor::zstd(const char *data, const size_t len, std::string *dest, unsigned int dict_id)
+{
+    dest->clear();
+    if (len == 0)
+        return StatusOK;
+
+    const ZstdDict *dict = nullptr;
+    if (dict_id != 0)
+    {
+        dict = find_zstd_dict(dict_id);
+        if (!dict)
+        {
+            XLOG_ERROR("zstd dictionary {} is not loaded", dict_id);
+            return StatusCompressError;
+        }
+    }
+
+    std::string ret;
+    ret.resize(ZSTD_compressBound(len));
+    ZSTD_CCtx *cctx = zstd_context().cctx;
+    size_t encoded_size;
+    if (dict)
+    {
+        encoded_size = ZSTD_compress_usingCDict(cctx, &ret[0], ret.size(),
+                                                data, len, dict->cdict);
+    }
+    else
+    {
+        encoded_size = ZSTD_compressCCtx(cctx, &ret[0], ret.size(),
+                                         data, len, ZSTD_CLEVEL_DEFAULT);
+    }
+    if (ZSTD_isError(encoded_size))
+    {
+        XLOG_ERROR("zstd compress error : {}", ZSTD_getErrorName(encoded_size));
+        return StatusCompressError;
+    }
+    ret.resize(encoded_size);
+    *dest = std::move(ret);
+    return StatusOK;
+}
+
+int Compressor::unzstd(const std::string * const src, std::string *dest)
+{
+    const char *data = src->c_str();
+    const size_t len = src->size();
+    return unzstd(data, len, dest);
+}
+
+int Compressor::unzstd(const char *data, const size_t len, std::string *dest)
+{
+    return unzstd(data, len, dest, static_cast<size_t>(-1));
+}
+
+int Compressor::unzstd(const char *data, const size_t len, std::string *dest, size_t max_size)
+{
+    dest->clear();
+    if (len == 0)
+        return StatusOK;
+
+    ZSTD_DCtx *dctx = zstd_context().dctx;
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+
+    const ZstdDict *dict = nullptr;
+    unsigned int dict_id = ZSTD_getDictID_fromFrame(data, len);
+    if (dict_id != 0)
+    {
+        dict = find_zstd_dict(dict_id);
+        if (!dict)
+        {
+            XLOG_ERROR("zstd dictionary {} is not loaded", dict_id);
+            return StatusUncompressError;
+        }
+    }
+    ZSTD_DCtx_refDDict(dctx, dict ? dict->ddict : nullptr);
+
+    unsigned long long content_size = ZSTD_getFrameContentSize(data, len);
+    if (content_size == ZSTD_CONTENTSIZE_ERROR)
+        return StatusUncompressError;
+
+    // One shot compression always records the content size, 
+    // streaming encoders may not.
+    size_t limit = output_limit(max_size);
+    std::string decompressed;
+    if (content_size != ZSTD_CONTENTSIZE_UNKNOWN)
+    {
+        if (content_size > max_size)
+            return StatusUncompressTooLarge;
+        decompressed.resize(content_size > 0 ? content_size : 1);
+    }
+    else
+    {
+        decompressed.resize(std::min(len * 3, limit));
+    }
+
+    ZSTD_inBuffer input = { data, len, 0 };
+    ZSTD_outBuffer output = { &decompressed[0], decompressed.size(), 0 };
+    while (true)
+    {
+        size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(ret))
+        {
+            XLOG_ERROR("zstd decompress error : {}", ZSTD_getErrorName(ret));
+            return StatusUncompressError;
+        }
+        if (ret == 0)   // frame is completely decoded and flushed
+            break;
+        if (output.pos == output.size)
+        {
+            if (decompressed.size() >= limit)
+                return StatusUncompressTooLarge;
+            decompressed.resize(grow_size(decompressed.size(), limit));
+            output.dst = &decompressed[0];
+            output.size = decompressed.size();
+        }
+        else if (input.pos == input.size)
+        {
+            // truncated frame
+            return StatusUncompressError;
+        }
+    }
+    if (output.pos > max_size)
+        return StatusUncompressTooLarge;
+
+    decompressed.resize(output.pos);
+    *dest = std::move(decompressed);
+    return StatusOK;
+}
+
+int Compressor::zstd_train_dict(const std::vector<std::string> &samples, 
+                                size_t dict_capacity, std::string *dict)
+{
+    dict->clear();
+    std::string samples_buf;
+    std::vector<size_t> samples_size;
+    samples_size.reserve(samples.size());
+    for (const auto &sample : samples)
+    {
+        samples_buf.append(sample);
+        samples_size.push_back(sample.size());
+    }
+
+    std::string ret;
+    ret.resize(dict_capacity);
+    size_t dict_size = ZDICT_trainFromBuffer(&ret[0], ret.size(), 
+                                             samples_buf.data(), 
+                                             samples_size.data(), 
+                                             static_cast<unsigned>(samples_size.size()));
+    if (ZDICT_isError(dict_size))
+    {
+        XLOG_ERROR("zstd train dictionary error : {}", ZDICT_getErrorName(dict_size));
+        return StatusCompressError;
+    }
+    ret.resize(dict_size);
+    *dict = std::move(ret);
+    return StatusOK;
+}
+
+int Compressor::zstd_load_dict(const char *data, const size_t len, unsigned int *dict_id)
+{
+    // raw content dictionaries carry no id, so the client could not name them
+    unsigned int id = ZSTD_getDictID_fromDict(data, len);
+    if (id == 0)
+    {
+        XLOG_ERROR("Not a trained zstd dictionary");
+        return StatusCompressError;
+    }
+
+    std::unique_ptr<ZstdDict> dict(new ZstdDict);
+    dict->cdict = ZSTD_createCDict(data, len, ZSTD_CLEVEL_DEFAULT);
+    dict->ddict = ZSTD_createDDict(data, len);
+    if (!dict->cdict || !dict->ddict)
+    {
+        XLOG_ERROR("zstd load dictionary {} error", id);
+        return StatusCompressError;
+    }
+    zstd_dicts()[id] = std::move(dict);
+    *dict_id = id;
+    return StatusOK;
+}
+
+#else
+
+int Compressor::zstd(const std::string * const, std::string *)
+{
+    XLOG_ERROR("If you do not have the zstd package installed, you cannot use zstd()!");
+    return StatusCompressNotSupport;
+}
+
+int Compressor::zstd(const char *, const size_t, std::string *)
+{
+    XLOG_ERROR("If you do not have the zstd package installed, you cannot use zstd()!");
+    return StatusCompressNotSupport;
+}
+
+int Compressor::zstd(const char *, const size_t, std::string *, unsigned int)
+{
+    XLOG_ERROR("If you do not have the zstd package installed, you cannot use zstd()!");
+    return StatusCompressNotSupport;
+}
+
+int Compressor::unzstd(const std::string * const, std::string *)
+{
+    XLOG_ERROR("If you do not have the zstd package installed, you cannot use zstd()!");
+    return StatusUncompressNotSupport;
+}
+
+int Compressor::unzstd(const char *, const size_t, std::string *)
+{
+    XLOG_ERROR("If you do not have the zstd package installed, you cannot use zstd()!");
+    return StatusUncompressNotSupport;
+}
+
+int Compressor::unzstd(const char *, const size_t, std::string *, size_t)
+{
+    XLOG_ERROR("If you do not have the zstd package installed, you cannot use zstd()!");
+    return StatusUncompressNotSupport;
+}
+
+int Compressor::zstd_train_dict(const std::vector<std::string> &, size_t, std::string *)
+{
+    XLOG_ERROR("If you do not have the zstd package installed, you cannot use zstd()!");
+    return StatusCompressNotSupport;
+}
+
+int Compressor::zstd_load_dict(const char *, const size_t, unsigned int *)
+{
+    XLOG_ERROR("If you do not have the zstd package installed, you cannot use zstd()!");
+    return StatusCompressNotSupport;
+}
+
+#endif
+
+int Compressor::zstd_load_dict(const std::string &path, unsigned int *dict_id)
+{
+    size_t size;
+    int ret = FileUtil::size(path, OUT &size);
+    if (ret != StatusOK)
+        return ret;
+
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+        return StatusNotFound;
+
+    std::string dict;
+    dict.resize(size);
+    size_t read_len = fread(&dict[0], 1, size, f);
+    fclose(f);
+    if (read_len != size)
+        return StatusFileReadError;
+
+    return zstd_load_dict(dict.data(), dict.size(), dict_id);
+}
+
+unsigned int Compressor::zstd_negotiate_dict(const std::string &client_dict_ids)
+{
+#ifdef USE_ZSTD
+    if (client_dict_ids.empty())
+        return 0;
+
+    // client lists its dictionaries by preference
+    std::vector<StringPiece> id_list = StrUtil::split_piece<StringPiece>(client_dict_ids, ',');
+    for (const auto &id_piece : id_list)
+    {
+        std::string id_str = StrUtil::trim(id_piece).as_string();
+        if (id_str.empty())
+            continue;
+        unsigned int dict_id = static_cast<unsigned int>(strtoul(id_str.c_str(), nullptr, 10));
+        if (dict_id != 0 && find_zstd_dict(dict_id))
+            return dict_id;
+    }
+#endif
+    return 0;
+}
@@ -1,16 +1,22 @@
 ﻿// Modified from drogon
 // https://zlib.net/manual.html
 // https://github.com/google/brotli
+// https://facebook.github.io/zstd/zstd_manual.html
 
 #ifndef WFREST_COMPRESS_H_
 #define WFREST_COMPRESS_H_
 
 #include <string>
+#include <vector>
 #include <zlib.h>
 #ifdef USE_BROTLI
 #include <brotli/decode.h>
 #include <brotli/encode.h>
 #endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+#include "wfrest/Macro.h"
 
 namespace wfrest
 {
@@ -18,7 +24,8 @@ namespace wfrest
 enum class Compress 
 {
     GZIP,
-    BROTLI
+    BROTLI,
+    ZSTD
 };
 
 const char* compress_method_to_str(const Compress& compress_method);
@@ -34,6 +41,17 @@ public:
     
     static int ungzip(const char *data, const size_t len, std::string *dest);
 
+    // Bounded versions for untrusted input (request bodies) :
+    // return StatusUncompressTooLarge as soon as the output would exceed max_size
+    static int ungzip(const char *data, const size_t len, std::string *dest, size_t max_size);
+
+    // zlib (RFC 1950) or raw deflate (RFC 1951) data
+    static int undeflate(const std::string * const src, std::string *dest);
+
+    static int undeflate(const char *data, const size_t len, std::string *dest);
+
+    static int undeflate(const char *data, const size_t len, std::string *dest, size_t max_size);
+
     static int brotli(const std::string * const src, std::string *dest);
 
     static int brotli(const char *data, const size_t len, std::string *dest);
@@ -41,6 +59,41 @@ public:
     static int unbrotli(const std::string * const src, std::string *dest);
 
     static int unbrotli(const char *data, const size_t len, std::string *dest);
+
+    static int unbrotli(const char *data, const size_t len, std::string *dest, size_t max_size);
+
+    static int zstd(const std::string * const src, std::string *dest);
+
+    static int zstd(const char *data, const size_t len, std::string *dest);
+
+    // dict_id is the id of a dictionary loaded by zstd_load_dict(), 0 means no dictionary
+    static int zstd(const char *data, const size_t len, std::string *dest, unsigned int dict_id);
+
+    // the dictionary is picked by the dictionary id in the frame header
+    static int unzstd(const std::string * const src, std::string *dest);
+
+    static int unzstd(const char *data, const size_t len, std::string *dest);
+
+    static int unzstd(const char *data, const size_t len, std::string *dest, size_t max_size);
+
+public:
+    // zstd dictionary mode, for small responses (1~4 KB json) where gzip barely helps.
+    // 1. offline : train a dictionary from sample responses and save it to a file
+    // 2. startup : load it before the server starts, the dictionaries are read-only afterwards
+    // 3. request : the client lists the dictionary ids it holds in k_zstd_dict_header,
+    //              the server answers with the id it used in the same header
+    static int zstd_train_dict(const std::vector<std::string> &samples, 
+                               size_t dict_capacity, OUT std::string *dict);
+
+    static int zstd_load_dict(const std::string &path, OUT unsigned int *dict_id);
+
+    static int zstd_load_dict(const char *data, const size_t len, OUT unsigned int *dict_id);
+
+    // Zstd-Dictionary-Id: 1248637042, 87021734
+    // return the first id we also hold, 0 if none
+    static unsigned int zstd_negotiate_dict(const std::string &client_dict_ids);
+
+    static const std::string k_zstd_dict_header;
 };
 
 }  // namespace wfrest
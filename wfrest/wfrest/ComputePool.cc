@@ -0,0 +1,282 @@
+﻿#include "workflow/WFGlobal.h"
+#include "workflow/Executor.h"
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "wfrest/ComputePool.h"
+#include "XLogger.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+// never destroyed, compute threads may still finish tasks at exit
+struct Registry
+{
+    std::mutex mutex;
+    std::map<int, ComputePool *> pools;
+    // the BATCH pools on the compute threads of workflow
+    std::vector<ComputePool *> batch_pools;
+};
+
+Registry *registry()
+{
+    static Registry *registry = new Registry;
+    return registry;
+}
+
+// 0 until set_batch_limit() or the first BATCH task
+std::atomic<size_t> g_batch_limit{0};
+std::atomic<size_t> g_batch_running{0};
+
+size_t batch_limit()
+{
+    size_t limit = g_batch_limit;
+    if (limit > 0)
+        return limit;
+    int threads = WFGlobal::get_global_settings()->compute_threads;
+    if (threads <= 0)
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+    limit = threads > 1 ? threads / 2 : 1;
+    g_batch_limit = limit;
+    return limit;
+}
+
+std::vector<ComputePool *> batch_pools()
+{
+    Registry *reg = registry();
+    std::lock_guard<std::mutex> lock(reg->mutex);
+    return reg->batch_pools;
+}
+
+}  // namespace
+
+class ComputePool::Task : public WFGoTask
+{
+public:
+    Task(ComputePool *pool, std::function<void ()> &&func)
+        : WFGoTask(pool->queue_, pool->executor_),
+        pool_(pool),
+        go_(std::move(func))
+    {}
+
+    ~Task()
+    {
+        pool_->finish(this);
+    }
+
+    // the series starts the task, the pool decides when it reaches the executor
+    void dispatch() override
+    {
+        pool_->submit(this);
+    }
+
+    void exec_dispatch()
+    {
+        this->ExecRequest::dispatch();
+    }
+
+protected:
+    void execute() override
+    {
+        started_ = true;
+        pool_->running_++;
+        go_();
+    }
+
+private:
+    ComputePool *pool_;
+    std::function<void ()> go_;
+    bool started_ = false;
+    // a slot of the pool, and of the batch limit
+    bool has_slot_ = false;
+    bool batch_slot_ = false;
+
+    friend class ComputePool;
+};
+
+ComputePool *ComputePool::get(int id)
+{
+    Registry *reg = registry();
+    std::lock_guard<std::mutex> lock(reg->mutex);
+    ComputePool *&pool = reg->pools[id];
+    if (!pool)
+        pool = new ComputePool("wfrest" + std::to_string(id), ComputePoolOptions());
+    return pool;
+}
+
+ComputePool *ComputePool::configure(int id, const ComputePoolOptions &options)
+{
+    ComputePool *pool = ComputePool::get(id);
+    pool->set_options(options);
+
+    Registry *reg = registry();
+    std::lock_guard<std::mutex> lock(reg->mutex);
+    auto it = std::find(reg->batch_pools.begin(), reg->batch_pools.end(), pool);
+    bool batch = options.priority == ComputePriority::BATCH && !pool->own_threads_;
+    if (batch && it == reg->batch_pools.end())
+        reg->batch_pools.push_back(pool);
+    else if (!batch && it != reg->batch_pools.end())
+        reg->batch_pools.erase(it);
+    return pool;
+}
+
+void ComputePool::set_batch_limit(size_t limit)
+{
+    g_batch_limit = limit > 0 ? limit : 1;
+    for (ComputePool *pool : batch_pools())
+        pool->drain();
+}
+
+ComputePool::ComputePool(const std::string &name, const ComputePoolOptions &options)
+    : name_(name),
+    queue_(WFGlobal::get_exec_queue(name)),
+    executor_(WFGlobal::get_compute_executor()),
+    max_running_(options.max_running),
+    max_queued_(options.max_queued),
+    batch_(options.priority == ComputePriority::BATCH)
+{
+}
+
+void ComputePool::set_options(const ComputePoolOptions &options)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    max_running_ = options.max_running;
+    max_queued_ = options.max_queued;
+    batch_ = options.priority == ComputePriority::BATCH;
+    if (options.threads > 0 && !own_threads_)
+    {
+        // the tasks made so far keep the shared queue
+        if (created_ > 0)
+        {
+            XLOG_ERROR("compute pool {} already in use, no threads of its own", name_);
+        }
+        else
+        {
+            auto *queue = new ExecQueue;
+            auto *executor = new Executor;
+            if (queue->init() < 0 || executor->init(options.threads) < 0)
+            {
+                XLOG_ERROR("compute pool {} : {} threads error", name_, options.threads);
+                delete queue;
+                delete executor;
+            }
+            else
+            {
+                // alive until the process exits, as the queues of workflow
+                queue_ = queue;
+                executor_ = executor;
+                own_threads_ = true;
+            }
+        }
+    }
+    if (own_threads_)
+        batch_ = false;
+    lock.unlock();
+    // higher limits let waiting tasks run
+    this->drain();
+}
+
+WFGoTask *ComputePool::create_go_task(std::function<void ()> &&func)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (max_queued_ > 0 && created_ - running_ >= max_queued_)
+        {
+            rejected_++;
+            return nullptr;
+        }
+        created_++;
+    }
+    return new Task(this, std::move(func));
+}
+
+ComputePoolStats ComputePool::stats() const
+{
+    ComputePoolStats stats;
+    stats.running = running_;
+    stats.queued = created_ - stats.running;
+    stats.rejected = rejected_;
+    stats.completed = completed_;
+    return stats;
+}
+
+void ComputePool::submit(Task *task)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!waiting_.empty() || !this->acquire_slot(task))
+    {
+        // a task releasing its slot takes this mutex before looking at waiting_
+        waiting_.push_back(task);
+        return;
+    }
+    lock.unlock();
+    task->exec_dispatch();
+}
+
+void ComputePool::finish(Task *task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (task->started_)
+        {
+            running_--;
+            completed_++;
+        }
+        created_--;
+        if (task->has_slot_)
+            dispatched_--;
+    }
+    if (!task->has_slot_)
+        return;
+
+    this->drain();
+    if (task->batch_slot_)
+    {
+        g_batch_running--;
+        // the slot may go to another BATCH pool
+        for (ComputePool *pool : batch_pools())
+            pool->drain();
+    }
+}
+
+void ComputePool::drain()
+{
+    std::vector<Task *> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!waiting_.empty() && this->acquire_slot(waiting_.front()))
+        {
+            ready.push_back(waiting_.front());
+            waiting_.pop_front();
+        }
+    }
+    // outside of the mutex, a task failing to start is finished right away
+    for (Task *task : ready)
+        task->exec_dispatch();
+}
+
+// with mutex_ held
+bool ComputePool::acquire_slot(Task *task)
+{
+    if (max_running_ > 0 && dispatched_ >= max_running_)
+        return false;
+    if (batch_)
+    {
+        size_t limit = batch_limit();
+        size_t running = g_batch_running;
+        do
+        {
+            if (running >= limit)
+                return false;
+        } while (!g_batch_running.compare_exchange_weak(running, running + 1));
+        task->batch_slot_ = true;
+    }
+    dispatched_++;
+    task->has_slot_ = true;
+    return true;
+}
@@ -0,0 +1,115 @@
+﻿#ifndef WFREST_COMPUTEPOOL_H_
+#define WFREST_COMPUTEPOOL_H_
+
+#include "workflow/WFTask.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "wfrest/Noncopyable.h"
+
+class ExecQueue;
+class Executor;
+
+namespace wfrest
+{
+
+enum class ComputePriority
+{
+    INTERACTIVE, BATCH
+};
+
+struct ComputePoolOptions
+{
+    // threads of its own, 0 runs on the compute threads of workflow
+    int threads = 0;
+    // tasks running at once, 0 no limit
+    size_t max_running = 0;
+    // tasks created and not running yet, a task beyond is refused (503), 0 no limit
+    size_t max_queued = 0;
+    // BATCH pools on the compute threads of workflow share the batch limit,
+    // INTERACTIVE pools always find the other compute threads
+    ComputePriority priority = ComputePriority::INTERACTIVE;
+};
+
+struct ComputePoolStats
+{
+    size_t running;
+    size_t queued;
+    size_t rejected;
+    size_t completed;
+};
+
+// The compute_queue_id of ROUTE(route, id, handler) and HttpResp::Compute(id, ...).
+// Its queue is resolved once, instead of looking up "wfrest" + id for every task.
+// A pool may cap the tasks it runs at once and refuse tasks beyond a queue depth,
+// so an expensive route can not take every compute thread from the others.
+// Pools live until the process exits.
+// Thread safety: YES
+class ComputePool : public Noncopyable
+{
+public:
+    // pool id, created with the default options (no limits) on first use
+    static ComputePool *get(int id);
+
+    // Options of pool id. Call before the server starts, the threads of a pool
+    // are only created if it has not made a task yet.
+    static ComputePool *configure(int id, const ComputePoolOptions &options);
+
+    // BATCH tasks running at once on the compute threads of workflow,
+    // half of them by default
+    static void set_batch_limit(size_t limit);
+
+    // nullptr when the queue is full
+    WFGoTask *create_go_task(std::function<void ()> &&func);
+
+    ComputePoolStats stats() const;
+
+    const std::string &name() const
+    { return name_; }
+
+private:
+    class Task;
+
+    ComputePool(const std::string &name, const ComputePoolOptions &options);
+
+    void set_options(const ComputePoolOptions &options);
+
+    // dispatch the task or keep it until a slot is free
+    void submit(Task *task);
+
+    void finish(Task *task);
+
+    // start the waiting tasks the slots allow
+    void drain();
+
+    bool acquire_slot(Task *task);
+
+    friend class Task;
+
+private:
+    std::string name_;
+    ExecQueue *queue_;
+    Executor *executor_;
+
+    mutable std::mutex mutex_;
+    size_t max_running_;
+    size_t max_queued_;
+    bool batch_;
+    bool own_threads_ = false;
+    // tasks dispatched to the executor and not finished yet
+    size_t dispatched_ = 0;
+    std::deque<Task *> waiting_;
+
+    std::atomic<size_t> created_{0};
+    std::atomic<size_t> running_{0};
+    std::atomic<size_t> rejected_{0};
+    std::atomic<size_t> completed_{0};
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_COMPUTEPOOL_H_
@@ -0,0 +1,171 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+
+#include "wfrest/ConcurrencyLimiter.h"
+#include "wfrest/HttpServerTask.h"
+#include "wfrest/ErrorCode.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+int64_t steady_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t steady_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the body HttpResp::Error(StatusOverloaded) would build
+const std::string &overloaded_body()
+{
+    static const std::string body = "{\"code\":503,\"msg\":\"" +
+                                    std::string(error_code_to_str(StatusOverloaded)) + "\"}";
+    return body;
+}
+
+}  // namespace
+
+ConcurrencyLimiter::ConcurrencyLimiter(const ConcurrencyLimitOptions &options)
+    : options_(options),
+    window_start_ms_(steady_ms())
+{
+    if (options_.min_limit == 0)
+        options_.min_limit = 1;
+    if (options_.max_limit < options_.min_limit)
+        options_.max_limit = options_.min_limit;
+    size_t limit = std::min(std::max(options_.initial_limit, options_.min_limit), options_.max_limit);
+    if (!options_.adaptive)
+        limit = std::max<size_t>(options_.initial_limit, 1);
+    limit_ = limit;
+    limit_value_ = static_cast<double>(limit);
+}
+
+bool ConcurrencyLimiter::try_acquire()
+{
+    size_t inflight = ++inflight_;
+    if (inflight > limit_)
+    {
+        inflight_--;
+        rejected_++;
+        return false;
+    }
+    accepted_++;
+    if (options_.adaptive)
+    {
+        size_t max = window_max_inflight_;
+        while (inflight > max && !window_max_inflight_.compare_exchange_weak(max, inflight))
+            ;
+    }
+    return true;
+}
+
+void ConcurrencyLimiter::release(int64_t latency_us)
+{
+    inflight_--;
+    if (!options_.adaptive)
+        return;
+
+    window_latency_us_ += latency_us;
+    if (++window_samples_ < options_.window_samples)
+        return;
+    int64_t now = steady_ms();
+    if (now - window_start_ms_ < options_.window_ms)
+        return;
+
+    std::unique_lock<std::mutex> lock(update_mutex_, std::try_to_lock);
+    if (lock.owns_lock())
+        this->update(now);
+}
+
+// with update_mutex_ held
+void ConcurrencyLimiter::update(int64_t now_ms)
+{
+    // another release may have ended this window already
+    if (window_samples_ < options_.window_samples || now_ms - window_start_ms_ < options_.window_ms)
+        return;
+
+    size_t samples = window_samples_.exchange(0);
+    int64_t latency_us = window_latency_us_.exchange(0);
+    size_t max_inflight = window_max_inflight_.exchange(inflight_);
+    window_start_ms_ = now_ms;
+    if (samples == 0)
+        return;
+
+    double short_latency = std::max<double>(1.0, static_cast<double>(latency_us) / samples);
+    double long_latency = static_cast<double>(long_latency_us_);
+    if (long_latency <= 0)
+    {
+        long_latency = short_latency;
+    }
+    else
+    {
+        // about the last 100 windows, a slowdown takes a while to look usual
+        long_latency = long_latency * 0.98 + short_latency * 0.02;
+        // latency fell for good, the long term one catches up faster
+        if (long_latency > 2 * short_latency)
+            long_latency *= 0.95;
+    }
+    long_latency_us_ = static_cast<int64_t>(long_latency);
+
+    double limit = limit_value_;
+    // the limit was not what held the requests back
+    if (max_inflight < limit / 2)
+        return;
+
+    double gradient = std::max(0.5, std::min(1.0, options_.tolerance * long_latency / short_latency));
+    double new_limit = limit * gradient + std::sqrt(limit);
+    limit = limit * (1 - options_.smoothing) + new_limit * options_.smoothing;
+    limit = std::max<double>(options_.min_limit, std::min<double>(options_.max_limit, limit));
+
+    limit_value_ = limit;
+    limit_ = static_cast<size_t>(limit);
+}
+
+ConcurrencyLimiterStats ConcurrencyLimiter::stats() const
+{
+    ConcurrencyLimiterStats stats;
+    stats.limit = limit_;
+    stats.inflight = inflight_;
+    stats.accepted = accepted_;
+    stats.rejected = rejected_;
+    stats.long_latency_us = long_latency_us_;
+    return stats;
+}
+
+bool ConcurrencyLimiter::admit(HttpServerTask *server_task)
+{
+    if (!this->try_acquire())
+    {
+        respond_overloaded(server_task->get_resp());
+        return false;
+    }
+    int64_t start = steady_us();
+    server_task->add_callback([this, start](HttpTask *)
+    {
+        this->release(steady_us() - start);
+    });
+    return true;
+}
+
+void ConcurrencyLimiter::respond_overloaded(HttpResp *resp)
+{
+    const std::string &body = overloaded_body();
+    resp->set_status(503);
+    resp->headers["Content-Type"] = "application/json";
+    resp->append_output_body_nocopy(body.data(), body.size());
+}
+
+bool ConcurrencyLimitAspect::before(const HttpReq *req, HttpResp *resp) const
+{
+    // released once the response is sent, even if a later aspect refuses the request
+    return limiter_->admit(task_of(resp));
+}
@@ -0,0 +1,124 @@
+﻿#ifndef WFREST_CONCURRENCYLIMITER_H_
+#define WFREST_CONCURRENCYLIMITER_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "wfrest/Aspect.h"
+#include "wfrest/HttpMsg.h"
+#include "wfrest/Noncopyable.h"
+
+namespace wfrest
+{
+
+class HttpServerTask;
+
+struct ConcurrencyLimitOptions
+{
+    // requests in flight at first, the limit stays within [min_limit, max_limit]
+    size_t initial_limit = 200;
+    size_t min_limit = 10;
+    size_t max_limit = 10000;
+    // false keeps initial_limit
+    bool adaptive = true;
+    // a latency up to tolerance times the long term latency is not queueing
+    double tolerance = 2.0;
+    // share of the new limit taken at each update, 0 to 1
+    double smoothing = 0.2;
+    // the limit is updated once a window is over, and has that many samples
+    int window_ms = 1000;
+    size_t window_samples = 50;
+};
+
+struct ConcurrencyLimiterStats
+{
+    size_t limit;
+    size_t inflight;
+    size_t accepted;
+    size_t rejected;
+    // the long term latency the windows are compared with, us
+    int64_t long_latency_us;
+};
+
+// Caps the requests in flight, the cap follows the latency :
+// Every window, limit = limit * gradient + sqrt(limit), smoothed, where gradient is
+// tolerance * long term latency / latency of the window, within [0.5, 1].
+// Queueing makes the window slower than usual and the limit drops,
+// as long as latency holds the sqrt(limit) lets it grow.
+// A window using less than half the limit does not raise it.
+// Thread safety: YES
+class ConcurrencyLimiter : public Noncopyable
+{
+public:
+    explicit ConcurrencyLimiter(const ConcurrencyLimitOptions &options);
+
+    // false when the limit is reached, the request is not to be served
+    bool try_acquire();
+
+    // every accepted request, once answered, with the time it took
+    void release(int64_t latency_us);
+
+    size_t limit() const
+    { return limit_; }
+
+    ConcurrencyLimiterStats stats() const;
+
+    // try_acquire() for a request, released when its response is sent,
+    // or answers the 503. The limiter is to outlive the server tasks.
+    bool admit(HttpServerTask *server_task);
+
+    // The prerendered 503, no json is built when shedding
+    static void respond_overloaded(HttpResp *resp);
+
+private:
+    void update(int64_t now_ms);
+
+private:
+    ConcurrencyLimitOptions options_;
+    std::atomic<size_t> limit_;
+    std::atomic<size_t> inflight_{0};
+    std::atomic<size_t> accepted_{0};
+    std::atomic<size_t> rejected_{0};
+
+    // the window being measured
+    std::atomic<int64_t> window_start_ms_;
+    std::atomic<int64_t> window_latency_us_{0};
+    std::atomic<size_t> window_samples_{0};
+    std::atomic<size_t> window_max_inflight_{0};
+
+    // taken by the release ending a window, the others do not wait
+    std::mutex update_mutex_;
+    double limit_value_;
+    std::atomic<int64_t> long_latency_us_{0};
+};
+
+// The limit of a route : svr.GET("/report", handler, ConcurrencyLimitAspect(options)).
+// Requests over it are answered 503, the others hold their slot until the response is sent.
+// Copies share the limiter.
+class ConcurrencyLimitAspect : public Aspect
+{
+public:
+    explicit ConcurrencyLimitAspect(const ConcurrencyLimitOptions &options)
+        : limiter_(std::make_shared<ConcurrencyLimiter>(options))
+    {}
+
+    explicit ConcurrencyLimitAspect(const std::shared_ptr<ConcurrencyLimiter> &limiter)
+        : limiter_(limiter)
+    {}
+
+    bool before(const HttpReq *req, HttpResp *resp) const override;
+
+    bool after(const HttpReq *req, HttpResp *resp) const override
+    { return true; }
+
+    ConcurrencyLimiter *limiter() const
+    { return limiter_.get(); }
+
+private:
+    std::shared_ptr<ConcurrencyLimiter> limiter_;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_CONCURRENCYLIMITER_H_
@@ -0,0 +1,35 @@
+﻿#ifndef WFREST_DEADLINE_H_
+#define WFREST_DEADLINE_H_
+
+#include "wfrest/Aspect.h"
+#include "wfrest/HttpMsg.h"
+
+namespace wfrest
+{
+
+// The budget of a route : svr.GET("/report", 1, handler, DeadlineAspect(5000)).
+// The deadline of the request becomes at most budget_ms after it was received,
+// an earlier one from HttpServer::request_budget() or the client is kept.
+class DeadlineAspect : public Aspect
+{
+public:
+    explicit DeadlineAspect(int budget_ms) : budget_ms_(budget_ms)
+    {}
+
+    bool before(const HttpReq *req, HttpResp *resp) const override
+    {
+        // the request is the server task's own, only const for the aspects
+        const_cast<HttpReq *>(req)->set_budget(budget_ms_);
+        return true;
+    }
+
+    bool after(const HttpReq *req, HttpResp *resp) const override
+    { return true; }
+
+private:
+    int budget_ms_;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_DEADLINE_H_
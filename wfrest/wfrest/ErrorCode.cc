@@ -20,6 +20,14 @@ std::map<int, const char *> error_code_table = {
     { StatusProxyError, "Http Proxy Error" },
     { StatusRouteVerbNotImplment, "Route Http Method not implement" },
     { StatusRouteNotFound, "Route Not Found" },
+    { StatusMultiPartInvalid, "Invalid Multipart Body" },
+    { StatusUnauthorized, "Unauthorized" },
+    { StatusComputeQueueFull, "Compute Queue Full" },
+    { StatusDeadlineExceeded, "Deadline Exceeded" },
+    { StatusOverloaded, "Server Overloaded" },
+    { StatusTooManyRequests, "Too Many Requests" },
+    { StatusAspectUndecided, "Aspect Undecided" },
+    { StatusUncompressTooLarge, "Uncompressed Body Too Large" },
 };
  
 const char* error_code_to_str(int code)
@@ -29,6 +29,30 @@ enum ErrorCode
     // Route
     StatusRouteVerbNotImplment,
     StatusRouteNotFound,
+
+    // Multipart
+    StatusMultiPartInvalid,
+
+    // Auth
+    StatusUnauthorized,
+
+    // ComputePool
+    StatusComputeQueueFull,
+
+    // HttpReq::deadline()
+    StatusDeadlineExceeded,
+
+    // ConcurrencyLimiter
+    StatusOverloaded,
+
+    // RateLimiter
+    StatusTooManyRequests,
+
+    // AsyncAspect
+    StatusAspectUndecided,
+
+    // Uncompress, the body over its size limit
+    StatusUncompressTooLarge,
 };
 
 const char* error_code_to_str(int code);
@@ -0,0 +1,216 @@
+﻿#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#ifndef OS_WINDOWS
+#include <unistd.h>
+#endif
+
+#include "wfrest/FileIO.h"
+#include "XLogger.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+// created once and never destroyed, tasks may complete while the process exits
+IoUring *g_ring = nullptr;
+std::atomic<bool> g_use_ring(false);
+
+}  // namespace
+
+void FileIOTask::dispatch()
+{
+#ifndef OS_WINDOWS
+    if (!this->path.empty())
+    {
+        int flags = this->write ? O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC : O_RDONLY | O_CLOEXEC;
+        this->args.fd = open(this->path.c_str(), flags, 0644);
+        if (this->args.fd < 0)
+        {
+            this->finish(WFT_STATE_SYS_ERROR, errno, -1);
+            return;
+        }
+        this->owns_fd = true;
+    }
+
+    if (g_use_ring.load(std::memory_order_acquire))
+    {
+        this->uring_req.write = this->write;
+        this->uring_req.fd = this->args.fd;
+        this->uring_req.buf = this->args.buf;
+        this->uring_req.count = this->args.count;
+        this->uring_req.offset = this->args.offset;
+        this->uring_req.callback = FileIOTask::uring_callback;
+        this->uring_req.context = this;
+        if (g_ring->submit(&this->uring_req) == 0)
+            return;
+        // ring full, this one goes through workflow
+    }
+
+    auto cb = [this](WFFileIOTask *task)
+    {
+        this->finish(task->get_state(), task->get_error(), task->get_retval());
+    };
+    WFFileIOTask *task;
+    if (this->write)
+        task = WFTaskFactory::create_pwrite_task(this->args.fd, this->args.buf, this->args.count,
+                                                 this->args.offset, std::move(cb));
+    else
+        task = WFTaskFactory::create_pread_task(this->args.fd, this->args.buf, this->args.count,
+                                                this->args.offset, std::move(cb));
+    task->start();
+#else
+    // no file tasks in workflow on windows, a compute thread blocks instead
+    WFTaskFactory::create_go_task("wfrest_file_io", [this]()
+    {
+        FILE *fp = fopen(this->path.c_str(), this->write ? "wb" : "rb");
+        if (fp == NULL)
+        {
+            this->finish(WFT_STATE_SYS_ERROR, errno, -1);
+            return;
+        }
+        long ret = -1;
+        if (_fseeki64(fp, this->args.offset, SEEK_SET) == 0)
+        {
+            if (this->write)
+                ret = static_cast<long>(fwrite(this->args.buf, 1, this->args.count, fp));
+            else
+                ret = static_cast<long>(fread(this->args.buf, 1, this->args.count, fp));
+        }
+        int error = ferror(fp) ? errno : 0;
+        fclose(fp);
+        if (ret < 0 || error != 0)
+            this->finish(WFT_STATE_SYS_ERROR, error ? error : EIO, -1);
+        else
+            this->finish(WFT_STATE_SUCCESS, 0, ret);
+    })->start();
+#endif
+}
+
+void FileIOTask::uring_callback(IoUring::Request *req, long res)
+{
+    auto *task = static_cast<FileIOTask *>(req->context);
+    if (res < 0)
+        task->finish(WFT_STATE_SYS_ERROR, static_cast<int>(-res), -1);
+    else
+        task->finish(WFT_STATE_SUCCESS, 0, res);
+}
+
+void FileIOTask::finish(int state, int error, long retval)
+{
+#ifndef OS_WINDOWS
+    if (this->owns_fd && this->args.fd >= 0)
+        close(this->args.fd);
+#endif
+    this->state = state;
+    this->error = error;
+    this->retval = retval;
+    this->subtask_done();
+}
+
+SubTask *FileIOTask::done()
+{
+    SeriesWork *series = series_of(this);
+
+    if (this->callback)
+        this->callback(this);
+
+    delete this;
+    return series->pop();
+}
+
+int FileIO::use_io_uring(unsigned entries, size_t fixed_buffers, size_t fixed_buffer_size)
+{
+    if (!g_ring)
+    {
+        auto *ring = new IoUring;
+        if (ring->init(entries, fixed_buffers, fixed_buffer_size) < 0)
+        {
+            int error = errno;
+            XLOG_ERROR("io_uring unavailable, errno {}, file I/O stays on the default backend", error);
+            delete ring;
+            errno = error;
+            return -1;
+        }
+        g_ring = ring;
+    }
+    g_use_ring.store(true, std::memory_order_release);
+    return 0;
+}
+
+void FileIO::use_default()
+{
+    g_use_ring.store(false, std::memory_order_release);
+}
+
+FileIO::Backend FileIO::backend()
+{
+    return g_use_ring.load(std::memory_order_acquire) ? BACKEND_IO_URING : BACKEND_DEFAULT;
+}
+
+#ifndef OS_WINDOWS
+FileIOTask *FileIO::create_pread_task(int fd, void *buf, size_t count, off_t offset,
+                                      file_io_callback_t callback)
+{
+    auto *task = new FileIOTask(false, std::move(callback));
+    task->args.fd = fd;
+    task->args.buf = buf;
+    task->args.count = count;
+    task->args.offset = offset;
+    return task;
+}
+
+FileIOTask *FileIO::create_pwrite_task(int fd, const void *buf, size_t count, off_t offset,
+                                       file_io_callback_t callback)
+{
+    auto *task = new FileIOTask(true, std::move(callback));
+    task->args.fd = fd;
+    task->args.buf = const_cast<void *>(buf);
+    task->args.count = count;
+    task->args.offset = offset;
+    return task;
+}
+#endif
+
+FileIOTask *FileIO::create_pread_task(const std::string &path, void *buf, size_t count, off_t offset,
+                                      file_io_callback_t callback)
+{
+    auto *task = new FileIOTask(false, std::move(callback));
+    task->path = path;
+    task->args.fd = -1;
+    task->args.buf = buf;
+    task->args.count = count;
+    task->args.offset = offset;
+    return task;
+}
+
+FileIOTask *FileIO::create_pwrite_task(const std::string &path, const void *buf, size_t count, off_t offset,
+                                       file_io_callback_t callback)
+{
+    auto *task = new FileIOTask(true, std::move(callback));
+    task->path = path;
+    task->args.fd = -1;
+    task->args.buf = const_cast<void *>(buf);
+    task->args.count = count;
+    task->args.offset = offset;
+    return task;
+}
+
+void *FileIO::alloc_buffer(size_t size)
+{
+    // the ring is never destroyed, its buffers stay valid after use_default()
+    if (g_ring)
+        return g_ring->alloc_buffer(size);
+    return malloc(size);
+}
+
+void FileIO::free_buffer(void *buf)
+{
+    if (g_ring)
+        g_ring->free_buffer(buf);
+    else
+        free(buf);
+}
@@ -0,0 +1,138 @@
+﻿#ifndef WFREST_FILEIO_H_
+#define WFREST_FILEIO_H_
+
+#include "workflow/WFTaskFactory.h"
+
+#include <functional>
+#include <string>
+
+#include "wfrest/IoUring.h"
+
+namespace wfrest
+{
+
+class FileIOTask;
+using file_io_callback_t = std::function<void (FileIOTask *)>;
+
+// pread / pwrite task with the interface of WFFileIOTask, run by the backend
+// FileIO selected at startup.
+class FileIOTask : public SubTask
+{
+public:
+    void start()
+    {
+        assert(!series_of(this));
+        Workflow::start_series_work(this, nullptr);
+    }
+
+    void dismiss()
+    {
+        assert(!series_of(this));
+        delete this;
+    }
+
+public:
+    FileIOArgs *get_args() { return &this->args; }
+
+    long get_retval() const
+    {
+        if (this->state == WFT_STATE_SUCCESS)
+            return this->retval;
+        else
+            return -1;
+    }
+
+    int get_state() const { return this->state; }
+    int get_error() const { return this->error; }
+
+    void set_callback(file_io_callback_t cb)
+    {
+        this->callback = std::move(cb);
+    }
+
+public:
+    void *user_data = nullptr;
+
+protected:
+    virtual void dispatch();
+
+    virtual SubTask *done();
+
+private:
+    void finish(int state, int error, long retval);
+
+    static void uring_callback(IoUring::Request *req, long res);
+
+private:
+    bool write;
+    FileIOArgs args;
+    // opened by dispatch() and closed when done for the path tasks
+    std::string path;
+    bool owns_fd = false;
+    IoUring::Request uring_req;
+
+    int state = WFT_STATE_UNDEFINED;
+    int error = 0;
+    long retval = 0;
+    file_io_callback_t callback;
+
+public:
+    FileIOTask(bool write, file_io_callback_t &&cb) :
+        write(write),
+        callback(std::move(cb))
+    { }
+
+    virtual ~FileIOTask() { }
+
+    friend class FileIO;
+};
+
+// Factory of the file tasks of wfrest.
+// The default backend is workflow's file I/O (Linux aio), or a blocking read in a
+// go task on windows. use_io_uring() switches to an io_uring ring on Linux and falls
+// back to the default by itself when the kernel does not allow it.
+class FileIO
+{
+public:
+    enum Backend
+    {
+        BACKEND_DEFAULT,
+        BACKEND_IO_URING,
+    };
+
+    // Call before the server starts.
+    // 0, or -1 with errno and the default backend stays.
+    // Buffers from alloc_buffer() up to fixed_buffer_size are registered with the kernel.
+    static int use_io_uring(unsigned entries = 256,
+                            size_t fixed_buffers = 16,
+                            size_t fixed_buffer_size = 256 * 1024);
+
+    static void use_default();
+
+    static Backend backend();
+
+#ifndef OS_WINDOWS
+    static FileIOTask *create_pread_task(int fd, void *buf, size_t count, off_t offset,
+                                         file_io_callback_t callback);
+
+    static FileIOTask *create_pwrite_task(int fd, const void *buf, size_t count, off_t offset,
+                                          file_io_callback_t callback);
+#endif
+
+    // the file is opened when the task runs, O_WRONLY | O_CREAT | O_TRUNC for pwrite
+    static FileIOTask *create_pread_task(const std::string &path, void *buf, size_t count, off_t offset,
+                                         file_io_callback_t callback);
+
+    static FileIOTask *create_pwrite_task(const std::string &path, const void *buf, size_t count, off_t offset,
+                                          file_io_callback_t callback);
+
+    // Read buffers, registered ones while the io_uring backend runs.
+    // Release with free_buffer(), never free().
+    static void *alloc_buffer(size_t size);
+
+    static void free_buffer(void *buf);
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_FILEIO_H_
@@ -3,6 +3,7 @@
 #include "wfrest/StrUtil.h"
 #include "wfrest/HttpContent.h"
 #include "wfrest/StringPiece.h"
+#include "wfrest/ErrorCode.h"
 
 using namespace wfrest;
 
@@ -219,6 +220,234 @@ Form MultiPartForm::parse_multipart(const StringPiece &body) const
     return form;
 }
 
+namespace
+{
+
+// Boyer-Moore-Horspool search of the delimiter "\r\n--boundary". A mismatch moves
+// up to the whole delimiter length ahead, 40 bytes and more with the boundaries
+// of browsers, so most of a part's data is never looked at.
+class DelimiterSearch
+{
+public:
+    explicit DelimiterSearch(const std::string &delimiter)
+        : delimiter_(delimiter)
+    {
+        size_t len = delimiter_.size();
+        for (size_t &skip : skip_)
+            skip = len;
+        for (size_t i = 0; i + 1 < len; i++)
+            skip_[static_cast<unsigned char>(delimiter_[i])] = len - 1 - i;
+    }
+
+    // the first delimiter in [begin, end), or nullptr
+    const char *find(const char *begin, const char *end) const
+    {
+        size_t len = delimiter_.size();
+        if (static_cast<size_t>(end - begin) < len)
+            return nullptr;
+
+        const char *pattern = delimiter_.data();
+        unsigned char last = static_cast<unsigned char>(pattern[len - 1]);
+        const char *stop = end - len;
+        for (const char *p = begin; p <= stop; )
+        {
+            unsigned char c = static_cast<unsigned char>(p[len - 1]);
+            if (c == last && memcmp(p, pattern, len - 1) == 0)
+                return p;
+            p += skip_[c];
+        }
+        return nullptr;
+    }
+
+private:
+    std::string delimiter_;
+    size_t skip_[256];
+};
+
+const char *find_header_end(const char *begin, const char *end)
+{
+    const char *p = begin;
+    while (end - p >= 4)
+    {
+        p = static_cast<const char *>(memchr(p, '\r', end - p - 3));
+        if (p == nullptr)
+            return nullptr;
+        if (memcmp(p, "\r\n\r\n", 4) == 0)
+            return p;
+        ++p;
+    }
+    return nullptr;
+}
+
+bool equals_nocase(const StringPiece &piece, const char *str)
+{
+    size_t len = strlen(str);
+    return piece.size() == len && strncasecmp(piece.data(), str, len) == 0;
+}
+
+const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+// Content-Disposition: form-data; name="avatar"; filename="user.jpg"
+// Quoted values may hold ';' and '=', escapes are kept as they are.
+void parse_disposition(const StringPiece &value, FormPart *part)
+{
+    const char *end = value.end();
+    const char *p = static_cast<const char *>(memchr(value.data(), ';', value.size()));
+    if (p == nullptr)
+        return;
+
+    while (p < end)
+    {
+        // at a ';'
+        const char *key_begin = skip_space(p + 1, end);
+        p = key_begin;
+        while (p < end && *p != '=' && *p != ';')
+            ++p;
+        StringPiece key = StrUtil::trim(StringPiece(key_begin, p - key_begin));
+        if (p == end || *p == ';')
+            continue;
+
+        p = skip_space(p + 1, end);
+        StringPiece val;
+        if (p < end && (*p == '"' || *p == '\''))
+        {
+            char quote = *p;
+            const char *val_begin = ++p;
+            while (p < end && *p != quote)
+                p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+            val = StringPiece(val_begin, p - val_begin);
+            while (p < end && *p != ';')
+                ++p;
+        }
+        else
+        {
+            const char *val_begin = p;
+            while (p < end && *p != ';')
+                ++p;
+            val = StrUtil::trim(StringPiece(val_begin, p - val_begin));
+        }
+
+        if (equals_nocase(key, "name"))
+            part->name = val;
+        else if (equals_nocase(key, "filename"))
+            part->filename = val;
+    }
+}
+
+void parse_part_headers(const StringPiece &headers, FormPart *part)
+{
+    const char *p = headers.begin();
+    const char *end = headers.end();
+    while (p < end)
+    {
+        const char *line_end = p;
+        while (line_end < end && !(line_end[0] == '\r' && line_end + 1 < end && line_end[1] == '\n'))
+            ++line_end;
+
+        const char *colon = static_cast<const char *>(memchr(p, ':', line_end - p));
+        if (colon != nullptr)
+        {
+            StringPiece field = StrUtil::trim(StringPiece(p, colon - p));
+            StringPiece value = StrUtil::trim(StringPiece(colon + 1, line_end - colon - 1));
+            if (equals_nocase(field, "Content-Disposition"))
+                parse_disposition(value, part);
+            else if (equals_nocase(field, "Content-Type"))
+                part->content_type = value;
+        }
+        p = line_end < end ? line_end + 2 : end;
+    }
+}
+
+}  // namespace
+
+int MultiPartForm::parse_view(const StringPiece &body, FormView *form) const
+{
+    if (boundary_.empty())
+        return StatusMultiPartInvalid;
+
+    std::string delimiter = "\r\n--" + boundary_;
+    DelimiterSearch search(delimiter);
+    const char *end = body.end();
+    const char *p;
+    // no CRLF before the first boundary at the very start of the body
+    if (body.starts_with(StringPiece(delimiter.data() + 2, delimiter.size() - 2)))
+    {
+        p = body.begin() + delimiter.size() - 2;
+    }
+    else
+    {
+        p = search.find(body.begin(), end);
+        if (p == nullptr)
+            return StatusMultiPartInvalid;
+        p += delimiter.size();
+    }
+
+    while (true)
+    {
+        // the close delimiter, what follows is ignored
+        if (end - p >= 2 && p[0] == '-' && p[1] == '-')
+            return StatusOK;
+
+        p = skip_space(p, end);
+        if (end - p < 2 || p[0] != '\r' || p[1] != '\n')
+            return StatusMultiPartInvalid;
+        p += 2;
+
+        FormPart part;
+        const char *data;
+        if (end - p >= 2 && p[0] == '\r' && p[1] == '\n')
+        {
+            // a part without headers
+            data = p + 2;
+        }
+        else
+        {
+            const char *headers_end = find_header_end(p, end);
+            if (headers_end == nullptr)
+                return StatusMultiPartInvalid;
+            part.headers = StringPiece(p, headers_end - p);
+            parse_part_headers(part.headers, &part);
+            data = headers_end + 4;
+        }
+
+        const char *next = search.find(data, end);
+        if (next == nullptr)
+            return StatusMultiPartInvalid;
+        part.data = StringPiece(data, next - data);
+        form->add(part);
+        p = next + delimiter.size();
+    }
+}
+
+const FormPart *FormView::get(const StringPiece &name) const
+{
+    for (auto it = parts_.rbegin(); it != parts_.rend(); ++it)
+    {
+        if (it->name == name)
+            return &*it;
+    }
+    return nullptr;
+}
+
+Form FormView::to_form() const
+{
+    Form form;
+    for (const FormPart &part : parts_)
+    {
+        if (part.name.empty())
+            continue;
+        auto &formdata = form[part.name.as_string()];
+        formdata.first = part.filename.as_string();
+        formdata.second = part.data.as_string();
+    }
+    return form;
+}
+
 MultiPartEncoder::MultiPartEncoder()
     : boundary_(MultiPartForm::k_default_boundary)
 {
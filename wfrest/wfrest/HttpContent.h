@@ -3,15 +3,15 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include "wfrest/MultiPartParser.h"
 #include "wfrest/Macro.h"
 #include "wfrest/Noncopyable.h"
+#include "wfrest/StringPiece.h"
 
 namespace wfrest
 {
 
-class StringPiece;
-
 class Urlencode
 {
 public:
@@ -31,12 +31,67 @@ public:
 // <name ,<filename, body>>
 using Form = std::map<std::string, std::pair<std::string, std::string>>;
 
+// One part of a multipart/form-data body, every field points into the body
+struct FormPart
+{
+    StringPiece name;
+    // empty for a field which is not a file
+    StringPiece filename;
+    StringPiece content_type;
+    // the raw header lines of the part
+    StringPiece headers;
+    StringPiece data;
+
+    bool is_file() const
+    { return !filename.empty(); }
+};
+
+// The parts of a multipart/form-data body in order, duplicate names kept.
+// Nothing is copied : valid as long as the parsed body.
+class FormView
+{
+public:
+    using const_iterator = std::vector<FormPart>::const_iterator;
+
+    // the last part named name, nullptr if none
+    const FormPart *get(const StringPiece &name) const;
+
+    const_iterator begin() const
+    { return parts_.begin(); }
+
+    const_iterator end() const
+    { return parts_.end(); }
+
+    size_t size() const
+    { return parts_.size(); }
+
+    bool empty() const
+    { return parts_.empty(); }
+
+    void clear()
+    { parts_.clear(); }
+
+    void add(const FormPart &part)
+    { parts_.push_back(part); }
+
+    // copies to a Form, parts without a name are dropped
+    Form to_form() const;
+
+private:
+    std::vector<FormPart> parts_;
+};
+
 // Modified From libhv
 class MultiPartForm 
 {
 public:
     Form parse_multipart(const StringPiece &body) const;
 
+    // Finds the boundaries with a Boyer-Moore-Horspool search instead of the byte by byte
+    // state machine and copies nothing, the parts are views into body.
+    // StatusOK, or StatusMultiPartInvalid with the parts before the error in form.
+    int parse_view(const StringPiece &body, FormView *form) const;
+
     void set_boundary(std::string &&boundary)
     { boundary_ = std::move(boundary); }
 
@@ -1,18 +1,48 @@
 ﻿#include "workflow/WFTaskFactory.h"
 
+#include <openssl/ssl.h>
 #include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#ifndef OS_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+#endif
 
 #include "wfrest/HttpFile.h"
 #include "wfrest/HttpMsg.h"
+#include "wfrest/HttpContent.h"
 #include "wfrest/PathUtil.h"
 #include "wfrest/HttpServerTask.h"
 #include "wfrest/FileUtil.h"
 #include "wfrest/ErrorCode.h"
+#include "wfrest/StrUtil.h"
+#include "wfrest/SysInfo.h"
+#include "wfrest/StaticCache.h"
+#include "wfrest/OpenFileCache.h"
+#include "wfrest/FileIO.h"
+#include "wfrest/Timestamp.h"
+#include "wfrest/ZipWriter.h"
+#include "wfrest/Macro.h"
+#include "XLogger.h"
 
 using namespace wfrest;
 
 namespace
 {
+	// below this a pread into a heap buffer is cheaper than setting up a mapping
+	const size_t k_file_map_threshold = 64 * 1024;
+
 	struct pread_multi_context
 	{
 		std::string file_name;
@@ -31,7 +61,7 @@ namespace
 
 	todo : Any better way to transfer large File?
 	*/
-	void pread_callback(WFFileIOTask* pread_task)
+	void pread_callback(FileIOTask* pread_task)
 	{
 		FileIOArgs* args = pread_task->get_args();
 		long ret = pread_task->get_retval();
@@ -87,146 +117,1587 @@ namespace
 				str.append("Content-Type: application/octet-stream");
 			}
 		}
-		str.append("\r\n\r\n");
-		return str;
+		str.append("\r\n\r\n");
+		return str;
+	}
+
+	std::string build_multipart_end()
+	{
+		std::string multi_part_last;
+		multi_part_last.reserve(128);
+		multi_part_last.append("--");
+		// RFC1521 says that a boundary "must be no longer than 70 characters, not counting the two leading hyphens".
+		multi_part_last.append(MultiPartForm::k_default_boundary);
+		multi_part_last.append("--");
+		return multi_part_last;
+	}
+
+	void pread_multi_callback(FileIOTask* pread_task)
+	{
+		FileIOArgs* args = pread_task->get_args();
+		long ret = pread_task->get_retval();
+		auto* ctx = static_cast<pread_multi_context*>(pread_task->user_data);
+		HttpResp* resp = ctx->resp;
+
+		std::string multipart_start = build_multipart_start(ctx->file_name, ctx->file_index);
+		ctx->multipart_start = std::move(multipart_start);
+		resp->append_output_body(ctx->multipart_start.c_str(), ctx->multipart_start.size());
+		if (pread_task->get_state() != WFT_STATE_SUCCESS || ret < 0)
+		{
+			char res[256];
+			resp->set_status_code("503");
+			//resp->append_output_body_nocopy("503 Internal Server Error\n", 26);
+			//resp->Error(StatusFileReadError);
+			sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 503, "503 Internal Server Error", ctx->file_name.substr(ctx->file_name.find_last_of("/")).c_str());
+			resp->append_output_body(res, strlen(res));
+		}
+		else
+		{
+			resp->append_output_body(args->buf, ret);
+		}
+
+		if (ctx->last)   // last one
+		{
+			std::string multipart_end = build_multipart_end();
+			ctx->multipart_end = std::move(multipart_end);
+			resp->append_output_body(ctx->multipart_end.c_str(), ctx->multipart_end.size());
+		}
+	}
+
+	struct save_context
+	{
+		std::string dst_path;
+		// written first and renamed over dst_path, empty when not atomic
+		std::string tmp_path;
+		// owned, the pwrite reads it in place
+		std::string content;
+		SaveOptions options;
+		HttpResp* resp;
+		int status = StatusOK;
+	};
+
+	std::atomic<unsigned long long> g_save_seq(0);
+
+	// next to the destination, rename() does not cross file systems
+	std::string save_tmp_path(const std::string& dst_path)
+	{
+#ifdef OS_WINDOWS
+		int pid = _getpid();
+#else
+		int pid = getpid();
+#endif
+		return dst_path + "." + std::to_string(pid) + "." + std::to_string(++g_save_seq) + ".tmp";
+	}
+
+	std::string parent_dir(const std::string& path)
+	{
+		std::string::size_type pos = path.find_last_of("/\\");
+		if (pos == std::string::npos)
+			return ".";
+		if (pos == 0)
+			return "/";
+		return path.substr(0, pos);
+	}
+
+	bool replace_file(const std::string& src, const std::string& dst)
+	{
+#ifdef OS_WINDOWS
+		return MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return rename(src.c_str(), dst.c_str()) == 0;
+#endif
+	}
+
+	// content, not metadata
+	bool sync_file(const std::string& path)
+	{
+#ifdef OS_WINDOWS
+		int fd = _open(path.c_str(), _O_WRONLY | _O_BINARY);
+		if (fd < 0)
+			return false;
+		bool ok = _commit(fd) == 0;
+		_close(fd);
+#else
+		int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+		bool ok = fdatasync(fd) == 0;
+		close(fd);
+#endif
+		return ok;
+	}
+
+	// the new directory entry of a rename, windows has no such thing
+	void sync_dir(const std::string& dir)
+	{
+#ifndef OS_WINDOWS
+		int fd = open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd >= 0)
+		{
+			fsync(fd);
+			close(fd);
+		}
+#endif
+	}
+
+	// One commit round : sync every file, rename them, then sync each directory once.
+	void commit_saves(const std::vector<save_context*>& saves)
+	{
+		std::vector<std::string> dirs;
+		for (save_context* ctx : saves)
+		{
+			const std::string& path = ctx->tmp_path.empty() ? ctx->dst_path : ctx->tmp_path;
+			if (!sync_file(path) ||
+				(!ctx->tmp_path.empty() && !replace_file(ctx->tmp_path, ctx->dst_path)))
+			{
+				XLOG_ERROR("save {} : {}", ctx->dst_path, strerror(errno));
+				ctx->status = StatusFileWriteError;
+				continue;
+			}
+			std::string dir = parent_dir(ctx->dst_path);
+			if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end())
+				dirs.push_back(std::move(dir));
+		}
+		for (const std::string& dir : dirs)
+			sync_dir(dir);
+	}
+
+	// Group commit of the saves with SaveOptions::group_commit : a save arriving
+	// while a round runs joins the next one, so N concurrent saves to a directory
+	// cost about two rounds of syncs instead of N.
+	class SaveCommitter
+	{
+	public:
+		static SaveCommitter* get_instance()
+		{
+			static SaveCommitter k_instance;
+			return &k_instance;
+		}
+
+		// counter->count() once ctx is durable, or failed
+		void add(save_context* ctx, WFCounterTask* counter)
+		{
+			bool start;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				pending_.emplace_back(ctx, counter);
+				start = !running_;
+				running_ = true;
+			}
+			if (start)
+				WFTaskFactory::create_go_task("wfrest_sync", &SaveCommitter::run, this)->start();
+		}
+
+	private:
+		void run()
+		{
+			for (;;)
+			{
+				std::vector<std::pair<save_context*, WFCounterTask*>> round;
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (pending_.empty())
+					{
+						running_ = false;
+						return;
+					}
+					round.swap(pending_);
+				}
+				std::vector<save_context*> saves;
+				for (auto& save : round)
+					saves.push_back(save.first);
+				commit_saves(saves);
+				for (auto& save : round)
+					save.second->count();
+			}
+		}
+
+	private:
+		std::mutex mutex_;
+		bool running_ = false;
+		std::vector<std::pair<save_context*, WFCounterTask*>> pending_;
+	};
+
+	void save_done(save_context* ctx)
+	{
+		HttpResp* resp = ctx->resp;
+		std::string file_name = PathUtil::base(ctx->dst_path);
+		char res[256];
+		if (ctx->status != StatusOK)
+		{
+			if (!ctx->tmp_path.empty())
+				remove(ctx->tmp_path.c_str());
+			resp->set_status_code("503");
+			snprintf(res, sizeof res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 503, "503 Internal Server Error", file_name.c_str());
+		}
+		else
+		{
+			snprintf(res, sizeof res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 0, "success", file_name.c_str());
+		}
+		resp->headers["Content-Type"] = "application/json";
+		resp->append_output_body(res, strlen(res));
+		delete ctx;
+	}
+
+	void pwrite_callback(FileIOTask* pwrite_task)
+	{
+		auto* ctx = static_cast<save_context*>(pwrite_task->user_data);
+		long ret = pwrite_task->get_retval();
+		if (pwrite_task->get_state() != WFT_STATE_SUCCESS || ret != static_cast<long>(ctx->content.size()))
+		{
+			XLOG_ERROR("save {} : write error {}", ctx->dst_path, pwrite_task->get_error());
+			ctx->status = StatusFileWriteError;
+			save_done(ctx);
+			return;
+		}
+		// the page cache has it now
+		std::string().swap(ctx->content);
+
+		SeriesWork* series = series_of(pwrite_task);
+		if (ctx->options.sync && ctx->options.group_commit)
+		{
+			WFCounterTask* counter = WFTaskFactory::create_counter_task(1, [ctx](WFCounterTask*)
+			{
+				save_done(ctx);
+			});
+			SaveCommitter::get_instance()->add(ctx, counter);
+			series->push_front(counter);
+		}
+		else if (ctx->options.sync)
+		{
+			WFGoTask* go_task = WFTaskFactory::create_go_task("wfrest_sync", [ctx]
+			{
+				commit_saves({ ctx });
+			});
+			go_task->set_callback([ctx](WFGoTask*)
+			{
+				save_done(ctx);
+			});
+			series->push_front(go_task);
+		}
+		else
+		{
+			if (!ctx->tmp_path.empty() && !replace_file(ctx->tmp_path, ctx->dst_path))
+			{
+				XLOG_ERROR("save {} : {}", ctx->dst_path, strerror(errno));
+				ctx->status = StatusFileWriteError;
+			}
+			save_done(ctx);
+		}
+	}
+
+	std::string file_content_type(const std::string& path)
+	{
+		http_content_type content_type = CONTENT_TYPE_NONE;
+		std::string suffix = PathUtil::suffix(path);
+		if (!suffix.empty())
+		{
+			content_type = ContentType::to_enum_by_suffix(suffix);
+		}
+		if (content_type == CONTENT_TYPE_NONE || content_type == CONTENT_TYPE_UNDEFINED)
+		{
+			content_type = APPLICATION_OCTET_STREAM;
+		}
+		return ContentType::to_str(content_type);
+	}
+
+	bool is_compressible(const std::string& content_type)
+	{
+		return content_type.compare(0, 5, "text/") == 0 ||
+			content_type.find("javascript") != std::string::npos ||
+			content_type.find("json") != std::string::npos ||
+			content_type.find("xml") != std::string::npos ||
+			content_type.find("svg") != std::string::npos;
+	}
+
+	// If-None-Match: "a1-2b-3c", W/"d4-5e-6f"
+	bool etag_match(const std::string& if_none_match, const std::string& etag)
+	{
+		std::vector<StringPiece> tag_list = StrUtil::split_piece<StringPiece>(if_none_match, ',');
+		for (const auto& item : tag_list)
+		{
+			StringPiece tag = StrUtil::trim(item);
+			if (tag == StringPiece("*"))
+				return true;
+			// weak comparison, W/"x" matches "x"
+			if (tag.starts_with(StringPiece("W/")))
+				tag.remove_prefix(2);
+			if (tag == StringPiece(etag))
+				return true;
+		}
+		return false;
+	}
+
+	// Sets the validators of a full file response.
+	// true if the client's copy is still good, the caller answers 304 without reading the file.
+	bool check_not_modified(const std::string& etag, const std::string& last_modified,
+							time_t mtime, size_t size, HttpResp* resp)
+	{
+		if (resp->headers.find("ETag") == resp->headers.end())
+			resp->headers["ETag"] = etag;
+		if (resp->headers.find("Last-Modified") == resp->headers.end())
+			resp->headers["Last-Modified"] = last_modified;
+
+		const HttpReq* req = task_of(resp)->get_req();
+		const char* method = req->get_method();
+		if (strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0)
+			return false;
+
+		bool not_modified = false;
+		// https://datatracker.ietf.org/doc/html/rfc7232#section-6
+		// If-None-Match wins, If-Modified-Since is only looked at without it
+		const std::string& if_none_match = req->header("If-None-Match");
+		if (!if_none_match.empty())
+		{
+			not_modified = etag_match(if_none_match, resp->headers["ETag"]);
+		}
+		else
+		{
+			const std::string& if_modified_since = req->header("If-Modified-Since");
+			if (!if_modified_since.empty())
+			{
+				Timestamp since = Timestamp::from_http_date(if_modified_since);
+				not_modified = since.valid() &&
+					static_cast<uint64_t>(mtime) <= since.micro_sec_since_epoch() / Timestamp::k_micro_sec_per_sec;
+			}
+		}
+		if (!not_modified)
+			return false;
+
+		resp->set_status(304);
+		// no body, the length is the one a 200 would have had (RFC 7230 3.3.2)
+		resp->headers["Content-Length"] = std::to_string(size);
+		return true;
+	}
+
+	// Accept-Encoding: gzip, deflate, br;q=0.8
+	bool accept_encoding(const std::string& accept_encoding, const char* coding)
+	{
+		std::vector<StringPiece> coding_list = StrUtil::split_piece<StringPiece>(accept_encoding, ',');
+		for (const auto& item : coding_list)
+		{
+			std::vector<StringPiece> params = StrUtil::split_piece<StringPiece>(item, ';');
+			StringPiece name = StrUtil::trim(params[0]);
+			if (name.size() != strlen(coding) || strncasecmp(name.data(), coding, name.size()) != 0)
+				continue;
+
+			for (size_t i = 1; i < params.size(); i++)
+			{
+				StringPiece param = StrUtil::trim(params[i]);
+				if (param.starts_with(StringPiece("q=")))
+				{
+					// q=0 means "not acceptable"
+					return atof(param.as_string().c_str() + 2) > 0;
+				}
+			}
+			return true;
+		}
+		return false;
+	}
+
+	struct PrecompressedVariant
+	{
+		const char* encoding;
+		const char* suffix;
+		Compress method;
+	};
+
+	// in order of preference
+	const PrecompressedVariant k_precompressed_variants[] = {
+		{ "br", ".br", Compress::BROTLI },
+		{ "gzip", ".gz", Compress::GZIP },
+	};
+
+	// StatusFileReadError for a file over max_size
+	int read_file(const std::string& path, size_t max_size, std::string* content)
+	{
+		size_t size;
+		int ret = FileUtil::size(path, OUT & size);
+		if (ret != StatusOK)
+			return ret;
+		if (size > max_size)
+			return StatusFileReadError;
+
+		FILE* f = fopen(path.c_str(), "rb");
+		if (f == NULL)
+			return StatusNotFound;
+
+		content->resize(size);
+		size_t read_len = size > 0 ? fread(&(*content)[0], 1, size, f) : 0;
+		fclose(f);
+		return read_len == size ? StatusOK : StatusFileReadError;
+	}
+
+	// Compress once and keep the result next to the original.
+	// Written to a temporary file then renamed, so a concurrent request never sends half of it.
+	int generate_precompressed(const std::string& path, const std::string& variant_path,
+							   Compress method, size_t max_size)
+	{
+		std::string content;
+		int ret = read_file(path, max_size, &content);
+		if (ret != StatusOK)
+			return ret;
+
+		std::string compress_data;
+		if (method == Compress::BROTLI)
+			ret = Compressor::brotli(&content, &compress_data);
+		else
+			ret = Compressor::gzip(&content, &compress_data);
+		if (ret != StatusOK)
+			return ret;
+
+		std::string tmp_path = variant_path + ".tmp" + std::to_string(CurrentThread::tid());
+		FILE* f = fopen(tmp_path.c_str(), "wb");
+		if (f == NULL)
+			return StatusFileWriteError;
+		size_t write_len = fwrite(compress_data.data(), 1, compress_data.size(), f);
+		fclose(f);
+		if (write_len != compress_data.size())
+		{
+			remove(tmp_path.c_str());
+			return StatusFileWriteError;
+		}
+#ifdef OS_WINDOWS
+		// rename() does not replace an existing (stale) file on windows
+		remove(variant_path.c_str());
+#endif
+		if (rename(tmp_path.c_str(), variant_path.c_str()) != 0)
+		{
+			remove(tmp_path.c_str());
+			return StatusFileWriteError;
+		}
+		return StatusOK;
+	}
+
+	// the variants being generated, one generation per variant at a time
+	std::mutex g_precompress_mutex;
+	std::unordered_set<std::string> g_precompressing;
+
+	// Generate the variant on the "wfrest_precompress" queue, not on the network thread.
+	// The request does not wait for it, the requests coming before it is written
+	// are answered with the next variant or the original file.
+	void start_precompress(const std::string& path, const std::string& variant_path,
+						   Compress method, size_t max_size)
+	{
+#ifndef USE_BROTLI
+		if (method == Compress::BROTLI)
+			return;
+#endif
+		{
+			std::lock_guard<std::mutex> lock(g_precompress_mutex);
+			if (!g_precompressing.insert(variant_path).second)
+				return;
+		}
+		WFTaskFactory::create_go_task("wfrest_precompress", [path, variant_path, method, max_size]()
+			{
+				// checked again here, the file may have grown since the request saw it
+				int ret = generate_precompressed(path, variant_path, method, max_size);
+				if (ret != StatusOK)
+					XLOG_ERROR("generate {} failed : {}", variant_path, error_code_to_str(ret));
+				std::lock_guard<std::mutex> lock(g_precompress_mutex);
+				g_precompressing.erase(variant_path);
+			})->start();
+	}
+
+	// Windowed streaming of the large files, without a buffer or a mapping their size.
+	// At most k_stream_windows windows of k_stream_window_size bytes per download :
+	// while the filled windows are pushed to the socket, the free ones are read.
+	const size_t k_stream_window_size = 256 * 1024;
+	const size_t k_stream_windows = 4;
+	// give up when the client has not taken a byte for this long
+	const int k_stream_stall_timeout_ms = 60 * 1000;
+	const int k_stream_max_backoff_ms = 64;
+
+	struct StreamWindow
+	{
+		char* buf;
+		size_t offset;
+		size_t len;
+		size_t sent;
+		long ret;
+	};
+
+	struct FileStream
+	{
+		HttpServerTask* server_task;
+#ifndef OS_WINDOWS
+		int fd;
+#else
+		FILE* fp;
+#endif
+		size_t read_offset;
+		size_t end;
+		std::string header;
+		size_t header_sent = 0;
+		bool detached = false;
+		bool failed = false;
+		int backoff_ms = 0;
+		int stall_ms = 0;
+		StreamWindow windows[k_stream_windows];
+		std::deque<StreamWindow*> free_list;
+		std::deque<StreamWindow*> reading;
+		std::deque<StreamWindow*> filled;
+
+		~FileStream()
+		{
+			for (auto& window : windows)
+				FileIO::free_buffer(window.buf);
+#ifdef OS_WINDOWS
+			fclose(fp);
+#endif
+		}
+	};
+
+	void stream_step(FileStream* stream);
+
+#ifndef OS_WINDOWS
+	SubTask* create_window_read_task(int fd, StreamWindow* window)
+	{
+		return FileIO::create_pread_task(fd, window->buf, window->len,
+			static_cast<off_t>(window->offset),
+			[window](FileIOTask* task)
+			{
+				window->ret = task->get_state() == WFT_STATE_SUCCESS ? task->get_retval() : -1;
+			});
+	}
+#else
+	SubTask* create_window_read_task(FILE* fp, StreamWindow* window)
+	{
+		// no file tasks on windows, the reads of one stream are chained so the FILE* is never shared
+		return WFTaskFactory::create_go_task("wfrest_file_stream", [fp, window]()
+			{
+				if (_fseeki64(fp, window->offset, SEEK_SET) != 0)
+					window->ret = -1;
+				else
+					window->ret = static_cast<long>(fread(window->buf, 1, window->len, fp));
+			});
+	}
+#endif
+
+	// Bytes taken by the socket, 0 when its buffer is full, -1 on error.
+	// Over TLS push() reports a blocked SSL_write() as errno -SSL_get_error() :
+	// the same bytes are to be pushed again, which the callers do from where they stopped.
+	long stream_push(HttpServerTask* server_task, const char* data, size_t len)
+	{
+		int ret = server_task->push(data, len);
+		if (ret >= 0)
+			return ret;
+		if (errno == EAGAIN || errno == EWOULDBLOCK ||
+			errno == -SSL_ERROR_WANT_WRITE || errno == -SSL_ERROR_WANT_READ)
+			return 0;
+		return -1;
+	}
+
+	// A stream failing before its header went out is answered with an error,
+	// without the headers describing the body it did not send
+	void stream_error(HttpServerTask* server_task)
+	{
+		HttpResp* resp = server_task->get_resp();
+		for (const char* name : { "Content-Length", "Content-Range", "Transfer-Encoding", "Content-Disposition",
+								  "ETag", "Last-Modified" })
+			resp->headers.erase(name);
+		resp->Error(StatusFileReadError);
+	}
+
+	// Push what is ready without blocking. return false if the socket is full.
+	bool stream_flush(FileStream* stream)
+	{
+		bool progress = false;
+		bool blocked = false;
+		while (stream->header_sent < stream->header.size())
+		{
+			long ret = stream_push(stream->server_task, stream->header.data() + stream->header_sent,
+				stream->header.size() - stream->header_sent);
+			if (ret <= 0)
+			{
+				stream->failed = ret < 0;
+				blocked = true;
+				break;
+			}
+			stream->header_sent += ret;
+			progress = true;
+		}
+		while (!blocked && !stream->filled.empty())
+		{
+			StreamWindow* window = stream->filled.front();
+			long ret = stream_push(stream->server_task, window->buf + window->sent, window->len - window->sent);
+			if (ret <= 0)
+			{
+				stream->failed = ret < 0;
+				blocked = true;
+				break;
+			}
+			progress = true;
+			window->sent += ret;
+			if (window->sent == window->len)
+			{
+				stream->filled.pop_front();
+				stream->free_list.push_back(window);
+			}
+		}
+		if (progress)
+		{
+			stream->backoff_ms = 0;
+			stream->stall_ms = 0;
+		}
+		return !blocked;
+	}
+
+	void stream_callback(const ParallelWork* pwork)
+	{
+		auto* stream = static_cast<FileStream*>(pwork->get_context());
+		// reads were chained, they finish in file order
+		while (!stream->reading.empty())
+		{
+			StreamWindow* window = stream->reading.front();
+			stream->reading.pop_front();
+			if (window->ret != static_cast<long>(window->len))
+				stream->failed = true;
+			stream->filled.push_back(window);
+		}
+		if (stream->failed)
+		{
+			if (!stream->detached)
+				stream_error(stream->server_task);
+			else
+				XLOG_ERROR("file stream aborted at offset {}", stream->read_offset);
+			return;
+		}
+		if (!stream->detached)
+		{
+			// The handler has returned, every header it wanted is set by now
+			stream->header = stream->server_task->detach_resp_header();
+			stream->detached = true;
+		}
+		stream_step(stream);
+	}
+
+	void stream_step(FileStream* stream)
+	{
+		bool writable = true;
+		if (stream->detached)
+		{
+			writable = stream_flush(stream);
+			if (stream->failed)
+			{
+				XLOG_ERROR("file stream push error, errno {}", errno);
+				return;
+			}
+		}
+
+		SeriesWork* read_series = nullptr;
+		while (!stream->free_list.empty() && stream->read_offset < stream->end)
+		{
+			StreamWindow* window = stream->free_list.front();
+			stream->free_list.pop_front();
+			window->offset = stream->read_offset;
+			window->len = std::min(k_stream_window_size, stream->end - stream->read_offset);
+			window->sent = 0;
+			stream->read_offset += window->len;
+			stream->reading.push_back(window);
+
+#ifndef OS_WINDOWS
+			SubTask* task = create_window_read_task(stream->fd, window);
+#else
+			SubTask* task = create_window_read_task(stream->fp, window);
+#endif
+			if (read_series)
+				read_series->push_back(task);
+			else
+				read_series = Workflow::create_series_work(task, nullptr);
+		}
+
+		if (!read_series && writable && stream->filled.empty())
+			return;     // everything is on the wire
+
+		ParallelWork* pwork = Workflow::create_parallel_work(stream_callback);
+		pwork->set_context(stream);
+		if (read_series)
+			pwork->add_series(read_series);
+		if (!writable)
+		{
+			// Workflow does not tell us when the socket drains, poll it with a growing delay
+			stream->backoff_ms = std::min(std::max(stream->backoff_ms * 2, 1), k_stream_max_backoff_ms);
+			stream->stall_ms += stream->backoff_ms;
+			if (stream->stall_ms > k_stream_stall_timeout_ms)
+			{
+				XLOG_ERROR("file stream stalled for {} ms, give up", stream->stall_ms);
+				pwork->dismiss();
+				return;
+			}
+			WFTimerTask* timer = WFTaskFactory::create_timer_task(stream->backoff_ms * 1000, nullptr);
+			pwork->add_series(Workflow::create_series_work(timer, nullptr));
+		}
+		**stream->server_task << pwork;
+	}
+
+	// takes the ownership of the FILE*, the fd stays with its owner until the task ends
+#ifndef OS_WINDOWS
+	void start_file_stream(int fd, size_t start, size_t end, HttpResp* resp)
+#else
+	void start_file_stream(FILE* fp, size_t start, size_t end, HttpResp* resp)
+#endif
+	{
+		auto* stream = new FileStream;
+		stream->server_task = task_of(resp);
+#ifndef OS_WINDOWS
+		stream->fd = fd;
+#else
+		stream->fp = fp;
+#endif
+		stream->read_offset = start;
+		stream->end = end;
+		for (auto& window : stream->windows)
+		{
+			// registered with the kernel when the io_uring backend runs
+			window.buf = static_cast<char*>(FileIO::alloc_buffer(k_stream_window_size));
+			stream->free_list.push_back(&window);
+		}
+		stream->server_task->add_callback([stream](HttpTask*)
+			{
+				delete stream;
+			});
+
+		resp->headers["Content-Length"] = std::to_string(end - start);
+		// a stream that fails half way can only be reported by closing the connection
+		resp->headers["Connection"] = "close";
+		// the first windows are read before the header goes out
+		stream_step(stream);
+	}
+
+	// Streaming of files wrapped in a format written front to back (ZIP, multipart),
+	// on the windows of the file streams : the files are read one window after the other,
+	// and the bytes of the format around and between them are pushed as they are ready.
+	// Memory is the windows plus at most k_archive_max_output bytes waiting for the socket.
+	const size_t k_archive_max_output = k_stream_windows * k_stream_window_size;
+
+	struct ArchiveSource
+	{
+		std::string path;
+		// entry name, or the filename of a part
+		std::string name;
+		// form field of a part
+		std::string field;
+		uint64_t size;
+		time_t mtime;
+#ifndef OS_WINDOWS
+		int fd = -1;
+#else
+		FILE* fp = nullptr;
+#endif
+	};
+
+	// The bytes of the format, appended to out
+	class ArchiveEncoder
+	{
+	public:
+		virtual ~ArchiveEncoder() = default;
+
+		virtual void begin_file(const ArchiveSource& source, std::string* out) = 0;
+
+		// the data of the file, given window by window
+		virtual bool file_data(const char* data, size_t len, std::string* out) = 0;
+
+		virtual bool end_file(std::string* out) = 0;
+
+		// after the last file
+		virtual void finish(std::string* out) = 0;
+
+		// false when the windows go on the wire as they are, nothing appended by file_data()
+		virtual bool copies_data() const = 0;
+	};
+
+	class ZipEncoder : public ArchiveEncoder
+	{
+	public:
+		ZipEncoder(bool deflate, int level) : writer_(deflate, level), deflate_(deflate)
+		{}
+
+		void begin_file(const ArchiveSource& source, std::string* out) override
+		{
+			writer_.begin_file(source.name, source.size, source.mtime, out);
+		}
+
+		bool file_data(const char* data, size_t len, std::string* out) override
+		{
+			return writer_.file_data(data, len, out) == StatusOK;
+		}
+
+		bool end_file(std::string* out) override
+		{
+			return writer_.end_file(out) == StatusOK;
+		}
+
+		void finish(std::string* out) override
+		{
+			writer_.finish(out);
+		}
+
+		bool copies_data() const override
+		{
+			return deflate_;
+		}
+
+	private:
+		ZipWriter writer_;
+		bool deflate_;
+	};
+
+	// The layout HttpResp::String(MultiPartEncoder) always had :
+	// the params, then "\r\n--boundary" part headers before each file, then the close delimiter.
+	class MultiPartStreamEncoder : public ArchiveEncoder
+	{
+	public:
+		explicit MultiPartStreamEncoder(const std::string& boundary) : boundary_(boundary)
+		{}
+
+		void param(const std::string& name, const std::string& value, std::string* out) const
+		{
+			out->append("\r\n--");
+			out->append(boundary_);
+			out->append("\r\nContent-Disposition: form-data; name=\"");
+			out->append(name);
+			out->append("\"\r\n\r\n");
+			out->append(value);
+		}
+
+		void begin_file(const ArchiveSource& source, std::string* out) override
+		{
+			out->append("\r\n--");
+			out->append(boundary_);
+			out->append("\r\nContent-Disposition: form-data; name=\"");
+			out->append(source.field);
+			out->append("\"; filename=\"");
+			out->append(source.name);
+			out->append("\"\r\nContent-Type: ");
+			out->append(file_content_type(source.path));
+			out->append("\r\n\r\n");
+		}
+
+		bool file_data(const char* data, size_t len, std::string* out) override
+		{
+			return true;
+		}
+
+		bool end_file(std::string* out) override
+		{
+			return true;
+		}
+
+		void finish(std::string* out) override
+		{
+			out->append("\r\n--");
+			out->append(boundary_);
+			out->append("--\r\n");
+		}
+
+		bool copies_data() const override
+		{
+			return false;
+		}
+
+	private:
+		std::string boundary_;
+	};
+
+	struct ArchiveWindow : public StreamWindow
+	{
+		size_t source;
+	};
+
+	// generated bytes, or a stored window sent as it is
+	struct ArchiveChunk
+	{
+		std::string bytes;
+		ArchiveWindow* window;
+		size_t sent;
+	};
+
+	struct ArchiveStream
+	{
+		HttpServerTask* server_task;
+		std::unique_ptr<ArchiveEncoder> encoder;
+		// the size is not known, the archive goes out in chunks
+		bool chunked;
+		std::vector<ArchiveSource> sources;
+		// next window to read
+		size_t read_source = 0;
+		uint64_t read_offset = 0;
+		// entry being written into the archive
+		size_t write_source = 0;
+		bool in_file = false;
+		bool finished = false;
+		std::string header;
+		size_t header_sent = 0;
+		bool detached = false;
+		bool failed = false;
+		int backoff_ms = 0;
+		int stall_ms = 0;
+		ArchiveWindow windows[k_stream_windows];
+		std::deque<ArchiveWindow*> free_list;
+		std::deque<ArchiveWindow*> reading;
+		std::deque<ArchiveChunk> output;
+		size_t output_bytes = 0;
+		// archive bytes not queued yet
+		std::string pending;
+
+		~ArchiveStream()
+		{
+			for (auto& window : windows)
+				FileIO::free_buffer(window.buf);
+			for (auto& source : sources)
+			{
+#ifndef OS_WINDOWS
+				if (source.fd >= 0)
+					close(source.fd);
+#else
+				if (source.fp)
+					fclose(source.fp);
+#endif
+			}
+		}
+	};
+
+	void archive_step(ArchiveStream* stream);
+
+	// the bytes of the format so far, as a chunk when the size is not known
+	void archive_queue_pending(ArchiveStream* stream)
+	{
+		if (stream->pending.empty())
+			return;
+		ArchiveChunk chunk;
+		if (stream->chunked)
+		{
+			char size[32];
+			snprintf(size, sizeof size, "%zx\r\n", stream->pending.size());
+			chunk.bytes.reserve(strlen(size) + stream->pending.size() + 2);
+			chunk.bytes.append(size);
+			chunk.bytes.append(stream->pending);
+			chunk.bytes.append("\r\n");
+			stream->pending.clear();
+		}
+		else
+		{
+			chunk.bytes.swap(stream->pending);
+		}
+		chunk.window = nullptr;
+		chunk.sent = 0;
+		stream->output_bytes += chunk.bytes.size();
+		stream->output.push_back(std::move(chunk));
+	}
+
+	void archive_close_source(ArchiveSource& source)
+	{
+#ifndef OS_WINDOWS
+		if (source.fd >= 0)
+			close(source.fd);
+		source.fd = -1;
+#else
+		if (source.fp)
+			fclose(source.fp);
+		source.fp = nullptr;
+#endif
+	}
+
+	// the entries up to index, all of their data has been written
+	bool archive_end_entries(ArchiveStream* stream, size_t index)
+	{
+		while (stream->write_source < index)
+		{
+			ArchiveSource& source = stream->sources[stream->write_source];
+			if (!stream->in_file)
+				stream->encoder->begin_file(source, &stream->pending);
+			if (!stream->encoder->end_file(&stream->pending))
+				return false;
+			archive_close_source(source);
+			stream->in_file = false;
+			stream->write_source++;
+		}
+		return true;
+	}
+
+	bool archive_write_window(ArchiveStream* stream, ArchiveWindow* window)
+	{
+		if (!archive_end_entries(stream, window->source))
+			return false;
+		ArchiveSource& source = stream->sources[window->source];
+		if (!stream->in_file)
+		{
+			stream->encoder->begin_file(source, &stream->pending);
+			stream->in_file = true;
+		}
+		if (!stream->encoder->file_data(window->buf, window->len, &stream->pending))
+			return false;
+		if (!stream->encoder->copies_data())
+		{
+			archive_queue_pending(stream);
+			ArchiveChunk chunk;
+			chunk.window = window;
+			chunk.sent = 0;
+			stream->output_bytes += window->len;
+			stream->output.push_back(std::move(chunk));
+		}
+		else
+		{
+			stream->free_list.push_back(window);
+		}
+		if (window->offset + window->len == source.size)
+			return archive_end_entries(stream, window->source + 1);
+		return true;
+	}
+
+	// the end of the format (ZIP central directory) once every file is in
+	bool archive_finish(ArchiveStream* stream)
+	{
+		if (!archive_end_entries(stream, stream->sources.size()))
+			return false;
+		stream->encoder->finish(&stream->pending);
+		archive_queue_pending(stream);
+		if (stream->chunked)
+		{
+			ArchiveChunk last;
+			last.bytes = "0\r\n\r\n";
+			last.window = nullptr;
+			last.sent = 0;
+			stream->output_bytes += last.bytes.size();
+			stream->output.push_back(std::move(last));
+		}
+		stream->finished = true;
+		return true;
+	}
+
+	// Push what is ready without blocking. return false if the socket is full.
+	bool archive_flush(ArchiveStream* stream)
+	{
+		bool progress = false;
+		bool blocked = false;
+		while (stream->header_sent < stream->header.size())
+		{
+			long ret = stream_push(stream->server_task, stream->header.data() + stream->header_sent,
+				stream->header.size() - stream->header_sent);
+			if (ret <= 0)
+			{
+				stream->failed = ret < 0;
+				blocked = true;
+				break;
+			}
+			stream->header_sent += ret;
+			progress = true;
+		}
+		while (!blocked && !stream->output.empty())
+		{
+			ArchiveChunk& chunk = stream->output.front();
+			const char* data = chunk.window ? chunk.window->buf : chunk.bytes.data();
+			size_t len = chunk.window ? chunk.window->len : chunk.bytes.size();
+			long ret = stream_push(stream->server_task, data + chunk.sent, len - chunk.sent);
+			if (ret <= 0)
+			{
+				stream->failed = ret < 0;
+				blocked = true;
+				break;
+			}
+			progress = true;
+			chunk.sent += ret;
+			if (chunk.sent == len)
+			{
+				if (chunk.window)
+					stream->free_list.push_back(chunk.window);
+				stream->output_bytes -= len;
+				stream->output.pop_front();
+			}
+		}
+		if (progress)
+		{
+			stream->backoff_ms = 0;
+			stream->stall_ms = 0;
+		}
+		return !blocked;
+	}
+
+	void archive_callback(const ParallelWork* pwork)
+	{
+		auto* stream = static_cast<ArchiveStream*>(pwork->get_context());
+		// reads were chained, they finish in archive order
+		while (!stream->reading.empty())
+		{
+			ArchiveWindow* window = stream->reading.front();
+			stream->reading.pop_front();
+			if (stream->failed || window->ret != static_cast<long>(window->len))
+			{
+				stream->failed = true;
+				stream->free_list.push_back(window);
+				continue;
+			}
+			if (!archive_write_window(stream, window))
+				stream->failed = true;
+		}
+		if (!stream->failed && !stream->finished && stream->read_source == stream->sources.size())
+		{
+			if (!archive_finish(stream))
+				stream->failed = true;
+		}
+		if (!stream->failed)
+			archive_queue_pending(stream);
+		if (stream->failed)
+		{
+			if (!stream->detached)
+				stream_error(stream->server_task);
+			else
+				XLOG_ERROR("archive stream aborted in {}", stream->sources[stream->write_source].path);
+			return;
+		}
+		if (!stream->detached)
+		{
+			// The handler has returned, every header it wanted is set by now
+			stream->header = stream->server_task->detach_resp_header();
+			stream->detached = true;
+		}
+		archive_step(stream);
+	}
+
+	// the next file of the archive with data, opened
+	bool archive_open_next(ArchiveStream* stream)
+	{
+		while (stream->read_source < stream->sources.size() &&
+			   stream->sources[stream->read_source].size == 0)
+			stream->read_source++;
+		if (stream->read_source == stream->sources.size())
+			return false;
+		ArchiveSource& source = stream->sources[stream->read_source];
+#ifndef OS_WINDOWS
+		if (source.fd < 0)
+			source.fd = open(source.path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (source.fd < 0)
+#else
+		if (!source.fp)
+			source.fp = fopen(source.path.c_str(), "rb");
+		if (!source.fp)
+#endif
+		{
+			XLOG_ERROR("archive open {} : {}", source.path, strerror(errno));
+			stream->failed = true;
+			return false;
+		}
+		return true;
+	}
+
+	void archive_step(ArchiveStream* stream)
+	{
+		bool writable = true;
+		if (stream->detached)
+		{
+			writable = archive_flush(stream);
+			if (stream->failed)
+			{
+				XLOG_ERROR("archive stream push error, errno {}", errno);
+				return;
+			}
+		}
+
+		SeriesWork* read_series = nullptr;
+		while (!stream->free_list.empty() && stream->output_bytes < k_archive_max_output &&
+			   archive_open_next(stream))
+		{
+			ArchiveSource& source = stream->sources[stream->read_source];
+			ArchiveWindow* window = stream->free_list.front();
+			stream->free_list.pop_front();
+			window->source = stream->read_source;
+			window->offset = stream->read_offset;
+			window->len = static_cast<size_t>(std::min<uint64_t>(k_stream_window_size,
+				source.size - stream->read_offset));
+			window->sent = 0;
+			stream->read_offset += window->len;
+			if (stream->read_offset == source.size)
+			{
+				stream->read_source++;
+				stream->read_offset = 0;
+			}
+			stream->reading.push_back(window);
+
+#ifndef OS_WINDOWS
+			SubTask* task = create_window_read_task(source.fd, window);
+#else
+			SubTask* task = create_window_read_task(source.fp, window);
+#endif
+			if (read_series)
+				read_series->push_back(task);
+			else
+				read_series = Workflow::create_series_work(task, nullptr);
+		}
+		if (stream->failed)
+		{
+			if (read_series)
+				read_series->dismiss();
+			if (!stream->detached)
+				stream_error(stream->server_task);
+			return;
+		}
+
+		if (!read_series && writable && stream->finished && stream->output.empty())
+			return;     // everything is on the wire
+
+		ParallelWork* pwork = Workflow::create_parallel_work(archive_callback);
+		pwork->set_context(stream);
+		if (read_series)
+			pwork->add_series(read_series);
+		if (!writable)
+		{
+			// Workflow does not tell us when the socket drains, poll it with a growing delay
+			stream->backoff_ms = std::min(std::max(stream->backoff_ms * 2, 1), k_stream_max_backoff_ms);
+			stream->stall_ms += stream->backoff_ms;
+			if (stream->stall_ms > k_stream_stall_timeout_ms)
+			{
+				XLOG_ERROR("archive stream stalled for {} ms, give up", stream->stall_ms);
+				pwork->dismiss();
+				return;
+			}
+			WFTimerTask* timer = WFTaskFactory::create_timer_task(stream->backoff_ms * 1000, nullptr);
+			pwork->add_series(Workflow::create_series_work(timer, nullptr));
+		}
+		**stream->server_task << pwork;
+	}
+
+	void start_archive_stream(ArchiveStream* stream, HttpResp* resp)
+	{
+		stream->server_task = task_of(resp);
+		for (auto& window : stream->windows)
+		{
+			window.buf = static_cast<char*>(FileIO::alloc_buffer(k_stream_window_size));
+			stream->free_list.push_back(&window);
+		}
+		stream->server_task->add_callback([stream](HttpTask*)
+			{
+				delete stream;
+			});
+	}
+
+	// digits only, no sign or blanks
+	bool parse_offset(const StringPiece& str, unsigned long long& value)
+	{
+		value = 0;
+		for (size_t i = 0; i < str.size(); i++)
+		{
+			if (str[i] < '0' || str[i] > '9' || value > (ULLONG_MAX - 9) / 10)
+				return false;
+			value = value * 10 + (str[i] - '0');
+		}
+		return true;
 	}
 
-	std::string build_multipart_end()
+	std::string content_range(size_t start, size_t end, size_t file_size)
 	{
-		std::string multi_part_last;
-		multi_part_last.reserve(128);
-		multi_part_last.append("--");
-		// RFC1521 says that a boundary "must be no longer than 70 characters, not counting the two leading hyphens".
-		multi_part_last.append(MultiPartForm::k_default_boundary);
-		multi_part_last.append("--");
-		return multi_part_last;
+		return "bytes " + std::to_string(start) + "-" + std::to_string(end - 1)
+			+ "/" + std::to_string(file_size);
 	}
 
-	void pread_multi_callback(WFFileIOTask* pread_task)
+	// The Range of a GET for the whole file, empty if the whole file is sent.
+	// StatusFileRangeInvalid (416) if none of the ranges is satisfiable.
+	int client_ranges(const std::string& etag, const std::string& last_modified,
+					  size_t file_size, HttpResp* resp, std::vector<ByteRange>& ranges)
 	{
-		FileIOArgs* args = pread_task->get_args();
-		long ret = pread_task->get_retval();
-		auto* ctx = static_cast<pread_multi_context*>(pread_task->user_data);
-		HttpResp* resp = ctx->resp;
+		resp->headers["Accept-Ranges"] = "bytes";
+		const HttpReq* req = task_of(resp)->get_req();
+		if (strcmp(req->get_method(), "GET") != 0)
+			return StatusOK;
 
-		std::string multipart_start = build_multipart_start(ctx->file_name, ctx->file_index);
-		ctx->multipart_start = std::move(multipart_start);
-		resp->append_output_body(ctx->multipart_start.c_str(), ctx->multipart_start.size());
-		if (pread_task->get_state() != WFT_STATE_SUCCESS || ret < 0)
-		{
-			char res[256];
-			resp->set_status_code("503");
-			//resp->append_output_body_nocopy("503 Internal Server Error\n", 26);
-			//resp->Error(StatusFileReadError);
-			sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 503, "503 Internal Server Error", ctx->file_name.substr(ctx->file_name.find_last_of("/")).c_str());
-			resp->append_output_body(res, strlen(res));
-		}
-		else
+		const std::string& range = req->header("Range");
+		if (range.empty())
+			return StatusOK;
+
+		// https://datatracker.ietf.org/doc/html/rfc7233#section-3.2
+		// the ranges are for the version the client holds, or the whole new one is sent
+		const std::string& if_range = req->header("If-Range");
+		if (!if_range.empty())
 		{
-			resp->append_output_body(args->buf, ret);
+			// strong comparison only, a weak tag never matches
+			if (if_range.front() == '"' ? if_range != etag : if_range != last_modified)
+				return StatusOK;
 		}
 
-		if (ctx->last)   // last one
+		int ret = HttpFile::parse_range(range, file_size, ranges);
+		if (ret != StatusOK)
+			resp->headers["Content-Range"] = "bytes */" + std::to_string(file_size);
+		return ret;
+	}
+
+#ifndef OS_WINDOWS
+	// A page of a mapping past the end of a file truncated meanwhile faults when touched.
+	// writev() copies in the kernel, the write fails with EFAULT and the connection
+	// is lost. SSL_write() encrypts in user space, the fault is a SIGBUS that takes
+	// the server down : over TLS files are read, never mapped.
+	bool may_map(HttpServerTask* server_task, int fd, size_t end)
+	{
+		if (server_task->is_ssl())
+			return false;
+		// the size the open file cache saw may be stale
+		struct stat st;
+		return fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= end;
+	}
+
+	size_t ranges_size(const std::vector<ByteRange>& ranges)
+	{
+		size_t size = 0;
+		for (const auto& range : ranges)
+			size += range.end - range.start;
+		return size;
+	}
+
+	struct ByteRangesRead
+	{
+		char* buf;
+		bool failed = false;
+	};
+
+	// The parts of the ranges read into one buffer, in the series of the task.
+	// Takes the ownership of parts.
+	void read_byteranges(int fd, const std::vector<ByteRange>& ranges,
+						 std::vector<std::string>* parts, HttpResp* resp)
+	{
+		HttpServerTask* server_task = task_of(resp);
+		auto* read = new ByteRangesRead;
+		read->buf = static_cast<char*>(malloc(ranges_size(ranges)));
+		server_task->add_callback([parts, read](HttpTask*)
+			{
+				free(read->buf);
+				delete read;
+				delete parts;
+			});
+		char* part_buf = read->buf;
+		for (size_t i = 0; i < ranges.size(); i++)
 		{
-			std::string multipart_end = build_multipart_end();
-			ctx->multipart_end = std::move(multipart_end);
-			resp->append_output_body(ctx->multipart_end.c_str(), ctx->multipart_end.size());
+			size_t len = ranges[i].end - ranges[i].start;
+			resp->append_output_body_nocopy((*parts)[i].data(), (*parts)[i].size());
+			resp->append_output_body_nocopy(part_buf, len);
+			FileIOTask* pread_task = FileIO::create_pread_task(fd, part_buf, len,
+				static_cast<off_t>(ranges[i].start),
+				[read, resp, len](FileIOTask* task)
+				{
+					if (read->failed)
+						return;
+					// short, the file was truncated meanwhile
+					if (task->get_state() != WFT_STATE_SUCCESS || task->get_retval() != static_cast<long>(len))
+					{
+						read->failed = true;
+						resp->clear_output_body();
+						resp->Error(StatusFileReadError);
+					}
+				});
+			**server_task << pread_task;
+			part_buf += len;
 		}
 	}
+#endif
 
-	void pwrite_callback(WFFileIOTask* pwrite_task)
+	// multipart/byteranges, each part is sent from disk as it is
+#ifndef OS_WINDOWS
+	int send_byteranges(int fd, const std::vector<ByteRange>& ranges, size_t file_size, HttpResp* resp)
+#else
+	int send_byteranges(const std::string& path, const std::vector<ByteRange>& ranges, size_t file_size, HttpResp* resp)
+#endif
 	{
-		long ret = pwrite_task->get_retval();
-		HttpServerTask* server_task = task_of(pwrite_task);
-		HttpResp* resp = server_task->get_resp();
-		auto* ctx = static_cast<pread_multi_context*>(pwrite_task->user_data);
-		//delete static_cast<std::string*>(pwrite_task->user_data);	
-		
-		char res[256];
-		if (pwrite_task->get_state() != WFT_STATE_SUCCESS || ret < 0)
+		const std::string& content_type = resp->headers["Content-Type"];
+		// part headers are appended without copy, they live as long as the task
+		auto* parts = new std::vector<std::string>;
+		parts->reserve(ranges.size() + 1);
+		for (const auto& range : ranges)
 		{
-			resp->set_status_code("503");
-			//resp->append_output_body_nocopy("503 Internal Server Error\n", 26);
-			//resp->Error(StatusFileWriteError);
-			sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 503, "503 Internal Server Error", ctx->file_name.substr(ctx->file_name.find_last_of("/")).c_str());
-			resp->append_output_body(res, strlen(res));
+			std::string part;
+			part.append("\r\n--");
+			part.append(MultiPartForm::k_default_boundary);
+			part.append("\r\nContent-Type: ");
+			part.append(content_type);
+			part.append("\r\nContent-Range: ");
+			part.append(content_range(range.start, range.end, file_size));
+			part.append("\r\n\r\n");
+			parts->push_back(std::move(part));
+		}
+		parts->push_back("\r\n--" + MultiPartForm::k_default_boundary + "--\r\n");
+
+		HttpServerTask* server_task = task_of(resp);
+#ifndef OS_WINDOWS
+		// ranges are sorted, map from the first to the last one
+		off_t map_start = ranges.front().start & ~(static_cast<off_t>(sysconf(_SC_PAGESIZE)) - 1);
+		size_t map_len = ranges.back().end - map_start;
+		void* addr = MAP_FAILED;
+		if (may_map(server_task, fd, ranges.back().end))
+			addr = mmap(nullptr, map_len, PROT_READ, MAP_SHARED, fd, map_start);
+		if (addr == MAP_FAILED)
+		{
+			read_byteranges(fd, ranges, parts, resp);
 		}
 		else
 		{
-			//resp->append_output_body_nocopy("Save 200 success\n", 17);
-			sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 503, "503 Internal Server Error", ctx->file_name.substr(ctx->file_name.find_last_of("/")).c_str());
-			resp->append_output_body(res, strlen(res));
+			server_task->add_callback([parts, addr, map_len](HttpTask*)
+				{
+					munmap(addr, map_len);
+					delete parts;
+				});
+			for (size_t i = 0; i < ranges.size(); i++)
+			{
+				resp->append_output_body_nocopy((*parts)[i].data(), (*parts)[i].size());
+				resp->append_output_body_nocopy(static_cast<char*>(addr) + (ranges[i].start - map_start),
+												ranges[i].end - ranges[i].start);
+			}
+		}
+#else
+		FILE* f = fopen(path.c_str(), "rb");
+		if (f == NULL)
+		{
+			delete parts;
+			return StatusNotFound;
+		}
+		server_task->add_callback([parts](HttpTask*)
+			{
+				delete parts;
+			});
+		std::string buf;
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			buf.resize(ranges[i].end - ranges[i].start);
+			fseek(f, ranges[i].start, SEEK_SET);
+			size_t len = fread(&buf[0], 1, buf.size(), f);
+			resp->append_output_body_nocopy((*parts)[i].data(), (*parts)[i].size());
+			// append_output_body() copies
+			resp->append_output_body(buf.data(), len);
 		}
-		delete static_cast<pread_multi_context*>(pwrite_task->user_data);
+		fclose(f);
+#endif
+		resp->append_output_body_nocopy(parts->back().data(), parts->back().size());
+		resp->set_status(206);
+		resp->headers["Content-Type"] = "multipart/byteranges; boundary=" + MultiPartForm::k_default_boundary;
+		return StatusOK;
 	}
 
 }  // namespace
 
 // note : [start, end)
-int HttpFile::send_file(const std::string &path, size_t file_start, size_t file_end, HttpResp *resp)
+// The fd is not owned, it stays open until the task ends.
+static int send_opened_file(const std::string& path, const OpenFileInfo& file,
+							size_t file_start, size_t file_end, HttpResp* resp)
 {
-	if(!PathUtil::is_file(path))
-    {
-        return StatusNotFound;
-    }
-    int start = file_start;
-    int end = file_end;
-	if (end == -1 || start < 0)
+	size_t file_size = file.size;
+	HttpServerTask *server_task = task_of(resp);
+#ifndef OS_WINDOWS
+	int fd = file.fd;
+#endif
+	// File(path, -100) : the last 100 bytes
+	long long first = static_cast<long long>(file_start);
+	if (first < 0) first += file_size;
+	size_t end = file_end == static_cast<size_t>(-1) ? file_size : std::min(file_end, file_size);
+	bool whole = first == 0 && end == file_size;
+
+	if (first < 0 || (static_cast<size_t>(first) >= end && !whole))
+	{
+		resp->headers["Content-Range"] = "bytes */" + std::to_string(file_size);
+		return StatusFileRangeInvalid;
+	}
+	size_t start = first;
+
+	// keep the type of the original file when sending app.js.gz
+	if (resp->headers.find("Content-Type") == resp->headers.end())
+	{
+		resp->headers["Content-Type"] = file_content_type(path);
+	}
+
+	if (whole)
 	{
-		size_t file_size;
-		int ret = FileUtil::size(path, OUT & file_size);
+		std::string file_etag = HttpFile::etag(file.ino, file_size, file.mtime);
+		std::string file_last_modified = HttpFile::last_modified(file.mtime);
+		// validators describe the whole file, a slice is not revalidated
+		if (check_not_modified(file_etag, file_last_modified, file.mtime, file_size, resp))
+		{
+			return StatusOK;
+		}
 
+		std::vector<ByteRange> ranges;
+		int ret = client_ranges(file_etag, file_last_modified, file_size, resp, ranges);
 		if (ret != StatusOK)
 		{
-			char res[256];
-			resp->set_status(404);
-			//resp->headers["Content-Type"] = "text/html";
-			//resp->append_output_body_nocopy("404 File NOT FOUND\n", 19);
-			sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 404, "404 File NOT FOUND", path.substr(path.find_last_of("/") + 1).c_str());
-			resp->append_output_body(res, strlen(res));
 			return ret;
 		}
-		if (end == -1) end = file_size;
-		if (start < 0) start = file_size + start;
-	}
-
-    if (end <= start)
-    {
-        return StatusFileRangeInvalid;
-    }
-
-    http_content_type content_type = CONTENT_TYPE_NONE;
-    std::string suffix = PathUtil::suffix(path);
-    if(!suffix.empty())
-    {
-        content_type = ContentType::to_enum_by_suffix(suffix);
-    }
-    if (content_type == CONTENT_TYPE_NONE || content_type == CONTENT_TYPE_UNDEFINED) {
-        content_type = APPLICATION_OCTET_STREAM;
-    }
-    resp->headers["Content-Type"] = ContentType::to_str(content_type);
-
-    size_t size = end - start;
-    void *buf = malloc(size);
-
-    HttpServerTask *server_task = task_of(resp);
-    server_task->add_callback([buf](HttpTask *server_task)
-                              {
-                                  free(buf);
-                              });
-    // https://datatracker.ietf.org/doc/html/rfc7233#section-4.2
-    // Content-Range: bytes 42-1233/1234
-    resp->headers["Content-Range"] = "bytes " + std::to_string(start)
-                                            + "-" + std::to_string(end)
-                                            + "/" + std::to_string(size);
+		if (ranges.size() > 1)
+		{
+#ifndef OS_WINDOWS
+			// over TLS the parts are read into a buffer, whatever their size
+			return send_byteranges(fd, ranges, file_size, resp);
+#else
+			return send_byteranges(path, ranges, file_size, resp);
+#endif
+		}
+		if (ranges.size() == 1)
+		{
+			start = ranges[0].start;
+			end = ranges[0].end;
+			whole = false;
+		}
+	}
+
+	if (!whole)
+	{
+		// https://datatracker.ietf.org/doc/html/rfc7233#section-4.1
+		// Content-Range: bytes 42-1233/1234, the last byte is included
+		resp->set_status(206);
+		resp->headers["Content-Range"] = content_range(start, end, file_size);
+	}
+
+	size_t size = end - start;
+	if (size == 0)
+	{
+		return StatusOK;
+	}
 
 #ifndef OS_WINDOWS
- WFFileIOTask *pread_task = WFTaskFactory::create_pread_task(path,
-                                                                buf,
-                                                                size,
-                                                                static_cast<off_t>(start),
-                                                                pread_callback);
-    pread_task->user_data = resp;  
+	if (file.addr && !server_task->is_ssl())
+	{
+		// mapped once by the open file cache, the caller's handle keeps the mapping alive.
+		// No fstat() here, a truncated file only fails the writev() (see may_map())
+		resp->append_output_body_nocopy(static_cast<const char *>(file.addr) + start, size);
+		return StatusOK;
+	}
+	// Large files go through the read windows : memory stays at k_stream_windows
+	// windows whatever the size, and nothing of the file stays mapped for the whole download.
+	// TLS responses keep the buffered read below, the whole range is read before it is sent.
+	if (size >= k_stream_window_size * k_stream_windows && !server_task->is_ssl())
+	{
+		start_file_stream(fd, start, end, resp);
+		return StatusOK;
+	}
+	// Workflow writes the output body with writev() and does not give us the socket,
+	// so sendfile() is out of reach. The nearest thing for the others : map the file
+	// and hand the page cache pages to writev() directly, no heap buffer and no copy.
+	if (size >= k_file_map_threshold && may_map(server_task, fd, end))
+	{
+		off_t map_start = start & ~(static_cast<off_t>(sysconf(_SC_PAGESIZE)) - 1);
+		size_t map_len = end - map_start;
+		void *addr = mmap(nullptr, map_len, PROT_READ, MAP_SHARED, fd, map_start);
+		if (addr != MAP_FAILED)
+		{
+			madvise(addr, map_len, MADV_SEQUENTIAL);
+			server_task->add_callback([addr, map_len](HttpTask *)
+									  {
+										  munmap(addr, map_len);
+									  });
+			resp->append_output_body_nocopy(static_cast<char *>(addr) + (start - map_start), size);
+			return StatusOK;
+		}
+		// fall back to reading it
+	}
+
+	void *buf = malloc(size);
+	auto *ctx = new pread_multi_context;
+	ctx->file_name = path;
+	ctx->resp = resp;
+	server_task->add_callback([buf, ctx](HttpTask *)
+							  {
+								  free(buf);
+								  delete ctx;
+							  });
+	FileIOTask *pread_task = FileIO::create_pread_task(fd,
+																buf,
+																size,
+																static_cast<off_t>(start),
+																pread_callback);
+    pread_task->user_data = ctx;
     **server_task << pread_task;
 #else
 	FILE* f = fopen(path.c_str(), "rb");
@@ -239,13 +1710,337 @@ int HttpFile::send_file(const std::string &path, size_t file_start, size_t file_
 		resp->append_output_body(res, strlen(res));
 		return StatusNotFound;
 	}
+	else if (size >= k_stream_window_size * k_stream_windows && !server_task->is_ssl())
+	{
+		// constant memory however large the file is
+		start_file_stream(f, start, end, resp);
+	}
 	else
 	{
+		void *buf = malloc(size);
+		fseek(f, start, SEEK_SET);
 		int bufLen = fread(buf, 1, size, f);
 		fclose(f);
+		// append_output_body() copies
 		resp->append_output_body(buf, bufLen);
+		free(buf);
+	}
+#endif
+	return StatusOK;
+}
+
+// small files come from the cache, without a stat or a read per request,
+// the others from the cached fd or mapping
+static int send_static_file(const std::string& path, const StaticOptions& options, StaticCache* cache,
+							OpenFileCache* files, HttpResp* resp)
+{
+	const OpenFileCache::OpenFileHandle* handle = files ? files->get(path, options.mmap) : nullptr;
+	if (handle)
+	{
+		if (handle->value.error != 0 || handle->value.is_dir)
+		{
+			// negative entries answer the 404 storms of scanners
+			files->release(handle);
+			return StatusNotFound;
+		}
+		task_of(resp)->add_callback([files, handle](HttpTask*)
+			{
+				files->release(handle);
+			});
+	}
+
+	// a mapped file needs no copy in the static cache
+	if (handle && handle->value.addr)
+		cache = nullptr;
+
+	StaticCache::EntryPtr entry = cache ? cache->get(path) : nullptr;
+	// a Range is rare on small files, let send_file() deal with it
+	if (!entry || task_of(resp)->get_req()->has_header("Range"))
+	{
+		if (handle)
+			return send_opened_file(path, handle->value, 0, -1, resp);
+		return HttpFile::send_file(path, 0, -1, resp);
+	}
+
+	if (resp->headers.find("Content-Type") == resp->headers.end())
+		resp->headers["Content-Type"] = entry->content_type;
+	if (check_not_modified(entry->etag, entry->last_modified, entry->mtime, entry->size, resp))
+		return StatusOK;
+	resp->headers["Accept-Ranges"] = "bytes";
+	resp->append_output_body_nocopy(entry->content.data(), entry->content.size());
+	// the bytes stay valid until the response is sent, even if the entry is evicted
+	task_of(resp)->add_callback([entry](HttpTask*) {});
+	return StatusOK;
+}
+
+// a regular file, through the open file cache when there is one
+static bool static_file_stat(OpenFileCache* files, const std::string& path, time_t& mtime, size_t& size)
+{
+	const OpenFileCache::OpenFileHandle* handle = files ? files->get(path) : nullptr;
+	if (!handle)
+	{
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+			return false;
+		mtime = st.st_mtime;
+		size = st.st_size;
+		return true;
+	}
+	bool found = handle->value.error == 0 && !handle->value.is_dir;
+	mtime = handle->value.mtime;
+	size = handle->value.size;
+	files->release(handle);
+	return found;
+}
+
+static int send_static_variant(const std::string& path, const StaticOptions& options, StaticCache* cache,
+							   OpenFileCache* files, const HttpReq* req, HttpResp* resp)
+{
+	if (!options.precompressed)
+		return send_static_file(path, options, cache, files, resp);
+
+	std::string content_type = file_content_type(path);
+	if (!is_compressible(content_type))
+		return send_static_file(path, options, cache, files, resp);
+
+	// the body depends on Accept-Encoding even when we send the original file
+	resp->headers["Vary"] = "Accept-Encoding";
+
+	time_t mtime;
+	size_t size;
+	if (!static_file_stat(files, path, mtime, size))
+		return send_static_file(path, options, cache, files, resp);
+
+	const std::string& accept = req->header("Accept-Encoding");
+	for (const auto& variant : k_precompressed_variants)
+	{
+		if (!accept_encoding(accept, variant.encoding))
+			continue;
+
+		std::string variant_path = path + variant.suffix;
+		time_t variant_mtime;
+		size_t variant_size;
+		// a sibling older than the original is stale
+		bool fresh = static_file_stat(files, variant_path, variant_mtime, variant_size) && variant_mtime >= mtime;
+		if (!fresh)
+		{
+			if (options.generate_precompressed && size <= options.precompress_max_size)
+				start_precompress(path, variant_path, variant.method, options.precompress_max_size);
+			continue;
+		}
+
+		resp->headers["Content-Type"] = content_type;
+		resp->headers["Content-Encoding"] = variant.encoding;
+		return send_static_file(variant_path, options, cache, files, resp);
+	}
+	return send_static_file(path, options, cache, files, resp);
+}
+
+int HttpFile::send_static(const std::string& path, const StaticOptions& options, StaticCache* cache,
+						  OpenFileCache* files, const HttpReq* req, HttpResp* resp)
+{
+	if (!options.cache)
+		cache = nullptr;
+
+	int ret = send_static_variant(path, options, cache, files, req, resp);
+	// only on success, an immutable 404 would outlive the file being deployed
+	if (ret == StatusOK && !options.cache_control.empty())
+		resp->headers["Cache-Control"] = options.cache_control;
+	return ret;
+}
+
+// Range: bytes=0-499, 1000-, -500
+int HttpFile::parse_range(const std::string& range, size_t file_size, std::vector<ByteRange>& ranges)
+{
+	ranges.clear();
+	StringPiece spec = StrUtil::trim(StringPiece(range));
+	// other units are ignored
+	if (spec.size() < 6 || strncasecmp(spec.data(), "bytes=", 6) != 0)
+		return StatusOK;
+	spec.remove_prefix(6);
+
+	std::vector<StringPiece> spec_list = StrUtil::split_piece<StringPiece>(spec, ',');
+	size_t count = 0;
+	for (const auto& item : spec_list)
+	{
+		StringPiece byte_range = StrUtil::trim(item);
+		if (byte_range.empty())
+			continue;
+		// a request for many tiny ranges costs more than the whole file
+		if (++count > k_max_ranges)
+		{
+			ranges.clear();
+			return StatusOK;
+		}
+
+		const char* dash = static_cast<const char*>(memchr(byte_range.data(), '-', byte_range.size()));
+		if (dash == nullptr)
+		{
+			ranges.clear();
+			return StatusOK;    // malformed, the header is ignored
+		}
+		StringPiece first(byte_range.data(), dash - byte_range.data());
+		StringPiece last(dash + 1, byte_range.end() - dash - 1);
+		unsigned long long first_pos = 0;
+		unsigned long long last_pos = 0;
+		bool has_first = !first.empty();
+		bool has_last = !last.empty();
+		if ((!has_first && !has_last) ||
+			(has_first && !parse_offset(first, first_pos)) ||
+			(has_last && !parse_offset(last, last_pos)) ||
+			(has_first && has_last && last_pos < first_pos))
+		{
+			ranges.clear();
+			return StatusOK;
+		}
+
+		ByteRange r;
+		if (!has_first)
+		{
+			// suffix : the last N bytes
+			if (last_pos == 0 || file_size == 0)
+				continue;
+			r.start = last_pos >= file_size ? 0 : file_size - last_pos;
+			r.end = file_size;
+		}
+		else
+		{
+			if (first_pos >= file_size)
+				continue;   // not satisfiable
+			r.start = first_pos;
+			r.end = has_last && last_pos < file_size ? last_pos + 1 : file_size;
+		}
+		ranges.push_back(r);
+	}
+	if (count == 0)
+		return StatusOK;
+	if (ranges.empty())
+		return StatusFileRangeInvalid;
+
+	// overlapping and adjacent ranges are sent once (RFC 7233 4.1 allows coalescing)
+	std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b)
+		{
+			return a.start < b.start;
+		});
+	size_t merged = 0;
+	for (size_t i = 1; i < ranges.size(); i++)
+	{
+		if (ranges[i].start <= ranges[merged].end)
+			ranges[merged].end = std::max(ranges[merged].end, ranges[i].end);
+		else
+			ranges[++merged] = ranges[i];
+	}
+	ranges.resize(merged + 1);
+	return StatusOK;
+}
+
+std::string HttpFile::etag(unsigned long long ino, size_t size, time_t mtime)
+{
+	char buf[64];
+	snprintf(buf, sizeof buf, "\"%llx-%zx-%llx\"", ino, size, static_cast<unsigned long long>(mtime));
+	return buf;
+}
+
+std::string HttpFile::last_modified(time_t mtime)
+{
+	return Timestamp(static_cast<uint64_t>(mtime) * Timestamp::k_micro_sec_per_sec).to_http_date();
+}
+
+int HttpFile::send_file(const std::string &path, size_t file_start, size_t file_end, HttpResp *resp)
+{
+	OpenFileInfo file;
+	if (OpenFileCache::open_file(path, file) != 0 || file.is_dir)
+	{
+		return StatusNotFound;
 	}
+#ifndef OS_WINDOWS
+	int fd = file.fd;
+	task_of(resp)->add_callback([fd](HttpTask *)
+								{
+									close(fd);
+								});
 #endif
+	return send_opened_file(path, file, file_start, file_end, resp);
+}
+
+int HttpFile::send_zip(const std::vector<std::string>& path_list, const ZipOptions& options, HttpResp* resp)
+{
+	auto* stream = new ArchiveStream;
+	stream->sources.reserve(path_list.size());
+	std::vector<std::pair<std::string, uint64_t>> entries;
+	for (const std::string& path : path_list)
+	{
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		{
+			delete stream;
+			return StatusNotFound;
+		}
+		ArchiveSource source;
+		source.path = path;
+		source.name = PathUtil::base(path);
+		source.size = st.st_size;
+		source.mtime = st.st_mtime;
+		entries.emplace_back(source.name, source.size);
+		stream->sources.push_back(std::move(source));
+	}
+	stream->encoder.reset(new ZipEncoder(options.deflate, options.level));
+	stream->chunked = options.deflate;
+	start_archive_stream(stream, resp);
+
+	resp->headers["Content-Type"] = "application/zip";
+	resp->headers["Content-Disposition"] = "attachment; filename=\"" + options.name + "\"";
+	if (options.deflate)
+		resp->headers["Transfer-Encoding"] = "chunked";
+	else
+		resp->headers["Content-Length"] = std::to_string(ZipWriter::stored_size(entries));
+	// a stream that fails half way can only be reported by closing the connection
+	resp->headers["Connection"] = "close";
+	archive_step(stream);
+	return StatusOK;
+}
+
+int HttpFile::send_multipart(const MultiPartEncoder& encoder, HttpResp* resp)
+{
+	auto* stream = new ArchiveStream;
+	auto* multi_part = new MultiPartStreamEncoder(encoder.boundary());
+	stream->encoder.reset(multi_part);
+	stream->chunked = false;
+	for (const auto& param : encoder.params())
+		multi_part->param(param.first, param.second, &stream->pending);
+	uint64_t content_length = stream->pending.size();
+
+	stream->sources.reserve(encoder.files().size());
+	std::string part_header;
+	for (const auto& file : encoder.files())
+	{
+		struct stat st;
+		if (stat(file.second.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		{
+			XLOG_ERROR("[Error] Not a File : {:s}", file.second.c_str());
+			continue;
+		}
+		ArchiveSource source;
+		source.path = file.second;
+		source.name = PathUtil::base(file.second);
+		source.field = file.first;
+		source.size = st.st_size;
+		source.mtime = st.st_mtime;
+		part_header.clear();
+		multi_part->begin_file(source, &part_header);
+		content_length += part_header.size() + source.size;
+		stream->sources.push_back(std::move(source));
+	}
+	part_header.clear();
+	multi_part->finish(&part_header);
+	content_length += part_header.size();
+	start_archive_stream(stream, resp);
+
+	resp->headers["Content-Type"] = "multipart/form-data; boundary=" + encoder.boundary();
+	resp->headers["Content-Length"] = std::to_string(content_length);
+	// a stream that fails half way can only be reported by closing the connection
+	resp->headers["Connection"] = "close";
+	archive_step(stream);
 	return StatusOK;
 }
 
@@ -284,7 +2079,7 @@ int HttpFile::send_file_for_multi(const std::vector<std::string>& path_list, int
 			delete ctx;
 		});
 #ifndef OS_WINDOWS
-	WFFileIOTask* pread_task = WFTaskFactory::create_pread_task(file_path,
+	FileIOTask* pread_task = FileIO::create_pread_task(file_path,
 		buf,
 		size,
 		0,
@@ -348,7 +2143,7 @@ int HttpFile::send_file_for_multi(const std::vector<std::string>& path_list, int
 	}
 	void* buf = malloc(size);
 /*#ifdef OS_WINDOWS
-	WFFileIOTask* pread_task = WFTaskFactory::create_pread_task(file_path,
+	FileIOTask* pread_task = FileIO::create_pread_task(file_path,
 		buf,
 		size,
 		0,
@@ -386,80 +2181,32 @@ int HttpFile::send_file_for_multi(const std::vector<std::string>& path_list, int
 //#endif
 }
 
-void HttpFile::save_file(const std::string& dst_path, const std::string& content, HttpResp* resp)
+void HttpFile::save_file(const std::string& dst_path, const std::string& content,
+						 const SaveOptions& options, HttpResp* resp)
 {
-	HttpServerTask* server_task = task_of(resp);
-
-	//auto* save_content = new std::string;
-	//*save_content = content;
-	auto* ctx = new pread_multi_context;
-	ctx->file_name = PathUtil::base(dst_path);
-	ctx->multipart_start = content; //借用变量
-	ctx->resp = resp;
-#ifndef OS_WINDOWS
-	WFFileIOTask* pwrite_task = WFTaskFactory::create_pwrite_task(dst_path,
-		static_cast<const void*>(save_content->c_str()),
-		save_content->size(),
-		0,
-		pwrite_callback);
-	**server_task << pwrite_task;
-	pwrite_task->user_data = ctx;//save_content;
-#else
-	char res[256];
-	FILE* f = fopen(dst_path.c_str(), "wb");
-	if (f == NULL)
-	{
-		resp->set_status(404);
-		//resp->append_output_body_nocopy("404 File NOT FOUND\n", 19);
-		sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 404, "404 File NOT FOUND", dst_path.c_str());
-		resp->append_output_body(res, strlen(res));
-	}
-	else
-	{
-		int bufLen = fwrite(content.c_str(), 1, content.size(), f);
-		fclose(f);
-		//resp->append_output_body_nocopy("Save 200 success\n", 17);
-		sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 0, "success", dst_path.c_str());
-		resp->append_output_body(res, strlen(res));
-	}
-#endif
+	// the caller keeps its string, one copy
+	save_file(dst_path, std::string(content), options, resp);
 }
 
-void HttpFile::save_file(const std::string& dst_path, std::string&& content, HttpResp* resp)
+void HttpFile::save_file(const std::string& dst_path, std::string&& content,
+						 const SaveOptions& options, HttpResp* resp)
 {
 	HttpServerTask* server_task = task_of(resp);
 
-	//auto* save_content = new std::string;
-	//*save_content = std::move(content);
-	auto* ctx = new pread_multi_context;
-	ctx->file_name = PathUtil::base(dst_path);
-	ctx->multipart_start = content; //借用变量
+	auto* ctx = new save_context;
+	ctx->dst_path = dst_path;
+	if (options.atomic)
+		ctx->tmp_path = save_tmp_path(dst_path);
+	ctx->content = std::move(content);
+	ctx->options = options;
 	ctx->resp = resp;
-#ifndef OS_WINDOWS
-	WFFileIOTask* pwrite_task = WFTaskFactory::create_pwrite_task(dst_path,
-		static_cast<const void*>(save_content->c_str()),
-		save_content->size(),
+
+	const std::string& path = options.atomic ? ctx->tmp_path : dst_path;
+	FileIOTask* pwrite_task = FileIO::create_pwrite_task(path,
+		static_cast<const void*>(ctx->content.data()),
+		ctx->content.size(),
 		0,
 		pwrite_callback);
+	pwrite_task->user_data = ctx;
 	**server_task << pwrite_task;
-	pwrite_task->user_data = ctx;//save_content;
-#else
-	char res[256];
-	FILE* f = fopen(dst_path.c_str(), "wb");
-	if (f == NULL)
-	{
-		resp->set_status(404);
-		//resp->append_output_body_nocopy("404 File NOT FOUND\n", 19);
-		sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 404, "404 File NOT FOUND", dst_path.c_str());
-		resp->append_output_body(res, strlen(res));
-	}
-	else
-	{
-		int bufLen = fwrite(content.c_str(), 1, content.size(), f);
-		fclose(f);
-		//resp->append_output_body_nocopy("Save 200 success\n", 17);
-		sprintf(res, "{\"code\":%d,\"msg\":\"%s\",\"fileName\":\"%s\"}", 0, "success", dst_path.c_str());
-		resp->append_output_body(res, strlen(res));
-	}
-#endif
-}
\ No newline at end of file
+}
@@ -1,25 +1,121 @@
 ﻿#ifndef WFREST_HTTPFILE_H_
 #define WFREST_HTTPFILE_H_
 
+#include <time.h>
 #include <string>
 #include <vector>
 
+namespace protocol
+{
+class HttpRequest;
+}
+
 namespace wfrest
 {
+class HttpReq;
 class HttpResp;
+class StaticCache;
+class OpenFileCache;
+class MultiPartEncoder;
+
+// per Static() mount
+struct StaticOptions
+{
+    // serve app.js.br / app.js.gz next to app.js when the client accepts them
+    bool precompressed = true;
+    // compress and write the missing .br / .gz sibling in the background on the first
+    // request, the original is sent until it is written
+    bool generate_precompressed = false;
+    // generation reads the whole file into memory : larger files are always sent as they are
+    size_t precompress_max_size = 16 * 1024 * 1024;
+    // keep small files in the server's StaticCache
+    bool cache = true;
+    // Map files up to OpenFileCache::get_map_max_size() once and send every response
+    // straight from the shared mapping, instead of the StaticCache copy or a read.
+    // Replace files by rename, truncating a mapped file in place faults the readers.
+    // Not used over TLS, where such a fault is a SIGBUS : the files are read.
+    bool mmap = false;
+    // Cache-Control of every file of the mount, none if empty.
+    // Fingerprinted assets (app.3f9a1c.js) never change under their name :
+    // "public, max-age=31536000, immutable"
+    std::string cache_control;
+};
+
+// HttpResp::Save(), per call
+struct SaveOptions
+{
+    // Write "dst.<pid>.<n>.tmp" and rename() it over dst : readers and crashes 
+    // see the old content or the new one, never a torn file.
+    bool atomic = true;
+    // fdatasync the file (and the directory of the rename) before answering,
+    // the content survives a power loss. Costs a disk flush per save.
+    bool sync = false;
+    // With sync : the saves waiting for a flush share one round on the
+    // "wfrest_sync" queue, a round syncs each directory once.
+    bool group_commit = true;
+};
+
+// HttpResp::Zip()
+struct ZipOptions
+{
+    // Content-Disposition: attachment; filename="<name>"
+    std::string name = "archive.zip";
+    // Deflate with zlib, or store. A stored archive has a Content-Length,
+    // a deflated one is sent chunked. Store what is compressed already (media, archives).
+    bool deflate = false;
+    // zlib level, -1 is zlib's default
+    int level = -1;
+};
+
+// [start, end)
+struct ByteRange
+{
+    size_t start;
+    size_t end;
+};
 
 class HttpFile
 {
 public:
+    // cache and files may be null
+    static int send_static(const std::string &path, const StaticOptions &options, StaticCache *cache,
+                           OpenFileCache *files, const HttpReq *req, HttpResp *resp);
+
     static int send_file(const std::string &path, size_t start, size_t end, HttpResp *resp);
 
+    // One ZIP archive of the files, streamed while they are read. Entries are named by
+    // the base names. StatusNotFound before anything is sent if a file is missing.
+    static int send_zip(const std::vector<std::string> &path_list, const ZipOptions &options, HttpResp *resp);
+
+    // The params then the files of the encoder as multipart/form-data, the files streamed
+    // window by window. The Content-Length comes from the file sizes, paths which are not
+    // regular files are skipped.
+    static int send_multipart(const MultiPartEncoder &encoder, HttpResp *resp);
+
     static int send_file_for_multi(const std::vector<std::string> &path_list, int path_idx, HttpResp *resp);
 
     static int send_file_for_multi(const std::vector<std::string>& path_list, int path_idx, protocol::HttpRequest* req);
 
-    static void save_file(const std::string &dst_path, const std::string &content, HttpResp *resp);
+    // answers {"code":0,"msg":"success","fileName":...}, or 503 if the file can not be written
+    static void save_file(const std::string &dst_path, const std::string &content,
+                          const SaveOptions &options, HttpResp *resp);
+
+    // content is moved into the write, not copied
+    static void save_file(const std::string &dst_path, std::string&& content,
+                          const SaveOptions &options, HttpResp *resp);
+
+    // strong validator, "inode-size-mtime" in hex
+    static std::string etag(unsigned long long ino, size_t size, time_t mtime);
+
+    static std::string last_modified(time_t mtime);
+
+    // Range header of a request for a file of file_size bytes.
+    // StatusOK : the satisfiable ranges, sorted and coalesced,
+    //            none if the header is absent or malformed (the whole file is sent).
+    // StatusFileRangeInvalid : nothing is satisfiable (416).
+    static int parse_range(const std::string &range, size_t file_size, std::vector<ByteRange> &ranges);
 
-    static void save_file(const std::string &dst_path, std::string&& content, HttpResp *resp);
+    static const size_t k_max_ranges = 16;
 };
 
 }  // namespace wfrest
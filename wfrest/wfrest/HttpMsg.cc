@@ -8,7 +8,9 @@
 #else
 #include <unistd.h>
 #endif
+#include <limits.h>
 #include <algorithm>
+#include <chrono>
 
 #include "wfrest/HttpMsg.h"
 #include "wfrest/UriUtil.h"
@@ -19,6 +21,7 @@
 #include "wfrest/MysqlUtil.h"
 #include "wfrest/ErrorCode.h"
 #include "wfrest/FileUtil.h"
+#include "wfrest/FileIO.h"
 #include "HttpMsg.h"
 #include "XLogger.h"
 
@@ -31,12 +34,45 @@ namespace wfrest
 
 struct ReqData
 {
+    bool body_decoded = false;
+    int body_status = StatusOK;
+    // the decoded body, or the plain body still in the parser buffer
+    StringPiece body_view;
     std::string body;
     std::map<std::string, std::string> form_kv;
     Form form;
+    FormView form_view;
+    bool form_parsed = false;
     Json json;
+    // HttpServer::upload_options(), and the request size limit they raised
+    const UploadOptions *upload_options = nullptr;
+    size_t size_limit = (size_t)-1;
+    bool upload_checked = false;
+    std::shared_ptr<Upload> upload;
+    // shared with the JwtVerifier cache
+    std::shared_ptr<const Json> claims;
+    // steady clock ms
+    int64_t receive_time = 0;
+    int64_t deadline = 0;
 };
 
+static int64_t steady_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// multipart/form-data; boundary="----WebKitFormBoundary7MA4YWxkTrZu0gW"
+static std::string multipart_boundary(const std::string &content_type)
+{
+    const char *boundary = strstr(content_type.c_str(), "boundary=");
+    if (boundary == nullptr)
+        return std::string();
+    boundary += strlen("boundary=");
+    StringPiece boundary_piece(boundary);
+    return StrUtil::trim_pairs(boundary_piece, R"(""'')").as_string();
+}
+
 struct ProxyCtx
 {
     std::string url;
@@ -341,60 +377,183 @@ HttpReq::~HttpReq()
 
 std::string &HttpReq::body() const
 {
-    if (req_data_->body.empty())
+    this->decode_body();
+    // copy a plain body out of the parser buffer only when asked for a string
+    if (req_data_->body.empty() && !req_data_->body_view.empty())
+        req_data_->body.assign(req_data_->body_view.data(), req_data_->body_view.size());
+    return req_data_->body;
+}
+
+StringPiece HttpReq::body_view() const
+{
+    this->decode_body();
+    // body() hands out a mutable string, follow it once it exists
+    if (!req_data_->body.empty())
+        return StringPiece(req_data_->body);
+    return req_data_->body_view;
+}
+
+int HttpReq::decode_body() const
+{
+    if (req_data_->body_decoded)
+        return req_data_->body_status;
+    req_data_->body_decoded = true;
+
+    // a plain body is decoded straight from the parser buffer, 
+    // only chunked bodies need to be joined first
+    std::string content;
+    const void *data = nullptr;
+    size_t len = 0;
+    bool chunked = this->is_chunked();
+    if (chunked)
+    {
+        content = protocol::HttpUtil::decode_chunked_body(this);
+        data = content.data();
+        len = content.size();
+    }
+    else if (!this->get_parsed_body(&data, &len))
     {
-        std::string content = protocol::HttpUtil::decode_chunked_body(this);
+        return req_data_->body_status;
+    }
 
-        const std::string &header = this->header("Content-Encoding");
-        int status = StatusOK;
-        if (header.find("gzip") != std::string::npos)
-        {
-            status = Compressor::ungzip(&content, &req_data_->body);
-        }
+    // The decoded body obeys the same limit as the received one,
+    // otherwise a few KB of gzip could expand into gigabytes.
+    const char *ptr = static_cast<const char *>(data);
+    std::string encoding = StrUtil::toLower(this->header("Content-Encoding"));
+    StrUtil::trim(encoding);
+    if (!chunked && (encoding.empty() || encoding == "identity"))
+    {
+        // nothing to decode, the view points into the parser buffer
+        req_data_->body_view = StringPiece(ptr, len);
+        return req_data_->body_status;
+    }
+
+    size_t max_size = req_data_->upload_options ? req_data_->size_limit : this->get_size_limit();
+    int status;
+    if (encoding == "gzip" || encoding == "x-gzip")
+        status = Compressor::ungzip(ptr, len, &req_data_->body, max_size);
+    else if (encoding == "deflate")
+        status = Compressor::undeflate(ptr, len, &req_data_->body, max_size);
+    else if (encoding == "br")
+        status = Compressor::unbrotli(ptr, len, &req_data_->body, max_size);
+    else if (encoding == "zstd")
+        status = Compressor::unzstd(ptr, len, &req_data_->body, max_size);
+    else
+        status = StatusNoUncomrpess;
+
+    if (status == StatusUncompressTooLarge)
+    {
+        XLOG_ERROR("{} body exceeds the request size limit {}", encoding, max_size);
+        req_data_->body.clear();
+    }
+    else if (status != StatusOK)
+    {
+        // keep the raw body, the handler may know better what it is
+        if (!chunked)
+            req_data_->body.assign(ptr, len);
         else
-        {
-            status = StatusNoUncomrpess;
-        }
-        if(status != StatusOK)
-        {
             req_data_->body = std::move(content);
-        }
     }
-    return req_data_->body;
+    if (status != StatusNoUncomrpess)
+        req_data_->body_status = status;
+    req_data_->body_view = StringPiece(req_data_->body);
+    return req_data_->body_status;
 }
 
 std::map<std::string, std::string> &HttpReq::form_kv() const
 {
     if (content_type_ == APPLICATION_URLENCODED && req_data_->form_kv.empty())
     {
-        StringPiece body_piece(this->body());
-        req_data_->form_kv = Urlencode::parse_post_kv(body_piece);
+        req_data_->form_kv = Urlencode::parse_post_kv(this->body_view());
     }
     return req_data_->form_kv;
 }
 
 Form &HttpReq::form() const
 {
+    if (req_data_->upload)
+        return req_data_->upload->fields();
     if (content_type_ == MULTIPART_FORM_DATA && req_data_->form.empty())
     {
-        StringPiece body_piece(this->body());
-
-        req_data_->form = multi_part_.parse_multipart(body_piece);
+        req_data_->form = this->form_view().to_form();
     }
     return req_data_->form;
 }
 
+const FormView &HttpReq::form_view() const
+{
+    if (content_type_ == MULTIPART_FORM_DATA && !req_data_->form_parsed && !req_data_->upload)
+    {
+        req_data_->form_parsed = true;
+        multi_part_.parse_view(this->body_view(), &req_data_->form_view);
+    }
+    return req_data_->form_view;
+}
+
+const std::vector<UploadFile> &HttpReq::files() const
+{
+    static const std::vector<UploadFile> no_files;
+    if (req_data_->upload)
+        return req_data_->upload->files();
+    return no_files;
+}
+
+Upload *HttpReq::upload() const
+{
+    return req_data_->upload.get();
+}
+
+const Json &HttpReq::claims() const
+{
+    static const Json null_claims;
+    return req_data_->claims ? *req_data_->claims : null_claims;
+}
+
+void HttpReq::set_claims(std::shared_ptr<const Json> claims)
+{
+    req_data_->claims = std::move(claims);
+}
+
+int64_t HttpReq::receive_time() const
+{
+    return req_data_->receive_time;
+}
+
+int64_t HttpReq::deadline() const
+{
+    return req_data_->deadline;
+}
+
+int64_t HttpReq::remaining_ms() const
+{
+    return req_data_->deadline - steady_ms();
+}
+
+void HttpReq::mark_received()
+{
+    req_data_->receive_time = steady_ms();
+}
+
+void HttpReq::set_budget(int64_t budget_ms)
+{
+    if (req_data_->receive_time == 0)
+        this->mark_received();
+    int64_t deadline = req_data_->receive_time + budget_ms;
+    if (req_data_->deadline == 0 || deadline < req_data_->deadline)
+        req_data_->deadline = deadline;
+}
+
 Json &HttpReq::json() const
 {
     if (content_type_ == APPLICATION_JSON && req_data_->json.empty())
     {
-        const std::string &body_content = this->body();
-        if (!Json::accept(body_content))
+        StringPiece body_content = this->body_view();
+        if (!Json::accept(body_content.begin(), body_content.end()))
         {
             return req_data_->json;
             // todo : how to let user know the error ?
         }
-        req_data_->json = Json::parse(body_content);
+        req_data_->json = Json::parse(body_content.begin(), body_content.end());
     }
     return req_data_->json;
 }
@@ -447,16 +606,9 @@ void HttpReq::fill_content_type()
     if (content_type_ == MULTIPART_FORM_DATA)
     {
         // if type is multipart form, we reserve the boudary first
-        const char *boundary = strstr(content_type_str.c_str(), "boundary=");
-        if (boundary == nullptr)
-        {
-            return;
-        }
-        boundary += strlen("boundary=");
-        StringPiece boundary_piece(boundary);
-
-        StringPiece boundary_str = StrUtil::trim_pairs(boundary_piece, R"(""'')");
-        multi_part_.set_boundary(boundary_str.as_string());
+        std::string boundary = multipart_boundary(content_type_str);
+        if (!boundary.empty())
+            multi_part_.set_boundary(std::move(boundary));
     }
 }
 
@@ -517,6 +669,86 @@ const std::string &HttpReq::cookie(const std::string &key) const
     return string_not_found;
 }
 
+void HttpReq::set_upload_options(const UploadOptions *options)
+{
+    req_data_->upload_options = options;
+    req_data_->size_limit = this->get_size_limit();
+    if (options->max_size > req_data_->size_limit)
+        this->set_size_limit(options->max_size);
+}
+
+int HttpReq::append(const void *buf, size_t *size)
+{
+    if (req_data_->upload)
+        return req_data_->upload->append(buf, size);
+
+    int ret = HttpRequest::append(buf, size);
+    if (ret < 0 || !req_data_->upload_options)
+        return ret;
+
+    const http_parser_t *parser = this->parser;
+    if (!req_data_->upload_checked && http_parser_header_complete(this->parser))
+    {
+        req_data_->upload_checked = true;
+        if (ret == 0)
+        {
+            int upload_ret = this->start_upload();
+            if (req_data_->upload || upload_ret < 0)
+                return upload_ret;
+        }
+    }
+
+    // the parser runs with the raised limit, hold the buffered bodies to the real one
+    if (this->cur_size > req_data_->size_limit ||
+        (!parser->chunked && parser->transfer_length != (size_t)-1 &&
+         parser->header_offset + parser->transfer_length > req_data_->size_limit))
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return ret;
+}
+
+// Right after the header, with the first body bytes in the parser buffer.
+// 0 with no upload when the body is to be buffered.
+int HttpReq::start_upload()
+{
+    const UploadOptions *options = req_data_->upload_options;
+    const http_parser_t *parser = this->get_parser();
+    if (parser->chunked || parser->transfer_length == (size_t)-1 ||
+        parser->transfer_length < options->min_size)
+        return 0;
+
+    http_header_cursor_t cursor;
+    const void *value;
+    size_t value_len;
+    std::string content_type;
+    http_header_cursor_init(&cursor, parser);
+    if (http_header_cursor_find("Content-Type", strlen("Content-Type"),
+                                &value, &value_len, &cursor) == 0)
+        content_type.assign(static_cast<const char *>(value), value_len);
+    http_header_cursor_deinit(&cursor);
+
+    if (ContentType::to_enum(content_type) != MULTIPART_FORM_DATA)
+        return 0;
+    std::string boundary = multipart_boundary(content_type);
+    if (boundary.empty())
+        return 0;
+
+    if (parser->transfer_length > options->max_size)
+    {
+        XLOG_ERROR("upload of {} bytes exceeds {}", parser->transfer_length, options->max_size);
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    req_data_->upload = std::make_shared<Upload>(*options, boundary, parser->transfer_length);
+    // the rest of the body bypasses the parser buffer
+    const char *body = static_cast<const char *>(parser->msgbuf) + parser->header_offset;
+    size_t body_len = parser->msgsize - parser->header_offset;
+    return req_data_->upload->append(body, &body_len);
+}
+
 HttpReq::HttpReq(HttpReq&& other)
     : HttpRequest(std::move(other)),
     content_type_(other.content_type_),
@@ -578,122 +810,56 @@ void HttpResp::String(std::string &&str)
     this->append_output_body_nocopy(data->c_str(), data->size());
     task_of(this)->add_callback([data](HttpTask *) { delete data; });
 }
-#ifndef _WIN32
 void HttpResp::String(const MultiPartEncoder &multi_part_encoder)
 {
-    MultiPartEncoder *encoder = new MultiPartEncoder(multi_part_encoder);
-    this->String(encoder);
-} 
+    int ret = HttpFile::send_multipart(multi_part_encoder, this);
+    if (ret != StatusOK)
+        this->Error(ret);
+}
 
 void HttpResp::String(MultiPartEncoder &&multi_part_encoder)
 {
-    MultiPartEncoder *encoder = new MultiPartEncoder(std::move(multi_part_encoder));
-    this->String(encoder);
+    this->String(static_cast<const MultiPartEncoder &>(multi_part_encoder));
 }
 
-void HttpResp::String(MultiPartEncoder *encoder) 
-{   
-    const std::string &boudary = encoder->boundary();
-    this->headers["Content-Type"] = "multipart/form-data; boundary=" + boudary;
-    
-    HttpServerTask *server_task = task_of(this);
-    SeriesWork *series = series_of(server_task);
-
-    const MultiPartEncoder::FileList &file_list = encoder->files();
-    size_t file_cnt = file_list.size();
-    assert(file_cnt >= 0);
-    for(const auto &file : file_list) 
+int HttpResp::compress(const std::string * const data, std::string *compress_data)
+{
+    int status = StatusOK;
+    if (headers.find("Content-Encoding") != headers.end())
     {
-        file_cnt--;
-        if(!PathUtil::is_file(file.second))
+        const std::string &encoding = headers["Content-Encoding"];
+        if (encoding.find("gzip") != std::string::npos)
         {
-            XLOG_ERROR("[Error] Not a File : {:s}", file.second.c_str());
-            continue;
+            status = Compressor::gzip(data, compress_data);
         }
-        size_t file_size;
-        int ret = FileUtil::size(file.second, OUT &file_size);
-        if (ret != StatusOK)
+        else if (encoding.find("br") != std::string::npos)
         {
-            XLOG_ERROR( "[Error] Invalid File : {:s}", file.second.c_str());
-            continue;
+            status = Compressor::brotli(data, compress_data);
         }
-        void *buf = malloc(file_size);
-
-        WFFileIOTask *pread_task = WFTaskFactory::create_pread_task(file.second,
-                buf, file_size, 0,
-                [&file, &boudary](WFFileIOTask *pread_task) {
-                    FileIOArgs *args = pread_task->get_args();
-                    long ret = pread_task->get_retval();
-                    
-                    SeriesWork *series = series_of(pread_task);
-                    std::string *content = static_cast<std::string *>(series->get_context());
-                    if (pread_task->get_state() != WFT_STATE_SUCCESS || ret < 0)
-                    {
-                        XLOG_ERROR("Read {:s} Error\n", file.second.c_str());
-                    } else
-                    {
-                        std::string file_suffix = PathUtil::suffix(file.second);
-                        std::string file_type = ContentType::to_str_by_suffix(file_suffix);
-                        content->append("\r\n--");
-                        content->append(boudary);
-                        content->append("\r\nContent-Disposition: form-data; name=\"");
-                        content->append(file.first);
-                        content->append("\"; filename=\"");
-                        content->append(PathUtil::base(file.second));
-                        content->append("\"\r\nContent-Type: ");
-                        content->append(file_type);
-                        content->append("\r\n\r\n");
-                        content->append(static_cast<char *>(args->buf), ret);
-                    } 
-                    // last one, send the content
-                    if(pread_task->user_data) {
-                        content->append("\r\n--");
-                        content->append(boudary);
-                        content->append("--\r\n");
-                        HttpResp *resp = static_cast<HttpResp *>(pread_task->user_data);
-                        resp->append_output_body_nocopy(content->c_str(), content->size());
-                    }
-                });
-        if(file_cnt == 0)
+        else if (encoding.find("zstd") != std::string::npos)
         {
-            pread_task->user_data = this;
+            const HttpReq *req = task_of(this)->get_req();
+            const std::string &client_dict_ids = req->header(Compressor::k_zstd_dict_header);
+            unsigned int dict_id = Compressor::zstd_negotiate_dict(client_dict_ids);
+            status = Compressor::zstd(data->c_str(), data->size(), compress_data, dict_id);
+            if (status == StatusOK && dict_id != 0)
+            {
+                headers[Compressor::k_zstd_dict_header] = std::to_string(dict_id);
+            }
+            // caches must not serve a dictionary-compressed body to another client
+            if (headers["Vary"].empty())
+                headers["Vary"] = Compressor::k_zstd_dict_header;
+            else
+                headers["Vary"] += ", " + Compressor::k_zstd_dict_header;
         }
-        server_task->add_callback([buf](const HttpTask *server_task)
-                                {
-                                    free(buf);
-                                });
-        series->push_back(pread_task);
-
-    }
-    
-    std::string *content = new std::string;
-    series->set_context(content);
-    series->set_callback([encoder](const SeriesWork *series) {
-        delete encoder;
-        delete static_cast<std::string *>(series->get_context());
-    });
-
-    const MultiPartEncoder::ParamList &param_list = encoder->params();
-    for(const auto &param : param_list) {
-        content->append("\r\n--");
-        content->append(boudary);
-        content->append("\r\nContent-Disposition: form-data; name=\"");
-        content->append(param.first);
-        content->append("\"\r\n\r\n");
-        content->append(param.second);
-    } 
-}
-#endif // !_WIN32
-int HttpResp::compress(const std::string * const data, std::string *compress_data)
-{
-    int status = StatusOK;
-    if (headers.find("Content-Encoding") != headers.end())
-    {
-        if (headers["Content-Encoding"].find("gzip") != std::string::npos)
+        else
         {
-            status = Compressor::gzip(data, compress_data);
+            status = StatusCompressNotSupport;
         }
-    } else 
+        // send the raw body rather than a body that does not match the header
+        if (status != StatusOK)
+            headers.erase("Content-Encoding");
+    } else
     {
         status = StatusNoComrpess;
     }
@@ -715,6 +881,24 @@ void HttpResp::Error(int error_code, const std::string &errmsg)
     case StatusRouteNotFound:
         status_code = 404;
         break;
+    case StatusUnauthorized:
+        status_code = 401;
+        break;
+    case StatusUncompressTooLarge:
+        status_code = 413;
+        break;
+    case StatusFileRangeInvalid:
+        status_code = 416;
+        break;
+    case StatusTooManyRequests:
+        status_code = 429;
+        break;
+    case StatusDeadlineExceeded:
+        status_code = 504;
+        break;
+    case StatusAspectUndecided:
+        status_code = 500;
+        break;
     default:
         break;
     }
@@ -747,19 +931,30 @@ void HttpResp::File(const std::string &path, size_t start, size_t end)
     }
 }
 
+void HttpResp::Zip(const std::vector<std::string> &path_list, const ZipOptions &options)
+{
+    int ret = HttpFile::send_zip(path_list, options, this);
+    if(ret != StatusOK)
+    {
+        this->Error(ret);
+    }
+}
+
 void HttpResp::set_status(int status_code)
 {
     protocol::HttpUtil::set_response_status(this, status_code);
 }
 
-void HttpResp::Save(const std::string &file_dst, const std::string &content)
+void HttpResp::Save(const std::string &file_dst, const std::string &content,
+                    const SaveOptions &options)
 {
-    HttpFile::save_file(file_dst, content, this);
+    HttpFile::save_file(file_dst, content, options, this);
 }
 
-void HttpResp::Save(const std::string &file_dst, std::string &&content)
+void HttpResp::Save(const std::string &file_dst, std::string &&content,
+                    const SaveOptions &options)
 {
-    HttpFile::save_file(file_dst, std::move(content), this);
+    HttpFile::save_file(file_dst, std::move(content), options, this);
 }
 
 void HttpResp::Json(const ::Json &json)
@@ -800,28 +995,41 @@ int HttpResp::get_error() const
     return server_task->get_error();   
 }
 
+// The network task of create, made when the series reaches it for a request with
+// a deadline : the timeouts are the time left, and nothing is sent once it passed.
+template<class TASK>
+static SubTask *deadline_task(HttpResp *resp, std::function<TASK *()> &&create)
+{
+    const HttpReq *req = task_of(resp)->get_req();
+    if (!req->has_deadline())
+        return create();
+
+    return WFTaskFactory::create_dynamic_task(
+        [resp, req, create](WFDynamicTask *) -> SubTask *
+    {
+        int64_t remaining = req->remaining_ms();
+        if (remaining <= 0)
+        {
+            resp->Error(StatusDeadlineExceeded);
+            return WFTaskFactory::create_empty_task();
+        }
+        TASK *task = create();
+        int timeout = remaining > INT_MAX ? INT_MAX : static_cast<int>(remaining);
+        task->set_send_timeout(timeout);
+        task->set_receive_timeout(timeout);
+        return task;
+    });
+}
+
 void HttpResp::Http(const std::string &url, int redirect_max, size_t size_limit)
 {
     HttpServerTask *server_task = task_of(this);
-    HttpReq *server_req = server_task->get_req();
     std::string http_url = url;
 	if (strncasecmp(url.c_str(), "http://", 7) != 0 &&
 		strncasecmp(url.c_str(), "https://", 8) != 0)
 	{
 		http_url = "http://" + http_url;
 	}
-    WFHttpTask *http_task = WFTaskFactory::create_http_task(http_url, 
-                                                            redirect_max, 
-                                                            0, 
-                                                            proxy_http_callback);
-    auto *proxy_ctx = new ProxyCtx;
-    proxy_ctx->url = http_url;
-    proxy_ctx->server_task = server_task;
-    proxy_ctx->is_keep_alive = server_req->is_keep_alive();
-    http_task->user_data = proxy_ctx;
-
-    const void *body;
-	size_t len;      
 
     ParsedURI uri;
     XLOG_INFO("url:{}", http_url.c_str());
@@ -840,81 +1048,118 @@ void HttpResp::Http(const std::string &url, int redirect_max, size_t size_limit)
         route = "/";
     }
 
-	server_req->set_request_uri(route);
-	server_req->get_parsed_body(&body, &len);
-	server_req->append_output_body_nocopy(body, len);
-    // Keep parts unique to HttpReq
-    HttpRequest *server_req_cast = static_cast<HttpRequest *>(server_req);
-	*http_task->get_req() = std::move(*server_req_cast);  
-    http_task->get_resp()->set_size_limit(size_limit);
-	**server_task << http_task;
+    std::function<WFHttpTask *()> create = [server_task, http_url, route, redirect_max, size_limit]()
+    {
+        HttpReq *server_req = server_task->get_req();
+        WFHttpTask *http_task = WFTaskFactory::create_http_task(http_url, 
+                                                                redirect_max, 
+                                                                0, 
+                                                                proxy_http_callback);
+        auto *proxy_ctx = new ProxyCtx;
+        proxy_ctx->url = http_url;
+        proxy_ctx->server_task = server_task;
+        proxy_ctx->is_keep_alive = server_req->is_keep_alive();
+        http_task->user_data = proxy_ctx;
+
+        const void *body;
+        size_t len;
+        server_req->set_request_uri(route);
+        server_req->get_parsed_body(&body, &len);
+        server_req->append_output_body_nocopy(body, len);
+        // Keep parts unique to HttpReq
+        HttpRequest *server_req_cast = static_cast<HttpRequest *>(server_req);
+        *http_task->get_req() = std::move(*server_req_cast);  
+        http_task->get_resp()->set_size_limit(size_limit);
+        return http_task;
+    };
+    this->add_task(deadline_task(this, std::move(create)));
 }
 
 void HttpResp::MySQL(const std::string &url, const std::string &sql)
 {
-    WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, mysql_callback);
-    mysql_task->get_req()->set_query(sql);
-    mysql_task->user_data = this;
-    this->add_task(mysql_task);
+    std::function<WFMySQLTask *()> create = [this, url, sql]()
+    {
+        WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, mysql_callback);
+        mysql_task->get_req()->set_query(sql);
+        mysql_task->user_data = this;
+        return mysql_task;
+    };
+    this->add_task(deadline_task(this, std::move(create)));
 }
 
 void HttpResp::MySQL(const std::string &url, const std::string &sql, const MySQLJsonFunc &func)
 {
-    WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, 
-    [func](WFMySQLTask *mysql_task)
+    std::function<WFMySQLTask *()> create = [url, sql, func]()
     {
-        ::Json json = mysql_concat_json_res(mysql_task);
-        func(&json);
-    });
+        WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, 
+        [func](WFMySQLTask *mysql_task)
+        {
+            ::Json json = mysql_concat_json_res(mysql_task);
+            func(&json);
+        });
 
-    mysql_task->get_req()->set_query(sql);
-    this->add_task(mysql_task);
+        mysql_task->get_req()->set_query(sql);
+        return mysql_task;
+    };
+    this->add_task(deadline_task(this, std::move(create)));
 }
 
 void HttpResp::MySQL(const std::string &url, const std::string &sql, const MySQLFunc &func)
 {
-    WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, 
-    [func](WFMySQLTask *mysql_task)
+    std::function<WFMySQLTask *()> create = [this, url, sql, func]()
     {
-        if (mysql_task->get_state() != WFT_STATE_SUCCESS)
+        WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, 
+        [func](WFMySQLTask *mysql_task)
         {
-            std::string errmsg = WFGlobal::get_error_string(mysql_task->get_state(),
-                                                mysql_task->get_error());
-            auto *server_resp = static_cast<HttpResp *>(mysql_task->user_data);
-            server_resp->String(std::move(errmsg));
-            return;
-        }
-        MySQLResponse *mysql_resp = mysql_task->get_resp();
-        MySQLResultCursor cursor(mysql_resp);
-        func(&cursor);
-    });
-    mysql_task->get_req()->set_query(sql);
-    mysql_task->user_data = this;
-    this->add_task(mysql_task);
+            if (mysql_task->get_state() != WFT_STATE_SUCCESS)
+            {
+                std::string errmsg = WFGlobal::get_error_string(mysql_task->get_state(),
+                                                    mysql_task->get_error());
+                auto *server_resp = static_cast<HttpResp *>(mysql_task->user_data);
+                server_resp->String(std::move(errmsg));
+                return;
+            }
+            MySQLResponse *mysql_resp = mysql_task->get_resp();
+            MySQLResultCursor cursor(mysql_resp);
+            func(&cursor);
+        });
+        mysql_task->get_req()->set_query(sql);
+        mysql_task->user_data = this;
+        return mysql_task;
+    };
+    this->add_task(deadline_task(this, std::move(create)));
 }
 
 void HttpResp::Redis(const std::string &url, const std::string &command,
         const std::vector<std::string>& params)
 {
-    WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, 2, [this](WFRedisTask *redis_task) 
+    std::function<WFRedisTask *()> create = [this, url, command, params]()
     {
-        ::Json js = redis_json_res(redis_task);
-        this->Json(js);
-    });
-	redis_task->get_req()->set_request(command, params);
-    this->add_task(redis_task);
+        WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, 2, [this](WFRedisTask *redis_task) 
+        {
+            ::Json js = redis_json_res(redis_task);
+            this->Json(js);
+        });
+        redis_task->get_req()->set_request(command, params);
+        return redis_task;
+    };
+    this->add_task(deadline_task(this, std::move(create)));
 }
 
 void HttpResp::Redis(const std::string &url, const std::string &command,
         const std::vector<std::string>& params, const RedisFunc &func)
 {
-    WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, 2, [func](WFRedisTask *redis_task) 
+    std::function<WFRedisTask *()> create = [url, command, params, func]()
     {
-        ::Json js = redis_json_res(redis_task);
-        func(&js);
-    });
-	redis_task->get_req()->set_request(command, params);
-    this->add_task(redis_task);
+        WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, 2, [func](WFRedisTask *redis_task) 
+        {
+            ::Json js = redis_json_res(redis_task);
+            func(&js);
+        });
+        redis_task->get_req()->set_request(command, params);
+        return redis_task;
+    };
+    this->add_task(deadline_task(this, std::move(create)));
 }
 
 void HttpResp::add_task(SubTask *task)
@@ -923,6 +1168,35 @@ void HttpResp::add_task(SubTask *task)
     **server_task << task;
 }
 
+std::function<void ()> HttpResp::before_deadline(std::function<void ()> &&work)
+{
+    const HttpReq *req = task_of(this)->get_req();
+    if (!req->has_deadline())
+        return std::move(work);
+    return [this, req, work]()
+    {
+        if (req->expired())
+            this->Error(StatusDeadlineExceeded);
+        else
+            work();
+    };
+}
+
+std::string HttpResp::dump_header()
+{
+    // one vector per header line, the body vectors follow the empty line
+    std::vector<struct iovec> vectors(2048);
+    int cnt = this->encode(vectors.data(), static_cast<int>(vectors.size()));
+    std::string header;
+    if (cnt < 0)
+        return header;
+    size_t body_size = this->get_output_body_size();
+    for (int i = 0; i < cnt; i++)
+        header.append(static_cast<const char *>(vectors[i].iov_base), vectors[i].iov_len);
+    header.resize(header.size() - body_size);
+    return header;
+}
+
 HttpResp::HttpResp(HttpResp&& other)
     : HttpResponse(std::move(other)),
     headers(std::move(other.headers)),
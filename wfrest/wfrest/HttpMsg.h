@@ -16,6 +16,10 @@
 #include "wfrest/StrUtil.h"
 #include "wfrest/HttpCookie.h"
 #include "wfrest/Noncopyable.h"
+#include "wfrest/Upload.h"
+#include "wfrest/HttpFile.h"
+#include "wfrest/ComputePool.h"
+#include "wfrest/ErrorCode.h"
 
 namespace protocol
 {
@@ -35,15 +39,51 @@ class MySQL;
 class HttpReq : public protocol::HttpRequest, public Noncopyable
 {
 public:
+    // Content-Encoding gzip / deflate / br / zstd is removed here
     std::string &body() const;
 
+    // Same content as body(), without copying a plain (not chunked, not compressed) 
+    // body out of the parser buffer. Valid as long as the request.
+    StringPiece body_view() const;
+
     // post body
     std::map<std::string, std::string> &form_kv() const;
 
+    // For a streamed upload, the fields without a filename
     Form &form() const;
 
+    // The parts of a buffered multipart/form-data body without copying them,
+    // views into body_view(). Empty for a streamed upload.
+    const FormView &form_view() const;
+
+    // File parts of a streamed upload (HttpServer::upload_options()),
+    // in temp files or sinks. Empty when the body was buffered.
+    const std::vector<UploadFile> &files() const;
+
+    // nullptr when the body was buffered
+    Upload *upload() const;
+
     Json &json() const;
 
+    // The claims of the token let through by JwtAspect, null without one
+    const Json &claims() const;
+
+    // Steady clock ms, the time the server started to process the request
+    int64_t receive_time() const;
+
+    // Steady clock ms, 0 without a deadline. Set from HttpServer::request_budget(),
+    // the timeout header of the client and DeadlineAspect : the earliest wins.
+    int64_t deadline() const;
+
+    bool has_deadline() const
+    { return this->deadline() != 0; }
+
+    // ms before the deadline, <= 0 once passed. Only meaningful with a deadline.
+    int64_t remaining_ms() const;
+
+    bool expired() const
+    { return this->has_deadline() && this->remaining_ms() <= 0; }
+
     http_content_type content_type() const
     { return content_type_; }
 
@@ -84,6 +124,11 @@ public:
 public:
     void fill_content_type();
 
+    // Decode the body once, limited by the request size limit.
+    // return StatusUncompressTooLarge (the body is left empty) or 
+    // StatusUncompressError (the raw body is kept) when it can not be decoded
+    int decode_body() const;
+
     void fill_header_map();
 
     // /{name}/{id} params in route
@@ -107,6 +152,25 @@ public:
     void set_parsed_uri(ParsedURI &&parsed_uri)
     { parsed_uri_ = std::move(parsed_uri); }
 
+    // Multipart bodies matching the options are streamed instead of buffered.
+    // The request size limit is raised to options->max_size for the parser,
+    // and applied by append() to every other body.
+    void set_upload_options(const UploadOptions *options);
+
+    void set_claims(std::shared_ptr<const Json> claims);
+
+    // receive_time() is now
+    void mark_received();
+
+    // the deadline is at most budget_ms after receive_time()
+    void set_budget(int64_t budget_ms);
+
+protected:
+    int append(const void *buf, size_t *size) override;
+
+private:
+    int start_upload();
+
 public:
     HttpReq();
 
@@ -180,6 +244,7 @@ public:
 
     void String(std::string &&str);
 
+    // multipart/form-data of the params and files, streamed with a Content-Length
     void String(MultiPartEncoder &&encoder);
 
     void String(const MultiPartEncoder &encoder);
@@ -191,10 +256,15 @@ public:
 
     void File(const std::string &path, size_t start, size_t end);
 
-    // save file
-    void Save(const std::string &file_dst, const std::string &content);
+    // zip archive of files, streamed
+    void Zip(const std::vector<std::string> &path_list, const ZipOptions &options = ZipOptions());
+
+    // save file, atomically by default. Pass std::move(req->body()) to save without a copy.
+    void Save(const std::string &file_dst, const std::string &content,
+              const SaveOptions &options = SaveOptions());
 
-    void Save(const std::string &file_dst, std::string &&content);
+    void Save(const std::string &file_dst, std::string &&content,
+              const SaveOptions &options = SaveOptions());
 
     // json
     void Json(const Json &json);
@@ -243,14 +313,17 @@ public:
     void Redis(const std::string &url, const std::string &command,
             const std::vector<std::string>& params, const RedisFunc &func);
 
+    // On ComputePool::get(compute_queue_id), a full pool answers 503.
+    // func is skipped with a 504 if the request expired while it was waiting.
     template<class FUNC, class... ARGS>
     void Compute(int compute_queue_id, FUNC&& func, ARGS&&... args)
     {
-        WFGoTask *go_task = WFTaskFactory::create_go_task(
-                "wfrest" + std::to_string(compute_queue_id),
-                std::forward<FUNC>(func),
-                std::forward<ARGS>(args)...);
-        this->add_task(go_task);
+        WFGoTask *go_task = ComputePool::get(compute_queue_id)->create_go_task(this->before_deadline(
+                std::bind(std::forward<FUNC>(func), std::forward<ARGS>(args)...)));
+        if (go_task)
+            this->add_task(go_task);
+        else
+            this->Error(StatusComputeQueueFull);
     }
 
     void Error(int error_code);
@@ -259,11 +332,15 @@ public:
 
     void add_task(SubTask *task);
 
+    // work, unless the deadline of the request has passed when it runs : then a 504
+    std::function<void ()> before_deadline(std::function<void ()> &&work);
+
+    // status line and headers as they go on the wire, the output body is not included
+    std::string dump_header();
+
 private:
     int compress(const std::string * const data, std::string *compress_data);
 
-    void String(MultiPartEncoder *encoder);
-
 public:
     HttpResp() = default;
 
@@ -1,4 +1,4 @@
-#include "workflow/HttpMessage.h"
+﻿#include "workflow/HttpMessage.h"
 
 #include <utility>
 
@@ -23,8 +23,12 @@ void HttpServer::process(HttpTask *task)
     auto *req = server_task->get_req();
     auto *resp = server_task->get_resp();
     long long seq = server_task->get_task_seq();
+    if (concurrency_limiter_ && !concurrency_limiter_->admit(server_task))
+        return;
+    req->mark_received();
     req->fill_header_map();
     req->fill_content_type();
+    this->set_deadline(req);
 	char addrstr[128];
 	struct sockaddr_storage addr;
 	socklen_t l = sizeof addr;
@@ -122,10 +126,138 @@ void HttpServer::process(HttpTask *task)
     req->set_parsed_uri(std::move(uri));
 	std::string verb = req->get_method();
 	XLOG_INFO("method:{:s},url:{:s}", verb, route);
+
+    // A streamed upload is routed once its last file blocks are on disk
+    if (Upload *upload = req->upload())
+    {
+        WFCounterTask *counter = WFTaskFactory::create_counter_task(1,
+            [this, server_task, verb, route](WFCounterTask *)
+        {
+            int status = server_task->get_req()->upload()->status();
+            if (status != StatusOK)
+                server_task->get_resp()->Error(status);
+            else
+                this->dispatch(server_task, verb, route);
+        });
+        upload->wait(counter);
+        **server_task << counter;
+        return;
+    }
+
+    // Decode compressed bodies before routing, so that a body over the size limit
+    // is refused here. Large ones are decoded on a compute queue instead of the
+    // handler thread, and routing continues in the callback.
+    const void *body;
+    size_t body_len;
+    if (!req->header("Content-Encoding").empty() && req->get_parsed_body(&body, &body_len))
+    {
+        if (body_len >= uncompress_offload_size_)
+        {
+            WFGoTask *go_task = WFTaskFactory::create_go_task("wfrest_uncompress", 
+                                                            &HttpReq::decode_body, req);
+            go_task->set_callback([this, server_task, verb, route](WFGoTask *)
+            {
+                if (server_task->get_req()->decode_body() == StatusUncompressTooLarge)
+                    server_task->get_resp()->Error(StatusUncompressTooLarge);
+                else
+                    this->dispatch(server_task, verb, route);
+            });
+            **server_task << go_task;
+            return;
+        }
+        if (req->decode_body() == StatusUncompressTooLarge)
+        {
+            resp->Error(StatusUncompressTooLarge);
+            return;
+        }
+    }
+    this->dispatch(server_task, verb, route);
+}
+
+void HttpServer::dispatch(HttpServerTask *server_task, const std::string &verb, const std::string &route)
+{
+    if (async_aspects_.empty())
+    {
+        this->call_route(server_task, verb, route);
+        return;
+    }
+    // one gate walks the request through the async aspects
+    auto *gate = new AspectGate(this, server_task, verb, route);
+    server_task->set_gate(gate);
+    this->next_async_aspect(gate);
+}
+
+void HttpServer::next_async_aspect(AspectGate *gate)
+{
+    if (gate->index_ == async_aspects_.size())
+    {
+        gate->closed_ = true;
+        this->call_route(gate->server_task_, gate->verb_, gate->route_);
+        return;
+    }
+    HttpServerTask *server_task = gate->server_task_;
+    async_aspects_[gate->index_]->before(server_task->get_req(), server_task->get_resp(),
+                                         series_of(server_task), gate);
+}
+
+void AspectGate::pass()
+{
+    if (closed_)
+        return;
+    index_++;
+    server_->next_async_aspect(this);
+}
+
+void AspectGate::stop()
+{
+    if (closed_)
+        return;
+    closed_ = true;
+    if (server_->track_func_)
+        server_task_->add_callback(server_->track_func_);
+}
+
+void AspectGate::fail()
+{
+    closed_ = true;
+    XLOG_ERROR("async aspect {} did not decide on {} {}", index_, verb_, route_);
+    // whatever the aspect had written is not sent
+    HttpResp *resp = server_task_->get_resp();
+    resp->clear_output_body();
+    resp->Error(StatusAspectUndecided);
+    if (server_->track_func_)
+        server_task_->add_callback(server_->track_func_);
+}
+
+void HttpServer::set_deadline(HttpReq *req)
+{
+    if (request_budget_ > 0)
+        req->set_budget(request_budget_);
+    if (timeout_header_.empty())
+        return;
+    const std::string &timeout = req->header(timeout_header_);
+    if (timeout.empty())
+        return;
+    char *end;
+    long long budget = strtoll(timeout.c_str(), &end, 10);
+    if (*end == '\0' && budget > 0)
+        req->set_budget(budget);
+}
+
+void HttpServer::call_route(HttpServerTask *server_task, const std::string &verb, const std::string &route)
+{
+    // waited too long for the body, the uncompress queue or the async aspects
+    if (server_task->get_req()->expired())
+    {
+        server_task->get_resp()->Error(StatusDeadlineExceeded);
+        if (track_func_)
+            server_task->add_callback(track_func_);
+        return;
+    }
     int ret = blue_print_.router().call(str_to_verb(verb), route, server_task);//查找请求是否已注册
     if(ret != StatusOK)
     {
-        resp->Error(ret, verb + " " + route);
+        server_task->get_resp()->Error(ret, verb + " " + route);
     }
     if(track_func_)
     {
@@ -135,10 +267,13 @@ void HttpServer::process(HttpTask *task)
 
 CommSession *HttpServer::new_session(long long seq, CommConnection *conn)
 {
-    HttpTask *task = new HttpServerTask(this, this->WFServer<HttpReq, HttpResp>::process);
+    auto *task = new HttpServerTask(this, this->WFServer<HttpReq, HttpResp>::process);
+    task->set_ssl(this->get_ssl_ctx() != nullptr);
     task->set_keep_alive(this->params.keep_alive_timeout);
     task->set_receive_timeout(this->params.receive_timeout);
     task->get_req()->set_size_limit(this->params.request_size_limit);
+    if (stream_uploads_)
+        task->get_req()->set_upload_options(&upload_options_);
 
     return task;
 }
@@ -155,9 +290,14 @@ void HttpServer::register_blueprint(const BluePrint& bp, const std::string& url_
 
 // /static : /www/file/
 void HttpServer::Static(const char *relative_path, const char *root)
+{
+    this->Static(relative_path, root, StaticOptions());
+}
+
+void HttpServer::Static(const char *relative_path, const char *root, const StaticOptions &options)
 {
     BluePrint bp;
-    int ret = serve_static(root, OUT bp);
+    int ret = serve_static(root, options, OUT bp);
     if(ret != StatusOK)
     {
         XLOG_ERROR("Error:{} dose not exists",root);
@@ -166,7 +306,7 @@ void HttpServer::Static(const char *relative_path, const char *root)
     blue_print_.add_blueprint(std::move(bp), relative_path);
 }
 
-int HttpServer::serve_static(const char* path, OUT BluePrint &bp)
+int HttpServer::serve_static(const char* path, const StaticOptions &options, OUT BluePrint &bp)
 {
     std::string path_str(path);
     bool is_file = true;
@@ -177,14 +317,24 @@ int HttpServer::serve_static(const char* path, OUT BluePrint &bp)
     {
         return StatusNotFound;
     }    
-    bp.GET("/*", [path_str, is_file](const HttpReq *req, HttpResp *resp) {
-        std::string match_path = req->match_path();
+    StaticCache *cache = &static_cache_;
+    OpenFileCache *files = &open_file_cache_;
+    bp.GET("/*", [path_str, is_file, options, cache, files](const HttpReq *req, HttpResp *resp) {
+        const std::string &match_path = req->match_path();
+        int ret;
         if(is_file && match_path.empty())
         {
-            resp->File(path_str);
+            ret = HttpFile::send_static(path_str, options, cache, files, req, resp);
         } else 
         {
-            resp->File(path_str + "/" + match_path);
+            std::string file_path;
+            file_path.reserve(path_str.size() + 1 + match_path.size());
+            file_path.append(path_str).append("/").append(match_path);
+            ret = HttpFile::send_static(file_path, options, cache, files, req, resp);
+        }
+        if(ret != StatusOK)
+        {
+            resp->Error(ret);
         }
     });
     return StatusOK;
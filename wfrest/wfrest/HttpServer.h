@@ -8,7 +8,11 @@
 #include <string>
 
 #include "wfrest/HttpMsg.h"
+#include "wfrest/HttpFile.h"
+#include "wfrest/StaticCache.h"
+#include "wfrest/OpenFileCache.h"
 #include "wfrest/BluePrint.h"
+#include "wfrest/ConcurrencyLimiter.h"
 
 namespace wfrest
 {
@@ -400,6 +404,8 @@ public:
 public:
     void Static(const char *relative_path, const char *root);
 
+    void Static(const char *relative_path, const char *root, const StaticOptions &options);
+
     void list_routes();
 
     void register_blueprint(const BluePrint &bp, const std::string &url_prefix);
@@ -407,8 +413,15 @@ public:
     template <typename... AP>
     void Use(AP &&...ap)
     {
-        auto *tp = new std::tuple<AP...>(std::move(ap)...);
-        for_each(*tp, GlobalAspectFunc());
+        // the aspects are moved to the heap one by one, owned by GlobalAspect
+        std::tuple<AP...> tp(std::forward<AP>(ap)...);
+        for_each(tp, GlobalAspectFunc());
+    }
+
+    // An AsyncAspect run before every route, in the order of the calls. The server owns it.
+    void UseAsync(AsyncAspect *aspect)
+    {
+        async_aspects_.emplace_back(aspect);
     }
     void SetServerName(const std::string& name)
     {
@@ -476,6 +489,112 @@ public:
 			return this->params.request_size_limit;
 		}
 
+		// Compressed request bodies at least this large are decoded 
+		// on the "wfrest_uncompress" compute queue before routing
+		HttpServer& uncompress_offload_size(size_t uncompress_offload_size)
+		{
+			this->uncompress_offload_size_ = uncompress_offload_size;
+			return *this;
+		}
+
+		size_t get_uncompress_offload_size()const
+		{
+			return this->uncompress_offload_size_;
+		}
+
+		// Small files served by Static() are kept in memory, 
+		// tune with static_cache().set_max_file_size() ..., capacity 0 disables it
+		HttpServer& static_cache_capacity(size_t capacity)
+		{
+			this->static_cache_.set_capacity(capacity);
+			return *this;
+		}
+
+		StaticCache& static_cache()
+		{
+			return this->static_cache_;
+		}
+
+		// hit ratio and memory of the static file cache
+		StaticCacheStats get_static_cache_stats()const
+		{
+			return this->static_cache_.stats();
+		}
+
+		// Open fds and stat results of the files served by Static(), 
+		// tune with open_file_cache().set_valid_time() ..., max_size 0 disables it
+		HttpServer& open_file_cache_size(size_t max_size)
+		{
+			this->open_file_cache_.set_max_size(max_size);
+			return *this;
+		}
+
+		OpenFileCache& open_file_cache()
+		{
+			return this->open_file_cache_;
+		}
+
+		OpenFileCacheStats get_open_file_cache_stats()const
+		{
+			return this->open_file_cache_.stats();
+		}
+
+		// multipart/form-data bodies of at least options.min_size are parsed as they arrive,
+		// file parts go to temp files (or options.sink) : req->files(), fields : req->form().
+		// Such requests are limited by options.max_size instead of the request size limit.
+		HttpServer& upload_options(const UploadOptions& options)
+		{
+			this->upload_options_ = options;
+			this->stream_uploads_ = true;
+			return *this;
+		}
+
+		const UploadOptions& get_upload_options()const
+		{
+			return this->upload_options_;
+		}
+
+		// Every request gets a deadline budget_ms after it is received, 0 for none.
+		// A client sends a shorter one in ms with the timeout header, "" ignores it.
+		// Routes, compute handlers and Compute(), MySQL(), Redis(), Http() not started 
+		// by then answer 504, the backend timeouts are the time left : see HttpReq::deadline().
+		HttpServer& request_budget(int budget_ms)
+		{
+			this->request_budget_ = budget_ms;
+			return *this;
+		}
+
+		int get_request_budget()const
+		{
+			return this->request_budget_;
+		}
+
+		HttpServer& request_timeout_header(const std::string& name)
+		{
+			this->timeout_header_ = name;
+			return *this;
+		}
+
+		const std::string& get_request_timeout_header()const
+		{
+			return this->timeout_header_;
+		}
+
+		// Requests in flight over the limit are answered a prerendered 503 before anything
+		// else is done for them, the limit follows the latency : see ConcurrencyLimiter.
+		// Routes have their own with ConcurrencyLimitAspect.
+		HttpServer& concurrency_limit(const ConcurrencyLimitOptions& options)
+		{
+			this->concurrency_limiter_.reset(new ConcurrencyLimiter(options));
+			return *this;
+		}
+
+		// nullptr without concurrency_limit()
+		ConcurrencyLimiter* get_concurrency_limiter()const
+		{
+			return this->concurrency_limiter_.get();
+		}
+
 		HttpServer& ssl_accept_timeout(int ssl_accept_timeout)
 		{
 			this->params.ssl_accept_timeout = ssl_accept_timeout;
@@ -501,7 +620,16 @@ public:
 	private:
 		void process(HttpTask* task);
 
-		int serve_static(const char* path, OUT BluePrint& bp);
+		void dispatch(HttpServerTask* server_task, const std::string& verb, const std::string& route);
+
+		void call_route(HttpServerTask* server_task, const std::string& verb, const std::string& route);
+
+		void set_deadline(HttpReq* req);
+
+		// the async aspect of gate, or the route once they all passed
+		void next_async_aspect(AspectGate* gate);
+
+		int serve_static(const char* path, const StaticOptions& options, OUT BluePrint& bp);
 
 		struct GlobalAspectFunc
 		{
@@ -518,6 +646,17 @@ public:
 		BluePrint blue_print_;
 		TrackFunc track_func_;
 		std::string serverName;
+		size_t uncompress_offload_size_ = 64 * 1024;
+		StaticCache static_cache_;
+		OpenFileCache open_file_cache_;
+		bool stream_uploads_ = false;
+		UploadOptions upload_options_;
+		std::vector<std::unique_ptr<AsyncAspect>> async_aspects_;
+		int request_budget_ = 0;
+		std::string timeout_header_ = "X-Request-Timeout";
+		std::unique_ptr<ConcurrencyLimiter> concurrency_limiter_;
+
+		friend class AspectGate;
 	};
 
 }  // namespace wfrest
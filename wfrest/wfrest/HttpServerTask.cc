@@ -23,6 +23,8 @@ HttpServerTask::HttpServerTask(CommService *service,
         {
             cb(task);
         }
+        if (aspects_)
+            aspects_->after(task->get_req(), task->get_resp());
     });
 }
 
@@ -50,6 +52,22 @@ void HttpServerTask::handle(int state, int error)
 }
 
 CommMessageOut *HttpServerTask::message_out()
+{
+    // the series is over, an async aspect left undecided refuses the request
+    if (gate_ && !gate_->closed_)
+        gate_->fail();
+    this->fill_resp_header();
+    return this->WFServerTask::message_out();
+}
+
+std::string HttpServerTask::detach_resp_header()
+{
+    this->fill_resp_header();
+    this->noreply();
+    return this->get_resp()->dump_header();
+}
+
+void HttpServerTask::fill_resp_header()
 {
     HttpResp *resp = this->get_resp();
    
@@ -80,7 +98,7 @@ CommMessageOut *HttpServerTask::message_out()
     }
     if(headers.find("Date") == headers.end())
     {
-        headers["Date"] = Timestamp::now().to_format_str("%a, %d %b %Y %H:%M:%S GMT");
+        headers["Date"] = Timestamp::now().to_http_date();
     }
     struct HttpMessageHeader header;
 
@@ -120,7 +138,9 @@ CommMessageOut *HttpServerTask::message_out()
         HttpUtil::set_response_status(resp, status_code);
     }
     
-    if (!resp->is_chunked() && !resp->has_content_length_header())
+    // a body pushed after detach_resp_header() may be chunked by its sender
+    if (!resp->is_chunked() && !resp->has_content_length_header() &&
+        headers.find("Transfer-Encoding") == headers.end())
     {
         char buf[32];
         header.name = "Content-Length";
@@ -202,7 +222,6 @@ CommMessageOut *HttpServerTask::message_out()
 
         resp->add_header(&header);
     }
-    return this->WFServerTask::message_out();
 }
 
 std::string HttpServerTask::get_peer_addr_str()
@@ -2,6 +2,7 @@
 #define WFREST_HTTPSERVERTASK_H_
 
 #include "wfrest/HttpMsg.h"
+#include "wfrest/Aspect.h"
 #include "wfrest/Noncopyable.h"
 
 namespace wfrest
@@ -24,6 +25,21 @@ public:
     void add_callback(ServerCallBack &&cb)
     { cb_list_.emplace_back(std::move(cb)); }
 
+    // after() of the route's aspects when the task is done, following the callbacks
+    void set_aspects(const AspectChain *aspects)
+    { aspects_ = aspects; }
+
+    // The gate of the async aspects, owned by the task from now on
+    void set_gate(AspectGate *gate)
+    { gate_.reset(gate); }
+
+    // TLS connection : the output body is read by SSL_write() in user space
+    bool is_ssl() const
+    { return ssl_; }
+
+    void set_ssl(bool ssl)
+    { ssl_ = ssl; }
+
     static size_t get_resp_offset()
     {
         HttpServerTask task(nullptr);
@@ -31,6 +47,10 @@ public:
     }
 
     std::string get_peer_addr_str();
+
+    // For a body written by the caller with push() : 
+    // serialize the status line and headers, the framework will not reply any more
+    std::string detach_resp_header();
     
 protected:
     void handle(int state, int error) override;
@@ -39,6 +59,8 @@ protected:
 
 
 private:
+    void fill_resp_header();
+
     // for hidning set_callback
     void set_callback()
     {}
@@ -58,6 +80,9 @@ private:
     bool req_has_keep_alive_header_;
     std::string req_keep_alive_;
     std::vector<ServerCallBack> cb_list_;
+    const AspectChain *aspects_ = nullptr;
+    std::unique_ptr<AspectGate> gate_;
+    bool ssl_ = false;
 };
 
 inline HttpServerTask *task_of(const SubTask *task)
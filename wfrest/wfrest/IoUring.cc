@@ -0,0 +1,372 @@
+﻿#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "wfrest/IoUring.h"
+#include "XLogger.h"
+
+#if !defined(OS_WINDOWS) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define WFREST_IO_URING
+#endif
+#endif
+#endif
+
+using namespace wfrest;
+
+#ifdef WFREST_IO_URING
+
+namespace
+{
+
+int sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int sys_io_uring_register(int ring_fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+unsigned load_acquire(const unsigned *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned *p, unsigned v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// user_data of the NOP that stops the reaper
+const __u64 k_stop = 0;
+
+}  // namespace
+
+bool IoUring::supported()
+{
+    return true;
+}
+
+int IoUring::init(unsigned entries, size_t fixed_buffers, size_t fixed_buffer_size)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof params);
+    ring_fd_ = sys_io_uring_setup(entries, &params);
+    if (ring_fd_ < 0)
+        return -1;
+
+    entries_ = params.sq_entries;
+    sq_len_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_len_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+
+    sq_ptr_ = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+        goto fail;
+    if (single_mmap)
+        cq_ptr_ = sq_ptr_;
+    else
+    {
+        cq_ptr_ = mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED)
+            goto fail;
+    }
+    sqes_len_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ring_fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED)
+        goto fail;
+
+    {
+        char *sq = static_cast<char *>(sq_ptr_);
+        char *cq = static_cast<char *>(cq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = cq + params.cq_off.cqes;
+    }
+
+    if (fixed_buffers > 0 && fixed_buffer_size > 0)
+    {
+        void *pool = nullptr;
+        if (posix_memalign(&pool, 4096, fixed_buffers * fixed_buffer_size) == 0)
+        {
+            std::vector<struct iovec> iovs(fixed_buffers);
+            for (size_t i = 0; i < fixed_buffers; i++)
+            {
+                iovs[i].iov_base = static_cast<char *>(pool) + i * fixed_buffer_size;
+                iovs[i].iov_len = fixed_buffer_size;
+            }
+            if (sys_io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS, iovs.data(), fixed_buffers) == 0)
+            {
+                fixed_pool_ = static_cast<char *>(pool);
+                fixed_size_ = fixed_buffer_size;
+                fixed_count_ = fixed_buffers;
+                for (size_t i = 0; i < fixed_buffers; i++)
+                    fixed_free_.push_back(static_cast<int>(i));
+            }
+            else
+            {
+                XLOG_ERROR("io_uring buffer registration failed, errno {}, reading without them", errno);
+                free(pool);
+            }
+        }
+    }
+
+    reaper_ = std::thread(&IoUring::reap, this);
+    return 0;
+
+fail:
+    int error = errno;
+    if (sqes_ && sqes_ != MAP_FAILED)
+        munmap(sqes_, sqes_len_);
+    if (cq_ptr_ && cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_)
+        munmap(cq_ptr_, cq_len_);
+    if (sq_ptr_ && sq_ptr_ != MAP_FAILED)
+        munmap(sq_ptr_, sq_len_);
+    sq_ptr_ = cq_ptr_ = sqes_ = nullptr;
+    close(ring_fd_);
+    ring_fd_ = -1;
+    errno = error;
+    return -1;
+}
+
+int IoUring::submit(Request *req)
+{
+    if (ring_fd_ < 0)
+        return -1;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    unsigned tail = *sq_tail_;
+    // the completion ring is twice as large, it can not overflow either
+    if (inflight_ >= entries_ || tail - load_acquire(sq_head_) >= entries_)
+        return -1;
+
+    unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + index;
+    memset(sqe, 0, sizeof *sqe);
+    sqe->fd = req->fd;
+    sqe->off = req->offset;
+    sqe->user_data = reinterpret_cast<__u64>(req);
+    int buf_index = fixed_index(req->buf, req->count);
+    if (buf_index >= 0)
+    {
+        sqe->opcode = req->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->addr = reinterpret_cast<__u64>(req->buf);
+        sqe->len = req->count;
+        sqe->buf_index = buf_index;
+    }
+    else
+    {
+        // READV exists since the first io_uring kernel, READ only since 5.6
+        req->iov.iov_base = req->buf;
+        req->iov.iov_len = req->count;
+        sqe->opcode = req->write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->addr = reinterpret_cast<__u64>(&req->iov);
+        sqe->len = 1;
+    }
+    sq_array_[index] = index;
+    store_release(sq_tail_, tail + 1);
+    pending_++;
+    inflight_++;
+
+    // Whoever finds no flush in progress submits for everyone,
+    // requests queued meanwhile go with its next io_uring_enter().
+    if (flushing_)
+        return 0;
+    flushing_ = true;
+    while (pending_ > 0)
+    {
+        unsigned to_submit = pending_;
+        pending_ = 0;
+        lock.unlock();
+        int ret = sys_io_uring_enter(ring_fd_, to_submit, 0, 0);
+        lock.lock();
+        if (ret < 0)
+        {
+            // EAGAIN / EBUSY : the entries stay in the ring, the next submit retries them
+            if (errno != EINTR)
+                XLOG_ERROR("io_uring_enter failed, errno {}", errno);
+            pending_ += to_submit;
+            break;
+        }
+        if (static_cast<unsigned>(ret) < to_submit)
+            pending_ += to_submit - ret;
+    }
+    flushing_ = false;
+    return 0;
+}
+
+void IoUring::reap()
+{
+    bool stopping = false;
+    std::vector<std::pair<Request *, long>> done;
+    while (true)
+    {
+        if (sys_io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            XLOG_ERROR("io_uring wait failed, errno {}", errno);
+            usleep(1000);
+        }
+
+        unsigned head = *cq_head_;
+        unsigned tail = load_acquire(cq_tail_);
+        for (; head != tail; head++)
+        {
+            auto *cqe = static_cast<struct io_uring_cqe *>(cqes_) + (head & *cq_mask_);
+            if (cqe->user_data == k_stop)
+                stopping = true;
+            else
+                done.emplace_back(reinterpret_cast<Request *>(cqe->user_data), cqe->res);
+        }
+        store_release(cq_head_, head);
+
+        if (!done.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                inflight_ -= done.size();
+            }
+            for (auto &req_res : done)
+                req_res.first->callback(req_res.first, req_res.second);
+            done.clear();
+        }
+
+        if (stopping)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (inflight_ == 0)
+                break;
+        }
+    }
+}
+
+int IoUring::fixed_index(const void *buf, size_t count) const
+{
+    const char *p = static_cast<const char *>(buf);
+    if (!fixed_pool_ || p < fixed_pool_ || p >= fixed_pool_ + fixed_count_ * fixed_size_)
+        return -1;
+    size_t index = (p - fixed_pool_) / fixed_size_;
+    if (p + count > fixed_pool_ + (index + 1) * fixed_size_)
+        return -1;
+    return static_cast<int>(index);
+}
+
+void *IoUring::alloc_buffer(size_t size)
+{
+    if (fixed_pool_ && size <= fixed_size_)
+    {
+        std::lock_guard<std::mutex> lock(fixed_mutex_);
+        if (!fixed_free_.empty())
+        {
+            int index = fixed_free_.back();
+            fixed_free_.pop_back();
+            return fixed_pool_ + index * fixed_size_;
+        }
+    }
+    return malloc(size);
+}
+
+void IoUring::free_buffer(void *buf)
+{
+    int index = fixed_index(buf, 0);
+    if (index < 0)
+    {
+        free(buf);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(fixed_mutex_);
+    fixed_free_.push_back(index);
+}
+
+IoUring::~IoUring()
+{
+    if (ring_fd_ < 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & *sq_mask_;
+        struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + index;
+        memset(sqe, 0, sizeof *sqe);
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = k_stop;
+        sq_array_[index] = index;
+        store_release(sq_tail_, tail + 1);
+        sys_io_uring_enter(ring_fd_, pending_ + 1, 0, 0);
+        pending_ = 0;
+    }
+    reaper_.join();
+
+    munmap(sqes_, sqes_len_);
+    if (cq_ptr_ != sq_ptr_)
+        munmap(cq_ptr_, cq_len_);
+    munmap(sq_ptr_, sq_len_);
+    close(ring_fd_);
+    free(fixed_pool_);
+}
+
+#else
+
+bool IoUring::supported()
+{
+    return false;
+}
+
+int IoUring::init(unsigned, size_t, size_t)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int IoUring::submit(Request *)
+{
+    return -1;
+}
+
+void IoUring::reap()
+{
+}
+
+int IoUring::fixed_index(const void *, size_t) const
+{
+    return -1;
+}
+
+void *IoUring::alloc_buffer(size_t size)
+{
+    return malloc(size);
+}
+
+void IoUring::free_buffer(void *buf)
+{
+    free(buf);
+}
+
+IoUring::~IoUring()
+{
+}
+
+#endif  // WFREST_IO_URING
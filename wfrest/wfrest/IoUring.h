@@ -0,0 +1,104 @@
+﻿#ifndef WFREST_IOURING_H_
+#define WFREST_IOURING_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifndef OS_WINDOWS
+#include <sys/uio.h>
+#endif
+
+#include "wfrest/Noncopyable.h"
+
+namespace wfrest
+{
+
+// A minimal io_uring for file reads and writes, on the raw system calls (no liburing).
+// Submissions from concurrent threads are batched into one io_uring_enter(),
+// completions are reaped by one thread.
+// Buffers handed out by alloc_buffer() are registered with the kernel and read
+// into with READ_FIXED, without pinning the pages on every request.
+// Thread safety: YES
+class IoUring : public Noncopyable
+{
+public:
+    struct Request
+    {
+        bool write;
+        int fd;
+        void *buf;
+        size_t count;
+        long long offset;
+        // on the completion thread, res is the byte count or -errno
+        void (*callback)(Request *req, long res);
+        void *context;
+#ifndef OS_WINDOWS
+        struct iovec iov;
+#endif
+    };
+
+    // built with <linux/io_uring.h>, the kernel may still refuse it
+    static bool supported();
+
+    // 0, or -1 with errno : ENOSYS on old kernels, EPERM when a seccomp filter blocks it ...
+    // Registering the fixed buffers may fail under RLIMIT_MEMLOCK, the ring works without them.
+    int init(unsigned entries, size_t fixed_buffers, size_t fixed_buffer_size);
+
+    // 0, or -1 when the ring is full or not running, do the I/O another way
+    int submit(Request *req);
+
+    // from the registered pool when size fits and one is free, malloc() otherwise
+    void *alloc_buffer(size_t size);
+
+    void free_buffer(void *buf);
+
+    size_t fixed_buffer_size() const
+    { return fixed_size_; }
+
+    ~IoUring();
+
+private:
+    void reap();
+
+    // the index of a registered buffer holding [buf, buf + count), -1 if none
+    int fixed_index(const void *buf, size_t count) const;
+
+private:
+    int ring_fd_ = -1;
+    unsigned entries_ = 0;
+
+    // rings shared with the kernel
+    void *sq_ptr_ = nullptr;
+    void *cq_ptr_ = nullptr;
+    void *sqes_ = nullptr;
+    size_t sq_len_ = 0;
+    size_t cq_len_ = 0;
+    size_t sqes_len_ = 0;
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_mask_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned *cq_mask_ = nullptr;
+    void *cqes_ = nullptr;
+
+    std::mutex mutex_;
+    // queued in the ring, not yet passed to io_uring_enter()
+    unsigned pending_ = 0;
+    bool flushing_ = false;
+    unsigned inflight_ = 0;
+    std::thread reaper_;
+
+    char *fixed_pool_ = nullptr;
+    size_t fixed_size_ = 0;
+    size_t fixed_count_ = 0;
+    std::mutex fixed_mutex_;
+    std::vector<int> fixed_free_;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_IOURING_H_
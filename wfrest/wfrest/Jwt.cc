@@ -0,0 +1,371 @@
+﻿#include <openssl/bio.h>
+#include <openssl/crypto.h>
+#include <openssl/ecdsa.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+#include <string.h>
+#include <time.h>
+
+#include "wfrest/Jwt.h"
+#include "wfrest/ErrorCode.h"
+#include "wfrest/json.hpp"
+#include "XLogger.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+enum
+{
+    k_hs256 = 1,
+    k_rs256,
+    k_es256,
+};
+
+int alg_code(const std::string &alg)
+{
+    if (alg == "HS256")
+        return k_hs256;
+    if (alg == "RS256")
+        return k_rs256;
+    if (alg == "ES256")
+        return k_es256;
+    return 0;
+}
+
+int base64url_value(unsigned char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '-')
+        return 62;
+    if (c == '_')
+        return 63;
+    return -1;
+}
+
+// unpadded, as in a JWS
+bool base64url_decode(const StringPiece &in, std::string *out)
+{
+    if (in.size() % 4 == 1)
+        return false;
+    out->clear();
+    out->reserve(in.size() / 4 * 3 + 2);
+    uint32_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        int v = base64url_value(static_cast<unsigned char>(in[i]));
+        if (v < 0)
+            return false;
+        acc = (acc << 6) | static_cast<uint32_t>(v);
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out->push_back(static_cast<char>((acc >> bits) & 0xFF));
+        }
+    }
+    return true;
+}
+
+bool parse_object(const std::string &text, Json *json)
+{
+    *json = Json::parse(text, nullptr, false);
+    return json->is_object();
+}
+
+// seconds since the epoch, or false when absent
+bool numeric_date(const Json &claims, const char *name, int64_t *value, bool *valid)
+{
+    auto it = claims.find(name);
+    if (it == claims.end())
+        return false;
+    *valid = it->is_number();
+    if (*valid)
+    {
+        // far enough for any token, and no overflow of the int64_t arithmetic
+        double seconds = it->get<double>();
+        if (seconds > 1e12)
+            seconds = 1e12;
+        else if (seconds < -1e12)
+            seconds = -1e12;
+        *value = static_cast<int64_t>(seconds);
+    }
+    return true;
+}
+
+bool has_audience(const Json &claims, const std::string &audience)
+{
+    auto it = claims.find("aud");
+    if (it == claims.end())
+        return false;
+    if (it->is_string())
+        return it->get<std::string>() == audience;
+    if (!it->is_array())
+        return false;
+    for (const Json &aud : *it)
+    {
+        if (aud.is_string() && aud.get<std::string>() == audience)
+            return true;
+    }
+    return false;
+}
+
+// r || s of a JWS to the DER of an ECDSA_SIG, as EVP_PKEY_verify() takes it
+bool es256_der(const std::string &sig, std::string *der)
+{
+    if (sig.size() != 64)
+        return false;
+    const unsigned char *raw = reinterpret_cast<const unsigned char *>(sig.data());
+    ECDSA_SIG *ecdsa = ECDSA_SIG_new();
+    BIGNUM *r = BN_bin2bn(raw, 32, nullptr);
+    BIGNUM *s = BN_bin2bn(raw + 32, 32, nullptr);
+    if (!ecdsa || !r || !s || ECDSA_SIG_set0(ecdsa, r, s) != 1)
+    {
+        BN_free(r);
+        BN_free(s);
+        ECDSA_SIG_free(ecdsa);
+        return false;
+    }
+    int len = i2d_ECDSA_SIG(ecdsa, nullptr);
+    bool ok = len > 0;
+    if (ok)
+    {
+        der->resize(len);
+        unsigned char *p = reinterpret_cast<unsigned char *>(&(*der)[0]);
+        ok = i2d_ECDSA_SIG(ecdsa, &p) == len;
+    }
+    ECDSA_SIG_free(ecdsa);
+    return ok;
+}
+
+}  // namespace
+
+JwtVerifier::JwtVerifier(const JwtOptions &options)
+    : options_(options),
+    cache_(options.cache_size)
+{
+    for (const JwtKey &jwt_key : options_.keys)
+    {
+        std::unique_ptr<Key> key(new Key);
+        key->alg = alg_code(jwt_key.alg);
+        key->kid = jwt_key.kid;
+        if (key->alg == 0)
+        {
+            XLOG_ERROR("jwt key {} : unsupported alg {}", jwt_key.kid, jwt_key.alg);
+            continue;
+        }
+        if (key->alg == k_hs256)
+        {
+            if (jwt_key.key.empty())
+            {
+                XLOG_ERROR("jwt key {} : empty HS256 secret", jwt_key.kid);
+                continue;
+            }
+            key->secret = jwt_key.key;
+            keys_.push_back(std::move(key));
+            continue;
+        }
+
+        BIO *bio = BIO_new_mem_buf(jwt_key.key.data(), static_cast<int>(jwt_key.key.size()));
+        if (bio)
+        {
+            key->pkey = PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
+            BIO_free(bio);
+        }
+        int type = key->alg == k_rs256 ? EVP_PKEY_RSA : EVP_PKEY_EC;
+        if (!key->pkey || EVP_PKEY_id(key->pkey) != type)
+        {
+            XLOG_ERROR("jwt key {} : not a {} public key", jwt_key.kid, jwt_key.alg);
+            EVP_PKEY_free(key->pkey);
+            ERR_clear_error();
+            continue;
+        }
+        keys_.push_back(std::move(key));
+    }
+}
+
+JwtVerifier::~JwtVerifier()
+{
+    for (auto &key : keys_)
+    {
+        for (EVP_PKEY_CTX *ctx : key->idle)
+            EVP_PKEY_CTX_free(ctx);
+        EVP_PKEY_free(key->pkey);
+    }
+}
+
+int JwtVerifier::verify(const StringPiece &token, std::shared_ptr<const Json> *claims)
+{
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char *>(token.data()), token.size(), digest);
+    std::string hash(reinterpret_cast<const char *>(digest), sizeof digest);
+    if (cache_.get(hash, claims))
+        return StatusOK;
+
+    // header.payload.signature, the signature is over header.payload
+    const char *begin = token.data();
+    const char *end = begin + token.size();
+    const char *dot1 = static_cast<const char *>(memchr(begin, '.', token.size()));
+    if (!dot1)
+        return StatusUnauthorized;
+    const char *dot2 = static_cast<const char *>(memchr(dot1 + 1, '.', end - dot1 - 1));
+    if (!dot2)
+        return StatusUnauthorized;
+
+    std::string text;
+    Json header;
+    if (!base64url_decode(StringPiece(begin, dot1 - begin), &text) || !parse_object(text, &header))
+        return StatusUnauthorized;
+    Key *key = this->find_key(header);
+    if (!key)
+        return StatusUnauthorized;
+
+    std::string sig;
+    if (!base64url_decode(StringPiece(dot2 + 1, end - dot2 - 1), &sig) ||
+        !this->check_signature(key, StringPiece(begin, dot2 - begin), sig))
+        return StatusUnauthorized;
+
+    auto payload = std::make_shared<Json>();
+    if (!base64url_decode(StringPiece(dot1 + 1, dot2 - dot1 - 1), &text) || !parse_object(text, payload.get()))
+        return StatusUnauthorized;
+
+    int64_t now = time(nullptr);
+    int64_t exp = 0;
+    int64_t nbf = 0;
+    bool valid = true;
+    bool has_exp = numeric_date(*payload, "exp", &exp, &valid);
+    if (!valid || (has_exp && now >= exp + options_.leeway))
+        return StatusUnauthorized;
+    if (numeric_date(*payload, "nbf", &nbf, &valid) && (!valid || now + options_.leeway < nbf))
+        return StatusUnauthorized;
+    if (!options_.issuer.empty())
+    {
+        auto it = payload->find("iss");
+        if (it == payload->end() || !it->is_string() || it->get<std::string>() != options_.issuer)
+            return StatusUnauthorized;
+    }
+    if (!options_.audience.empty() && !has_audience(*payload, options_.audience))
+        return StatusUnauthorized;
+
+    *claims = std::move(payload);
+    // until exp, a token without exp is verified every time
+    if (has_exp)
+        cache_.put(hash, *claims, (exp + options_.leeway - now) * 1000);
+    return StatusOK;
+}
+
+JwtVerifier::Key *JwtVerifier::find_key(const Json &header)
+{
+    auto alg = header.find("alg");
+    if (alg == header.end() || !alg->is_string())
+        return nullptr;
+    // "none" and every alg not configured are refused here
+    int code = alg_code(alg->get<std::string>());
+    auto kid = header.find("kid");
+    for (auto &key : keys_)
+    {
+        if (key->alg != code)
+            continue;
+        if (key->kid.empty())
+            return key.get();
+        if (kid != header.end() && kid->is_string() && kid->get<std::string>() == key->kid)
+            return key.get();
+    }
+    return nullptr;
+}
+
+bool JwtVerifier::check_signature(Key *key, const StringPiece &input, const std::string &sig)
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(input.data());
+    if (key->alg == k_hs256)
+    {
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        unsigned int mac_len = 0;
+        if (!HMAC(EVP_sha256(), key->secret.data(), static_cast<int>(key->secret.size()),
+                  data, input.size(), mac, &mac_len))
+            return false;
+        return sig.size() == mac_len && CRYPTO_memcmp(sig.data(), mac, mac_len) == 0;
+    }
+
+    std::string der;
+    const std::string *signature = &sig;
+    if (key->alg == k_es256)
+    {
+        if (!es256_der(sig, &der))
+            return false;
+        signature = &der;
+    }
+
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(data, input.size(), digest);
+    EVP_PKEY_CTX *ctx = this->get_ctx(key);
+    if (!ctx)
+        return false;
+    bool ok = EVP_PKEY_verify(ctx, reinterpret_cast<const unsigned char *>(signature->data()),
+                              signature->size(), digest, sizeof digest) == 1;
+    this->put_ctx(key, ctx);
+    if (!ok)
+        ERR_clear_error();
+    return ok;
+}
+
+// A context set up for the verification of SHA-256 digests with the key,
+// reused by the next verifications instead of being set up every time
+EVP_PKEY_CTX *JwtVerifier::get_ctx(Key *key)
+{
+    {
+        std::lock_guard<std::mutex> lock(key->mutex);
+        if (!key->idle.empty())
+        {
+            EVP_PKEY_CTX *ctx = key->idle.back();
+            key->idle.pop_back();
+            return ctx;
+        }
+    }
+
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(key->pkey, nullptr);
+    if (!ctx || EVP_PKEY_verify_init(ctx) <= 0 ||
+        (key->alg == k_rs256 && EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) <= 0) ||
+        EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256()) <= 0)
+    {
+        XLOG_ERROR("jwt key {} : EVP_PKEY_CTX setup error", key->kid);
+        EVP_PKEY_CTX_free(ctx);
+        ERR_clear_error();
+        return nullptr;
+    }
+    return ctx;
+}
+
+void JwtVerifier::put_ctx(Key *key, EVP_PKEY_CTX *ctx)
+{
+    std::lock_guard<std::mutex> lock(key->mutex);
+    key->idle.push_back(ctx);
+}
+
+bool JwtAspect::before(const HttpReq *req, HttpResp *resp) const
+{
+    const std::string &authorization = req->header("Authorization");
+    std::shared_ptr<const Json> claims;
+    if (authorization.size() > 7 && strncasecmp(authorization.c_str(), "Bearer ", 7) == 0 &&
+        verifier_->verify(StringPiece(authorization.data() + 7, authorization.size() - 7), &claims) == StatusOK)
+    {
+        // the request is the server task's own, only const for the aspects
+        const_cast<HttpReq *>(req)->set_claims(std::move(claims));
+        return true;
+    }
+    resp->headers["WWW-Authenticate"] = "Bearer";
+    resp->Error(StatusUnauthorized);
+    return false;
+}
@@ -0,0 +1,120 @@
+﻿#ifndef WFREST_JWT_H_
+#define WFREST_JWT_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "wfrest/Aspect.h"
+#include "wfrest/HttpMsg.h"
+#include "wfrest/ShardedCache.h"
+#include "wfrest/StringPiece.h"
+
+typedef struct evp_pkey_st EVP_PKEY;
+typedef struct evp_pkey_ctx_st EVP_PKEY_CTX;
+
+namespace wfrest
+{
+
+struct JwtKey
+{
+    // "HS256", "RS256" or "ES256", a token signed with another alg is refused
+    std::string alg;
+    // the shared secret for HS256, a PEM public key for RS256 and ES256
+    std::string key;
+    // when set, only tokens with this kid in their header
+    std::string kid;
+};
+
+// JwtVerifier, JwtAspect
+struct JwtOptions
+{
+    std::vector<JwtKey> keys;
+    // the iss and aud claims, checked when not empty
+    std::string issuer;
+    std::string audience;
+    // clock skew allowed on exp and nbf, seconds
+    int leeway = 30;
+    // verified tokens kept, in all
+    size_t cache_size = 64 * 1024;
+};
+
+// Checks the signature and the claims of a compact JWS (header.payload.signature).
+// The keys are parsed once, and the signature checks of a public key reuse verify
+// contexts already set up. A verified token is cached by its SHA-256 until its exp,
+// the next requests presenting it cost a hash and a lookup.
+// Refused tokens are not cached, random tokens can not fill the cache.
+// Thread safety: YES
+class JwtVerifier : public Noncopyable
+{
+public:
+    // Keys that do not load are logged and left out, see key_count()
+    explicit JwtVerifier(const JwtOptions &options);
+
+    ~JwtVerifier();
+
+    // StatusOK and the payload in *claims, or StatusUnauthorized
+    int verify(const StringPiece &token, std::shared_ptr<const Json> *claims);
+
+    size_t key_count() const
+    { return keys_.size(); }
+
+    ShardedCacheStats stats() const
+    { return cache_.stats(); }
+
+private:
+    struct Key
+    {
+        int alg;
+        std::string kid;
+        std::string secret;
+        EVP_PKEY *pkey = nullptr;
+        // verify contexts of pkey not in use
+        std::mutex mutex;
+        std::vector<EVP_PKEY_CTX *> idle;
+    };
+
+    Key *find_key(const Json &header);
+
+    bool check_signature(Key *key, const StringPiece &input, const std::string &sig);
+
+    EVP_PKEY_CTX *get_ctx(Key *key);
+
+    void put_ctx(Key *key, EVP_PKEY_CTX *ctx);
+
+private:
+    JwtOptions options_;
+    std::vector<std::unique_ptr<Key>> keys_;
+    ShardedCache<std::shared_ptr<const Json>> cache_;
+};
+
+// Lets through the requests with a valid "Authorization: Bearer <token>",
+// the others are answered 401. The claims of the token are in req->claims().
+// Copies share the verifier and its cache.
+class JwtAspect : public Aspect
+{
+public:
+    explicit JwtAspect(const JwtOptions &options)
+        : verifier_(std::make_shared<JwtVerifier>(options))
+    {}
+
+    explicit JwtAspect(const std::shared_ptr<JwtVerifier> &verifier)
+        : verifier_(verifier)
+    {}
+
+    bool before(const HttpReq *req, HttpResp *resp) const override;
+
+    bool after(const HttpReq *req, HttpResp *resp) const override
+    { return true; }
+
+    JwtVerifier *verifier() const
+    { return verifier_.get(); }
+
+private:
+    std::shared_ptr<JwtVerifier> verifier_;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_JWT_H_
@@ -3,4 +3,10 @@
 
 #define OUT
 
+// msvc has the S_IF* bits of <sys/stat.h> but not the S_IS* tests
+#if defined(_MSC_VER) && !defined(S_ISDIR)
+#define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
+#define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
+#endif
+
 #endif // WFREST_MACRO_H_
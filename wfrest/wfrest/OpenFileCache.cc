@@ -0,0 +1,189 @@
+﻿#include <sys/stat.h>
+#include <errno.h>
+#include <chrono>
+#ifndef OS_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "wfrest/OpenFileCache.h"
+#include "wfrest/Macro.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+int64_t steady_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+const OpenFileCache::OpenFileHandle *OpenFileCache::get(const std::string &path, bool map)
+{
+    if (max_size_ == 0)
+        return nullptr;
+
+    int64_t now = steady_ms();
+    const OpenFileHandle *handle;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        handle = cache_pool_.get(path);
+        if (handle && now < handle->value.expire_time && !(map && this->unmapped(handle->value)))
+        {
+            ++hits_;
+            return handle;
+        }
+    }
+
+    if (handle)
+    {
+        if (revalidate(path, handle->value, map))
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            handle->value.expire_time = now + valid_ms_;
+            ++hits_;
+            return handle;
+        }
+        this->release(handle);
+    }
+
+    // A request still holding the old entry keeps reading the file it opened.
+    ++misses_;
+    OpenFileInfo info;
+    int error = open_file(path, info);
+    if (error == 0 && map)
+        this->map_file(info);
+    if (error == ENOENT || error == ENOTDIR)
+        info.expire_time = now + negative_ms_;
+    else
+        info.expire_time = error == 0 ? now + valid_ms_ : now;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cache_pool_.put(path, info);
+}
+
+bool OpenFileCache::revalidate(const std::string &path, const OpenFileInfo &info, bool map) const
+{
+    if (info.error != 0 || (map && this->unmapped(info)))
+        return false;
+
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 &&
+           static_cast<unsigned long long>(st.st_ino) == info.ino &&
+           static_cast<size_t>(st.st_size) == info.size &&
+           st.st_mtime == info.mtime &&
+           S_ISDIR(st.st_mode) == info.is_dir;
+}
+
+bool OpenFileCache::unmapped(const OpenFileInfo &info) const
+{
+#ifndef OS_WINDOWS
+    return info.error == 0 && !info.addr && info.fd >= 0 &&
+           info.size > 0 && info.size <= map_max_size_;
+#else
+    return false;
+#endif
+}
+
+void OpenFileCache::map_file(OpenFileInfo &info) const
+{
+#ifndef OS_WINDOWS
+    if (!this->unmapped(info))
+        return;
+    // A file that is replaced (written elsewhere and renamed over) keeps the old
+    // inode and the mapping valid until the last response is done.
+    // Truncating a mapped file in place makes reads past the new end fault,
+    // deploy by rename when the mount is mapped.
+    void *addr = mmap(nullptr, info.size, PROT_READ, MAP_SHARED, info.fd, 0);
+    if (addr != MAP_FAILED)
+        info.addr = addr;
+#endif
+}
+
+int OpenFileCache::open_file(const std::string &path, OpenFileInfo &info)
+{
+    info.fd = -1;
+    info.addr = nullptr;
+    info.is_dir = false;
+    info.size = 0;
+    info.mtime = 0;
+    info.ino = 0;
+    info.expire_time = 0;
+
+    struct stat st;
+#ifndef OS_WINDOWS
+    // O_NONBLOCK : opening a fifo must not block the handler
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        info.error = errno;
+        return info.error;
+    }
+    if (fstat(fd, &st) != 0)
+    {
+        info.error = errno;
+        close(fd);
+        return info.error;
+    }
+    if (S_ISREG(st.st_mode))
+    {
+        info.fd = fd;
+    }
+    else
+    {
+        close(fd);
+        if (!S_ISDIR(st.st_mode))
+        {
+            info.error = ENOENT;    // devices, fifos, sockets are not served
+            return info.error;
+        }
+    }
+#else
+    if (stat(path.c_str(), &st) != 0)
+    {
+        info.error = errno;
+        return info.error;
+    }
+#endif
+    info.error = 0;
+    info.is_dir = S_ISDIR(st.st_mode);
+    info.size = st.st_size;
+    info.mtime = st.st_mtime;
+    info.ino = st.st_ino;
+    return 0;
+}
+
+OpenFileCacheStats OpenFileCache::stats() const
+{
+    OpenFileCacheStats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.entries = cache_pool_.size();
+    return stats;
+}
+
+void OpenFileCache::set_max_size(size_t max_size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_size_ = max_size;
+    if (max_size == 0)
+        cache_pool_.prune();
+    else
+        cache_pool_.set_max_size(max_size);
+}
+
+void OpenFileCache::ValueDeleter::operator() (const OpenFileInfo &info) const
+{
+#ifndef OS_WINDOWS
+    if (info.addr)
+        munmap(info.addr, info.size);
+    if (info.fd >= 0)
+        close(info.fd);
+#endif
+}
@@ -0,0 +1,133 @@
+﻿#ifndef WFREST_OPENFILECACHE_H_
+#define WFREST_OPENFILECACHE_H_
+
+#include "workflow/LRUCache.h"
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "wfrest/Noncopyable.h"
+
+namespace wfrest
+{
+
+struct OpenFileInfo
+{
+    // -1 for errors and directories, and on windows where files are read by path
+    int fd;
+    // 0, or the errno of the lookup : ENOENT, EACCES ...
+    int error;
+    bool is_dir;
+    size_t size;
+    time_t mtime;
+    unsigned long long ino;
+    // the whole file mapped read only, only when asked for, never on windows
+    void *addr;
+    // steady clock, ms. Touched under the cache mutex only
+    mutable int64_t expire_time;
+};
+
+struct OpenFileCacheStats
+{
+    size_t hits;
+    size_t misses;
+    size_t entries;
+};
+
+// Open fds and stat results of the hot paths of the Static() mounts, shared by
+// every request for the same file, like nginx's open_file_cache.
+// Lookups that failed with ENOENT are cached too, for a shorter time,
+// so a scanner's 404s do not reach the file system.
+// An expired entry is checked with one stat() and kept if the file is still the same,
+// otherwise it is replaced. An evicted or replaced fd (and mapping) is closed
+// when the last request using it releases its handle.
+// RAII: NO. Release handle by user
+// Thread safety: YES
+class OpenFileCache : public Noncopyable
+{
+public:
+    using OpenFileHandle = LRUHandle<std::string, OpenFileInfo>;
+
+    OpenFileCache()
+    { cache_pool_.set_max_size(max_size_); }
+
+    // nullptr if the cache is disabled, otherwise a positive or negative entry.
+    // map : also map files up to get_map_max_size(), responses then point into
+    // the mapping instead of reading the file.
+    // MUST call release when the fd (or mapping) is no longer used
+    const OpenFileHandle *get(const std::string &path, bool map = false);
+
+    void release(const OpenFileHandle *handle)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_pool_.release(handle);
+    }
+
+    OpenFileCacheStats stats() const;
+
+    // The uncached lookup : open() and fstat() a regular file, stat() only on windows.
+    // 0 or errno, the caller owns info.fd
+    static int open_file(const std::string &path, OpenFileInfo &info);
+
+public:
+    // entries, 0 disables the cache
+    void set_max_size(size_t max_size);
+
+    size_t get_max_size() const
+    { return max_size_; }
+
+    void set_valid_time(int valid_ms)
+    { valid_ms_ = valid_ms; }
+
+    int get_valid_time() const
+    { return valid_ms_; }
+
+    // ENOENT and ENOTDIR, other errors are never cached
+    void set_negative_time(int negative_ms)
+    { negative_ms_ = negative_ms; }
+
+    int get_negative_time() const
+    { return negative_ms_; }
+
+    // larger files are read, never mapped
+    void set_map_max_size(size_t map_max_size)
+    { map_max_size_ = map_max_size; }
+
+    size_t get_map_max_size() const
+    { return map_max_size_; }
+
+private:
+    // still the file we opened, and mapped if asked for
+    bool revalidate(const std::string &path, const OpenFileInfo &info, bool map) const;
+
+    // a file that could be mapped but is not
+    bool unmapped(const OpenFileInfo &info) const;
+
+    void map_file(OpenFileInfo &info) const;
+
+private:
+    std::atomic<size_t> max_size_{4096};
+    int valid_ms_ = 1000;
+    int negative_ms_ = 500;
+    size_t map_max_size_ = 32 * 1024 * 1024;
+
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+
+    mutable std::mutex mutex_;
+
+    class ValueDeleter
+    {
+    public:
+        void operator() (const OpenFileInfo &info) const;
+    };
+
+    LRUCache<std::string, OpenFileInfo, ValueDeleter> cache_pool_;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_OPENFILECACHE_H_
@@ -0,0 +1,192 @@
+﻿#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "wfrest/RateLimiter.h"
+#include "wfrest/HttpServerTask.h"
+#include "wfrest/ErrorCode.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+const size_t GROUP_SIZE = 4;
+
+}  // namespace
+
+struct RateLimiter::Bucket
+{
+    // 0 for none
+    std::atomic<uint64_t> key{0};
+    // the time the bucket is full again, us, 0 for full
+    std::atomic<int64_t> full_time{0};
+};
+
+RateLimiter::RateLimiter(const RateLimitOptions &options)
+{
+    size_t groups = 1;
+    while (groups * GROUP_SIZE < options.max_keys)
+        groups <<= 1;
+    buckets_ = new Bucket[groups * GROUP_SIZE];
+    group_mask_ = groups - 1;
+
+    double rate = options.rate > 0 ? options.rate : 1;
+    double burst = options.burst >= 1 ? options.burst : 1;
+    interval_us_ = std::max<int64_t>(1, static_cast<int64_t>(1000000 / rate));
+    burst_us_ = static_cast<int64_t>(interval_us_ * burst);
+}
+
+RateLimiter::~RateLimiter()
+{
+    delete []buckets_;
+}
+
+bool RateLimiter::try_acquire(uint64_t key, int64_t now_us, int64_t *wait_us)
+{
+    Bucket *bucket = this->find(key, now_us);
+    int64_t full_time = bucket->full_time.load(std::memory_order_relaxed);
+    int64_t next;
+    do
+    {
+        next = std::max(full_time, now_us) + interval_us_;
+        if (next - now_us > burst_us_)
+        {
+            limited_.fetch_add(1, std::memory_order_relaxed);
+            if (wait_us)
+                *wait_us = next - now_us - burst_us_;
+            return false;
+        }
+    } while (!bucket->full_time.compare_exchange_weak(full_time, next, std::memory_order_relaxed));
+    return true;
+}
+
+RateLimiter::Bucket *RateLimiter::find(uint64_t key, int64_t now_us)
+{
+    if (key == 0)
+        key = 1;
+    Bucket *group = &buckets_[(key & group_mask_) * GROUP_SIZE];
+    Bucket *victim = nullptr;
+    for (int retry = 0; retry < 2; retry++)
+    {
+        int64_t oldest = std::numeric_limits<int64_t>::max();
+        for (size_t i = 0; i < GROUP_SIZE; i++)
+        {
+            if (group[i].key.load(std::memory_order_acquire) == key)
+                return &group[i];
+        }
+        // an empty or full bucket, or the one used least recently
+        for (size_t i = 0; i < GROUP_SIZE; i++)
+        {
+            int64_t full_time = group[i].full_time.load(std::memory_order_relaxed);
+            if (full_time <= now_us)
+            {
+                victim = &group[i];
+                break;
+            }
+            if (full_time < oldest)
+            {
+                oldest = full_time;
+                victim = &group[i];
+            }
+        }
+        uint64_t old_key = victim->key.load(std::memory_order_relaxed);
+        if (victim->key.compare_exchange_strong(old_key, key, std::memory_order_acq_rel))
+        {
+            // a request of the old key in between may be counted for this one
+            if (old_key != 0 && victim->full_time.exchange(0, std::memory_order_relaxed) > now_us)
+                evicted_.fetch_add(1, std::memory_order_relaxed);
+            return victim;
+        }
+        // taken by another key meanwhile, maybe this one
+    }
+    return victim;
+}
+
+RateLimiterStats RateLimiter::stats() const
+{
+    RateLimiterStats stats;
+    stats.limited = limited_;
+    stats.evicted = evicted_;
+    return stats;
+}
+
+uint64_t RateLimiter::hash(const void *data, size_t len)
+{
+    // FNV-1a, then the splitmix64 finalizer for the low bits
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+int64_t RateLimiter::now_us()
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    // the tick of the kernel, no clock source read
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static uint64_t client_key(const HttpResp *resp)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof addr;
+    if (task_of(resp)->get_peer_addr(reinterpret_cast<struct sockaddr *>(&addr), &addr_len) < 0)
+        return 0;
+    // the address, not the port
+    if (addr.ss_family == AF_INET)
+    {
+        auto *sin = reinterpret_cast<struct sockaddr_in *>(&addr);
+        return RateLimiter::hash(&sin->sin_addr, sizeof sin->sin_addr);
+    }
+    if (addr.ss_family == AF_INET6)
+    {
+        auto *sin6 = reinterpret_cast<struct sockaddr_in6 *>(&addr);
+        return RateLimiter::hash(&sin6->sin6_addr, sizeof sin6->sin6_addr);
+    }
+    return 0;
+}
+
+bool RateLimitAspect::before(const HttpReq *req, HttpResp *resp) const
+{
+    uint64_t key;
+    switch (by_)
+    {
+    case RateLimitBy::API_KEY:
+    {
+        const std::string &api_key = req->header(api_key_header_);
+        key = api_key.empty() ? client_key(resp) : RateLimiter::hash(api_key);
+        break;
+    }
+    case RateLimitBy::ROUTE:
+        key = RateLimiter::hash(req->full_path());
+        break;
+    default:
+        key = client_key(resp);
+        break;
+    }
+
+    int64_t wait_us = 0;
+    if (limiter_->try_acquire(key, &wait_us))
+        return true;
+    int64_t retry_after = (wait_us + 999999) / 1000000;
+    resp->headers["Retry-After"] = std::to_string(retry_after > 0 ? retry_after : 1);
+    resp->Error(StatusTooManyRequests);
+    return false;
+}
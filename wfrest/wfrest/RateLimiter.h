@@ -0,0 +1,122 @@
+﻿#ifndef WFREST_RATELIMITER_H_
+#define WFREST_RATELIMITER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "wfrest/Aspect.h"
+#include "wfrest/HttpMsg.h"
+#include "wfrest/Noncopyable.h"
+#include "wfrest/StringPiece.h"
+
+namespace wfrest
+{
+
+enum class RateLimitBy
+{
+    // the peer address
+    CLIENT_IP,
+    // the api_key_header, the peer address without one
+    API_KEY,
+    // the route pattern, one bucket a route
+    ROUTE
+};
+
+// RateLimiter, RateLimitAspect
+struct RateLimitOptions
+{
+    // requests a second, and the burst let through at once
+    double rate = 100;
+    double burst = 100;
+    RateLimitBy by = RateLimitBy::CLIENT_IP;
+    std::string api_key_header = "X-API-Key";
+    // keys followed at once, the table is allocated up front (16 bytes a key)
+    size_t max_keys = 64 * 1024;
+};
+
+struct RateLimiterStats
+{
+    size_t limited;
+    // buckets taken over by another key before they were full again
+    size_t evicted;
+};
+
+// Token buckets by key, kept as GCRA : a bucket is the time it is full again,
+// a request takes 1 / rate seconds of it, and is refused if that goes beyond
+// burst / rate seconds from now. The refill is lazy, from a coarse clock.
+// The buckets are one table of atomics, a key hashes to a group of 4 adjacent ones.
+// Lookups and updates are compare-and-swap, no lock is taken.
+// A bucket full again is free (the TTL of a key is its refill time),
+// when none of the group is, the one used least recently is taken over.
+// Two keys with the same 64 bit hash share a bucket.
+// Thread safety: YES
+class RateLimiter : public Noncopyable
+{
+public:
+    explicit RateLimiter(const RateLimitOptions &options);
+
+    ~RateLimiter();
+
+    // false when the bucket of key is empty, *wait_us until it lets a request through
+    bool try_acquire(uint64_t key, int64_t *wait_us)
+    { return this->try_acquire(key, now_us(), wait_us); }
+
+    bool try_acquire(uint64_t key, int64_t now_us, int64_t *wait_us);
+
+    RateLimiterStats stats() const;
+
+    static uint64_t hash(const void *data, size_t len);
+
+    static uint64_t hash(const StringPiece &key)
+    { return hash(key.data(), key.size()); }
+
+    // the coarse clock of the buckets, us
+    static int64_t now_us();
+
+private:
+    struct Bucket;
+
+    Bucket *find(uint64_t key, int64_t now_us);
+
+private:
+    Bucket *buckets_;
+    size_t group_mask_;
+    int64_t interval_us_;
+    int64_t burst_us_;
+    std::atomic<size_t> limited_{0};
+    std::atomic<size_t> evicted_{0};
+};
+
+// Rate limits by client, API key or route :
+// svr.Use(RateLimitAspect(options)) for every request,
+// svr.GET("/login", handler, RateLimitAspect(options)) with the buckets of that route.
+// Refused requests are answered 429 with Retry-After.
+// Copies share the limiter.
+class RateLimitAspect : public Aspect
+{
+public:
+    explicit RateLimitAspect(const RateLimitOptions &options)
+        : limiter_(std::make_shared<RateLimiter>(options)),
+        by_(options.by),
+        api_key_header_(options.api_key_header)
+    {}
+
+    bool before(const HttpReq *req, HttpResp *resp) const override;
+
+    bool after(const HttpReq *req, HttpResp *resp) const override
+    { return true; }
+
+    RateLimiter *limiter() const
+    { return limiter_.get(); }
+
+private:
+    std::shared_ptr<RateLimiter> limiter_;
+    RateLimitBy by_;
+    std::string api_key_header_;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_RATELIMITER_H_
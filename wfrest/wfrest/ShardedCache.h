@@ -0,0 +1,161 @@
+﻿#ifndef WFREST_SHARDEDCACHE_H_
+#define WFREST_SHARDEDCACHE_H_
+
+#include "workflow/LRUCache.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "wfrest/Noncopyable.h"
+
+namespace wfrest
+{
+
+struct ShardedCacheStats
+{
+    size_t hits;
+    size_t misses;
+    size_t entries;
+};
+
+// Values that expire, keyed by string, for the checks made on every request
+// (credentials, tokens). The keys are spread over shards, each with its own mutex
+// and LRU list, so the handler threads seldom wait for each other.
+// A full shard drops its least recently used entry.
+// Thread safety: YES
+template<typename V>
+class ShardedCache : public Noncopyable
+{
+public:
+    // max_size entries in all, shards rounded up to a power of 2
+    explicit ShardedCache(size_t max_size, size_t shards = 16)
+    {
+        shard_count_ = 1;
+        while (shard_count_ < shards)
+            shard_count_ <<= 1;
+        shards_.reset(new Shard[shard_count_]);
+        this->set_max_size(max_size);
+    }
+
+    // false if missing or expired
+    bool get(const std::string &key, V *value)
+    {
+        Shard &shard = this->shard(key);
+        int64_t now = steady_ms();
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            const Handle *handle = shard.lru.get(key);
+            if (handle)
+            {
+                bool valid = now < handle->value.expire_time;
+                if (valid)
+                    *value = handle->value.value;
+                shard.lru.release(handle);
+                if (valid)
+                {
+                    hits_++;
+                    return true;
+                }
+                shard.lru.del(key);
+            }
+        }
+        misses_++;
+        return false;
+    }
+
+    // kept for ttl_ms, nothing is kept with 0
+    void put(const std::string &key, const V &value, int64_t ttl_ms)
+    {
+        if (ttl_ms <= 0)
+            return;
+        Shard &shard = this->shard(key);
+        Entry entry;
+        entry.value = value;
+        entry.expire_time = steady_ms() + ttl_ms;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.release(shard.lru.put(key, std::move(entry)));
+    }
+
+    void remove(const std::string &key)
+    {
+        Shard &shard = this->shard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.del(key);
+    }
+
+    void set_max_size(size_t max_size)
+    {
+        // at least one entry a shard, 0 would be no limit for the LRU list
+        size_t per_shard = (max_size + shard_count_ - 1) / shard_count_;
+        if (per_shard == 0)
+            per_shard = 1;
+        for (size_t i = 0; i < shard_count_; i++)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            shards_[i].lru.set_max_size(per_shard);
+        }
+    }
+
+    ShardedCacheStats stats() const
+    {
+        ShardedCacheStats stats;
+        stats.hits = hits_;
+        stats.misses = misses_;
+        stats.entries = 0;
+        for (size_t i = 0; i < shard_count_; i++)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            stats.entries += shards_[i].lru.size();
+        }
+        return stats;
+    }
+
+private:
+    struct Entry
+    {
+        V value;
+        // steady clock, ms
+        int64_t expire_time;
+    };
+
+    class ValueDeleter
+    {
+    public:
+        void operator() (const Entry &) const
+        {}
+    };
+
+    using Handle = LRUHandle<std::string, Entry>;
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        LRUCache<std::string, Entry, ValueDeleter> lru;
+    };
+
+    Shard &shard(const std::string &key)
+    {
+        return shards_[std::hash<std::string>()(key) & (shard_count_ - 1)];
+    }
+
+    static int64_t steady_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    size_t shard_count_;
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_SHARDEDCACHE_H_
@@ -0,0 +1,181 @@
+﻿#include <sys/stat.h>
+#include <chrono>
+#include <cstdio>
+
+#include "wfrest/StaticCache.h"
+#include "wfrest/HttpDef.h"
+#include "wfrest/HttpFile.h"
+#include "wfrest/PathUtil.h"
+#include "wfrest/Macro.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+long long steady_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string content_type_of(const std::string &path)
+{
+    http_content_type content_type = CONTENT_TYPE_NONE;
+    std::string suffix = PathUtil::suffix(path);
+    if (!suffix.empty())
+        content_type = ContentType::to_enum_by_suffix(suffix);
+    if (content_type == CONTENT_TYPE_NONE || content_type == CONTENT_TYPE_UNDEFINED)
+        content_type = APPLICATION_OCTET_STREAM;
+    return ContentType::to_str(content_type);
+}
+
+}  // namespace
+
+StaticCache::EntryPtr StaticCache::get(const std::string &path)
+{
+    if (capacity_ == 0)
+        return nullptr;
+
+    long long now = steady_ms();
+    EntryPtr entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = map_.find(path);
+        if (it != map_.end())
+        {
+            entry = it->second.entry;
+            lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_it);
+        }
+    }
+
+    if (entry && now - entry->checked_at < revalidate_interval_ms_)
+    {
+        ++hits_;
+        return entry;
+    }
+
+    if (entry)
+    {
+        // Revalidate : one stat per interval instead of one per request
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && st.st_mtime == entry->mtime &&
+            static_cast<size_t>(st.st_size) == entry->size &&
+            static_cast<unsigned long long>(st.st_ino) == entry->ino)
+        {
+            // entries are shared read-only, refresh by replacing
+            auto fresh = std::make_shared<StaticCacheEntry>(*entry);
+            fresh->checked_at = now;
+            insert(fresh);
+            ++hits_;
+            return fresh;
+        }
+        erase(path);
+    }
+
+    ++misses_;
+    entry = this->load(path, now);
+    if (entry)
+        insert(entry);
+    return entry;
+}
+
+StaticCache::EntryPtr StaticCache::load(const std::string &path, long long now)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return nullptr;
+    size_t size = st.st_size;
+    if (size > max_file_size_ || size > capacity_)
+        return nullptr;
+
+    auto entry = std::make_shared<StaticCacheEntry>();
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+        return nullptr;
+    entry->content.resize(size);
+    size_t read_len = size > 0 ? fread(&entry->content[0], 1, size, f) : 0;
+    fclose(f);
+    if (read_len != size)
+        return nullptr;
+
+    entry->path = path;
+    entry->content_type = content_type_of(path);
+    entry->mtime = st.st_mtime;
+    entry->size = size;
+    entry->ino = st.st_ino;
+    entry->etag = HttpFile::etag(entry->ino, size, entry->mtime);
+    entry->last_modified = HttpFile::last_modified(entry->mtime);
+    entry->checked_at = now;
+    return entry;
+}
+
+void StaticCache::insert(const EntryPtr &entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = map_.find(entry->path);
+    if (it != map_.end())
+    {
+        bytes_ -= it->second.entry->size;
+        it->second.entry = entry;
+        lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_it);
+    }
+    else
+    {
+        lru_list_.push_front(entry->path);
+        map_[entry->path] = Node{ entry, lru_list_.begin() };
+    }
+    bytes_ += entry->size;
+    this->evict();
+}
+
+void StaticCache::erase(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = map_.find(path);
+    if (it == map_.end())
+        return;
+    bytes_ -= it->second.entry->size;
+    lru_list_.erase(it->second.lru_it);
+    map_.erase(it);
+}
+
+void StaticCache::evict()
+{
+    while (bytes_ > capacity_ && !lru_list_.empty())
+    {
+        auto it = map_.find(lru_list_.back());
+        bytes_ -= it->second.entry->size;
+        map_.erase(it);
+        lru_list_.pop_back();
+        ++evictions_;
+    }
+}
+
+StaticCacheStats StaticCache::stats() const
+{
+    StaticCacheStats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.capacity = capacity_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.entries = map_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+
+void StaticCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_list_.clear();
+    map_.clear();
+    bytes_ = 0;
+}
+
+void StaticCache::set_capacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    this->evict();
+}
@@ -0,0 +1,116 @@
+﻿#ifndef WFREST_STATICCACHE_H_
+#define WFREST_STATICCACHE_H_
+
+#include <time.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "wfrest/Noncopyable.h"
+
+namespace wfrest
+{
+
+struct StaticCacheEntry
+{
+    std::string path;
+    std::string content;
+    std::string content_type;
+    // validators, the entry is dropped when the file on disk no longer matches them
+    time_t mtime;
+    size_t size;
+    unsigned long long ino;
+    // response headers, computed once
+    std::string etag;
+    std::string last_modified;
+    // steady clock, ms
+    long long checked_at;
+};
+
+struct StaticCacheStats
+{
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t entries;
+    size_t bytes;
+    size_t capacity;
+
+    double hit_ratio() const
+    { return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0; }
+};
+
+// Size bounded LRU cache of small static files, shared by the Static() mounts of a server.
+// Entries are handed out as shared_ptr, a response sends the bytes without copying
+// and keeps them alive until it is done, even if the entry is evicted meanwhile.
+class StaticCache : public Noncopyable
+{
+public:
+    using EntryPtr = std::shared_ptr<const StaticCacheEntry>;
+
+    // nullptr if the file can not be cached (too large, not found ...), send it from disk
+    EntryPtr get(const std::string &path);
+
+    StaticCacheStats stats() const;
+
+    void clear();
+
+public:
+    // total bytes of file content, 0 disables the cache
+    void set_capacity(size_t capacity);
+
+    size_t get_capacity() const
+    { return capacity_; }
+
+    // larger files are always sent from disk
+    void set_max_file_size(size_t max_file_size)
+    { max_file_size_ = max_file_size; }
+
+    size_t get_max_file_size() const
+    { return max_file_size_; }
+
+    // how long an entry is trusted before its mtime and size are checked again
+    void set_revalidate_interval(int revalidate_interval_ms)
+    { revalidate_interval_ms_ = revalidate_interval_ms; }
+
+    int get_revalidate_interval() const
+    { return revalidate_interval_ms_; }
+
+private:
+    EntryPtr load(const std::string &path, long long now);
+
+    void insert(const EntryPtr &entry);
+
+    void erase(const std::string &path);
+
+    // caller holds mutex_
+    void evict();
+
+private:
+    struct Node
+    {
+        EntryPtr entry;
+        std::list<std::string>::iterator lru_it;
+    };
+
+    size_t capacity_ = 64 * 1024 * 1024;
+    size_t max_file_size_ = 1024 * 1024;
+    int revalidate_interval_ms_ = 1000;
+
+    mutable std::mutex mutex_;
+    // front is the most recently used
+    std::list<std::string> lru_list_;
+    std::unordered_map<std::string, Node> map_;
+    size_t bytes_ = 0;
+
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+    std::atomic<size_t> evictions_{0};
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_STATICCACHE_H_
@@ -1,7 +1,44 @@
 ﻿#include "wfrest/Timestamp.h"
 
+#include <cstdio>
+#include <cstring>
+
 using namespace wfrest;
 
+namespace
+{
+
+const char *k_week_days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+const char *k_months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                           "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+// http://howardhinnant.github.io/date_algorithms.html
+// gmtime_r / timegm are spelled differently on every platform, so do it by hand
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+void civil_from_days(int64_t z, int64_t *y, unsigned *m, unsigned *d)
+{
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = static_cast<int64_t>(yoe) + era * 400 + (*m <= 2);
+}
+
+}  // namespace
+
 static_assert(sizeof(Timestamp) == sizeof(uint64_t),
               "Timestamp should be same size as uint64_t");
 
@@ -50,6 +87,45 @@ std::string Timestamp::to_format_str(const char *fmt) const
     return ss.str();
 }
 
+std::string Timestamp::to_http_date() const
+{
+    int64_t sec = micro_sec_since_epoch_ / k_micro_sec_per_sec;
+    int64_t days = sec / 86400;
+    int64_t rem = sec % 86400;
+    int64_t year;
+    unsigned month, day;
+    civil_from_days(days, &year, &month, &day);
+
+    char buf[32];
+    snprintf(buf, sizeof buf, "%s, %02u %s %04d %02d:%02d:%02d GMT",
+             k_week_days[(days + 4) % 7],    // 1970-01-01 is a Thursday
+             day, k_months[month - 1], static_cast<int>(year),
+             static_cast<int>(rem / 3600), static_cast<int>(rem % 3600 / 60), static_cast<int>(rem % 60));
+    return buf;
+}
+
+Timestamp Timestamp::from_http_date(const std::string &date)
+{
+    char week_day[4];
+    char month_str[4];
+    unsigned day, hour, minute, second;
+    int year;
+    if (sscanf(date.c_str(), "%3s, %2u %3s %4d %2u:%2u:%2u GMT",
+               week_day, &day, month_str, &year, &hour, &minute, &second) != 7)
+    {
+        return Timestamp::invalid();
+    }
+
+    unsigned month = 0;
+    while (month < 12 && strcmp(k_months[month], month_str) != 0)
+        month++;
+    if (month == 12 || day < 1 || day > 31 || year < 1970 || hour > 23 || minute > 59 || second > 60)
+        return Timestamp::invalid();
+
+    int64_t sec = days_from_civil(year, month + 1, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return Timestamp(static_cast<uint64_t>(sec) * k_micro_sec_per_sec);
+}
+
 uint64_t Timestamp::micro_sec_since_epoch() const
 {
     return micro_sec_since_epoch_;
@@ -32,6 +32,9 @@ public:
 
     std::string to_format_str(const char *fmt) const;
 
+    // RFC 7231 IMF-fixdate, always in GMT : Sun, 06 Nov 1994 08:49:37 GMT
+    std::string to_http_date() const;
+
     uint64_t micro_sec_since_epoch() const;
 
     bool valid() const
@@ -39,6 +42,9 @@ public:
 
     static Timestamp now();
 
+    // IMF-fixdate only (what every current client sends), invalid() on error
+    static Timestamp from_http_date(const std::string &date);
+
     static Timestamp invalid()
     { return Timestamp(); }
 
@@ -0,0 +1,408 @@
+﻿#include "workflow/WFTaskFactory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#ifdef OS_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "wfrest/Upload.h"
+#include "wfrest/FileIO.h"
+#include "wfrest/StrUtil.h"
+#include "wfrest/StringPiece.h"
+#include "wfrest/ErrorCode.h"
+#include "XLogger.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+// blocking write of a whole block, for the network thread
+bool write_block(int fd, const char *buf, size_t len, long long offset)
+{
+    while (len > 0)
+    {
+#ifdef OS_WINDOWS
+        int ret = -1;
+        if (_lseeki64(fd, offset, SEEK_SET) == offset)
+            ret = _write(fd, buf, static_cast<unsigned int>(len));
+#else
+        ssize_t ret = pwrite(fd, buf, len, offset);
+        if (ret < 0 && errno == EINTR)
+            continue;
+#endif
+        if (ret <= 0)
+            return false;
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+}  // namespace
+
+Upload::Upload(const UploadOptions &options, const std::string &boundary, size_t content_length)
+    : options_(options),
+    boundary_("--" + boundary),
+    content_length_(content_length)
+{
+#ifdef OS_WINDOWS
+	settings_ = {
+			header_field_cb,
+			header_value_cb,
+			part_data_cb,
+			part_data_begin_cb,
+			headers_complete_cb,
+			part_data_end_cb,
+			body_end_cb
+	};
+#else
+	settings_ = {
+			.on_header_field = header_field_cb,
+			.on_header_value = header_value_cb,
+			.on_part_data = part_data_cb,
+			.on_part_data_begin = part_data_begin_cb,
+			.on_headers_complete = headers_complete_cb,
+			.on_part_data_end = part_data_end_cb,
+			.on_body_end = body_end_cb
+	};
+#endif // OS_WINDOWS
+    parser_ = multipart_parser_init(boundary_.c_str(), &settings_);
+    multipart_parser_set_data(parser_, this);
+}
+
+Upload::~Upload()
+{
+    multipart_parser_free(parser_);
+    if (sink_)
+    {
+        sink_->close(false);
+        delete sink_;
+    }
+    if (block_)
+        FileIO::free_buffer(block_);
+    for (UploadFile &file : files_)
+    {
+        if (file.fd >= 0)
+            close(file.fd);
+        if (!file.path.empty())
+            remove(file.path.c_str());
+    }
+}
+
+int Upload::append(const void *buf, size_t *size)
+{
+    size_t rest = content_length_ - received_;
+    if (*size > rest)
+        *size = rest;
+
+    size_t len = *size;
+    if (len > 0 && multipart_parser_execute(parser_, static_cast<const char *>(buf), len) != len)
+    {
+        errno = field_too_large_ ? EMSGSIZE : EBADMSG;
+        return -1;
+    }
+    received_ += len;
+    if (received_ < content_length_)
+        return 0;
+
+    if (!body_end_)
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+    return 1;
+}
+
+void Upload::wait(WFCounterTask *counter)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_ > 0)
+        {
+            waiter_ = counter;
+            return;
+        }
+    }
+    counter->count();
+}
+
+int Upload::status() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_ ? StatusFileWriteError : StatusOK;
+}
+
+int Upload::header_field_cb(multipart_parser *parser, const char *buf, size_t len)
+{
+    auto *upload = static_cast<Upload *>(multipart_parser_get_data(parser));
+    // a new field starts after a value
+    if (!upload->header_value_.empty())
+        upload->handle_header();
+    upload->header_field_.append(buf, len);
+    return 0;
+}
+
+int Upload::header_value_cb(multipart_parser *parser, const char *buf, size_t len)
+{
+    auto *upload = static_cast<Upload *>(multipart_parser_get_data(parser));
+    upload->header_value_.append(buf, len);
+    return 0;
+}
+
+int Upload::part_data_cb(multipart_parser *parser, const char *buf, size_t len)
+{
+    auto *upload = static_cast<Upload *>(multipart_parser_get_data(parser));
+    return upload->part_data(buf, len);
+}
+
+int Upload::part_data_begin_cb(multipart_parser *parser)
+{
+    auto *upload = static_cast<Upload *>(multipart_parser_get_data(parser));
+    upload->name_.clear();
+    upload->filename_.clear();
+    upload->content_type_.clear();
+    upload->value_.clear();
+    upload->is_file_ = false;
+    return 0;
+}
+
+int Upload::headers_complete_cb(multipart_parser *parser)
+{
+    auto *upload = static_cast<Upload *>(multipart_parser_get_data(parser));
+    upload->handle_header();
+    return upload->begin_part();
+}
+
+int Upload::part_data_end_cb(multipart_parser *parser)
+{
+    auto *upload = static_cast<Upload *>(multipart_parser_get_data(parser));
+    return upload->end_part();
+}
+
+int Upload::body_end_cb(multipart_parser *parser)
+{
+    auto *upload = static_cast<Upload *>(multipart_parser_get_data(parser));
+    upload->body_end_ = true;
+    return 0;
+}
+
+void Upload::handle_header()
+{
+    if (strcasecmp(header_field_.c_str(), "Content-Disposition") == 0)
+    {
+        // Content-Disposition: form-data; name="avatar"; filename="user.jpg"
+        StringPiece header_val_piece(header_value_);
+        std::vector<StringPiece> dispo_list = StrUtil::split_piece<StringPiece>(header_val_piece, ';');
+
+        for (auto &dispo: dispo_list)
+        {
+            auto kv = StrUtil::split_piece<StringPiece>(StrUtil::trim(dispo), '=');
+            if (kv.size() != 2)
+                continue;
+            StringPiece value = StrUtil::trim_pairs(kv[1], R"(""'')");
+            if (kv[0] == StringPiece("name"))
+                name_ = value.as_string();
+            else if (kv[0] == StringPiece("filename"))
+            {
+                filename_ = value.as_string();
+                is_file_ = true;
+            }
+        }
+    }
+    else if (strcasecmp(header_field_.c_str(), "Content-Type") == 0)
+    {
+        content_type_ = header_value_;
+    }
+    header_field_.clear();
+    header_value_.clear();
+}
+
+int Upload::begin_part()
+{
+    if (!is_file_)
+        return 0;
+
+    files_.emplace_back();
+    UploadFile &file = files_.back();
+    file.name = name_;
+    file.filename = filename_;
+    file.content_type = content_type_;
+    if (options_.sink)
+    {
+        sink_ = options_.sink(file);
+        return 0;
+    }
+    this->open_file(file);
+    return 0;
+}
+
+int Upload::part_data(const char *buf, size_t len)
+{
+    if (!is_file_)
+    {
+        if (value_.size() + len > options_.max_field_size)
+        {
+            XLOG_ERROR("upload field {} exceeds {} bytes", name_, options_.max_field_size);
+            field_too_large_ = true;
+            return 1;
+        }
+        value_.append(buf, len);
+        return 0;
+    }
+
+    UploadFile &file = files_.back();
+    if (sink_)
+    {
+        file.size += len;
+        if (!sink_->write(buf, len))
+        {
+            // closed right away, a failed sink sees nothing more
+            this->fail();
+            sink_->close(false);
+            delete sink_;
+            sink_ = nullptr;
+        }
+        return 0;
+    }
+    if (file.fd < 0)
+        return 0;
+
+    while (len > 0)
+    {
+        if (!block_)
+            block_ = static_cast<char *>(FileIO::alloc_buffer(options_.write_size));
+        size_t n = std::min(len, options_.write_size - block_len_);
+        memcpy(block_ + block_len_, buf, n);
+        block_len_ += n;
+        file.size += n;
+        buf += n;
+        len -= n;
+        if (block_len_ == options_.write_size)
+            this->flush();
+    }
+    return 0;
+}
+
+int Upload::end_part()
+{
+    if (!is_file_)
+    {
+        if (!name_.empty())
+            fields_[name_] = std::make_pair(std::string(), std::move(value_));
+        value_.clear();
+        return 0;
+    }
+
+    if (sink_)
+    {
+        sink_->close(true);
+        delete sink_;
+        sink_ = nullptr;
+    }
+    else
+    {
+        this->flush();
+    }
+    is_file_ = false;
+    return 0;
+}
+
+void Upload::open_file(UploadFile &file)
+{
+    std::string path = options_.dir + "/wfrest_upload_XXXXXX";
+#ifdef OS_WINDOWS
+    int fd = -1;
+    if (_mktemp_s(&path[0], path.size() + 1) == 0)
+        fd = _open(path.c_str(), _O_CREAT | _O_EXCL | _O_RDWR | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = mkstemp(&path[0]);
+    if (fd >= 0)
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+    if (fd < 0)
+    {
+        XLOG_ERROR("upload temp file in {} : {}", options_.dir, strerror(errno));
+        this->fail();
+        return;
+    }
+    file.path = std::move(path);
+    file.fd = fd;
+}
+
+// Writes the pending block at the end of the current file.
+// Blocks are written concurrently, each at its own offset.
+void Upload::flush()
+{
+    if (block_len_ == 0)
+        return;
+
+    UploadFile &file = files_.back();
+    char *buf = block_;
+    size_t len = block_len_;
+    long long offset = file.size - len;
+    block_ = nullptr;
+    block_len_ = 0;
+
+    bool async = false;
+#ifndef OS_WINDOWS
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_ < options_.max_pending_writes)
+        {
+            ++pending_;
+            async = true;
+        }
+    }
+    if (async)
+    {
+        auto self = this->shared_from_this();
+        FileIOTask *task = FileIO::create_pwrite_task(file.fd, buf, len, offset,
+            [self, buf, len](FileIOTask *task)
+            {
+                FileIO::free_buffer(buf);
+                self->write_done(task->get_retval() == static_cast<long>(len));
+            });
+        task->start();
+        return;
+    }
+#endif
+    // the disk does not keep up (or windows), the connection waits
+    bool ok = write_block(file.fd, buf, len, offset);
+    FileIO::free_buffer(buf);
+    if (!ok)
+    {
+        XLOG_ERROR("upload write {} : {}", file.path, strerror(errno));
+        this->fail();
+    }
+}
+
+void Upload::write_done(bool ok)
+{
+    WFCounterTask *waiter = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ok)
+            failed_ = true;
+        if (--pending_ == 0)
+        {
+            waiter = waiter_;
+            waiter_ = nullptr;
+        }
+    }
+    if (waiter)
+        waiter->count();
+}
+
+void Upload::fail()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_ = true;
+}
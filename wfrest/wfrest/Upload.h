@@ -0,0 +1,162 @@
+﻿#ifndef WFREST_UPLOAD_H_
+#define WFREST_UPLOAD_H_
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "wfrest/HttpContent.h"
+#include "wfrest/Noncopyable.h"
+
+class WFCounterTask;
+
+namespace wfrest
+{
+
+// A file part of a streamed multipart/form-data upload
+struct UploadFile
+{
+    // form field name
+    std::string name;
+    // as sent by the client, never use it as a path
+    std::string filename;
+    std::string content_type;
+    // the temp file, empty when the part went to a sink.
+    // Removed when the request is done, rename() it to keep it.
+    std::string path;
+    // open for reading until the request is done, -1 with a sink
+    int fd = -1;
+    size_t size = 0;
+};
+
+// Receives the bytes of one file part in order, on the network thread : do not block.
+class UploadSink
+{
+public:
+    virtual ~UploadSink() = default;
+
+    // false fails the upload, the handler is not called
+    virtual bool write(const char *data, size_t len) = 0;
+
+    // complete is false when the request failed before the end of the part
+    virtual void close(bool complete) = 0;
+};
+
+// HttpServer::upload_options()
+struct UploadOptions
+{
+    // directory of the temp files
+    std::string dir = "/tmp";
+    // multipart/form-data bodies with a Content-Length of at least min_size are streamed,
+    // smaller ones are buffered and parsed by form() as usual
+    size_t min_size = 1024 * 1024;
+    // limit of a streamed body, in place of the request size limit
+    size_t max_size = 4ULL * 1024 * 1024 * 1024;
+    // parts without a filename stay in memory, a larger one fails the request (EMSGSIZE)
+    size_t max_field_size = 64 * 1024;
+    // file parts are written to disk in blocks of write_size
+    size_t write_size = 256 * 1024;
+    // beyond this many blocks in flight the network thread writes by itself
+    size_t max_pending_writes = 8;
+    // A sink per file part instead of a temp file, owned by the upload.
+    // Returning nullptr discards the part.
+    std::function<UploadSink *(const UploadFile &file)> sink;
+};
+
+// Incremental multipart/form-data parser of one request, fed by HttpReq as the
+// body bytes arrive. Fields are kept in a Form, file parts are written with
+// FileIO pwrite tasks, so the body is never held in memory.
+class Upload : public std::enable_shared_from_this<Upload>, public Noncopyable
+{
+public:
+    Upload(const UploadOptions &options, const std::string &boundary, size_t content_length);
+
+    ~Upload();
+
+    // The ProtocolMessage::append() contract : *size is cut to the rest of the body,
+    // 1 once the whole body is parsed, 0 for more, -1 with errno on a malformed body
+    // (EBADMSG) or a too large field (EMSGSIZE).
+    int append(const void *buf, size_t *size);
+
+    // counter->count() once every block is on disk, maybe right away
+    void wait(WFCounterTask *counter);
+
+    // StatusOK or StatusFileWriteError, final after wait()
+    int status() const;
+
+    // parts without a filename, as form() : <name, <"", value>>
+    Form &fields()
+    { return fields_; }
+
+    const std::vector<UploadFile> &files() const
+    { return files_; }
+
+private:
+    static int header_field_cb(multipart_parser *parser, const char *buf, size_t len);
+
+    static int header_value_cb(multipart_parser *parser, const char *buf, size_t len);
+
+    static int part_data_cb(multipart_parser *parser, const char *buf, size_t len);
+
+    static int part_data_begin_cb(multipart_parser *parser);
+
+    static int headers_complete_cb(multipart_parser *parser);
+
+    static int part_data_end_cb(multipart_parser *parser);
+
+    static int body_end_cb(multipart_parser *parser);
+
+    void handle_header();
+
+    int begin_part();
+
+    int part_data(const char *buf, size_t len);
+
+    int end_part();
+
+    void open_file(UploadFile &file);
+
+    void flush();
+
+    void write_done(bool ok);
+
+    void fail();
+
+private:
+    UploadOptions options_;
+    std::string boundary_;
+    size_t content_length_;
+    size_t received_ = 0;
+    bool body_end_ = false;
+    bool field_too_large_ = false;
+
+    multipart_parser_settings settings_;
+    multipart_parser *parser_;
+
+    // the part being parsed
+    std::string header_field_;
+    std::string header_value_;
+    std::string name_;
+    std::string filename_;
+    std::string content_type_;
+    std::string value_;
+    bool is_file_ = false;
+    UploadSink *sink_ = nullptr;
+    // block not written yet, from FileIO::alloc_buffer()
+    char *block_ = nullptr;
+    size_t block_len_ = 0;
+
+    Form fields_;
+    std::vector<UploadFile> files_;
+
+    mutable std::mutex mutex_;
+    size_t pending_ = 0;
+    bool failed_ = false;
+    WFCounterTask *waiter_ = nullptr;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_UPLOAD_H_
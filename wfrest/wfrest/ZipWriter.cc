@@ -0,0 +1,337 @@
+﻿#include <string.h>
+
+#include "wfrest/ZipWriter.h"
+#include "wfrest/ErrorCode.h"
+#include "XLogger.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+const uint32_t k_local_header_sig = 0x04034b50;
+const uint32_t k_data_descriptor_sig = 0x08074b50;
+const uint32_t k_central_header_sig = 0x02014b50;
+const uint32_t k_zip64_end_sig = 0x06064b50;
+const uint32_t k_zip64_locator_sig = 0x07064b50;
+const uint32_t k_end_sig = 0x06054b50;
+
+// sizes and crc in the data descriptor, names in UTF-8
+const uint16_t k_flags = 0x0008 | 0x0800;
+const uint16_t k_method_store = 0;
+const uint16_t k_method_deflate = 8;
+const uint16_t k_version = 20;
+const uint16_t k_version_zip64 = 45;
+const uint32_t k_max32 = 0xFFFFFFFF;
+const uint16_t k_max16 = 0xFFFF;
+
+const size_t k_local_header_size = 30;
+const size_t k_central_header_size = 46;
+const size_t k_zip64_extra_size = 4 + 8 + 8;
+const size_t k_end_size = 22;
+const size_t k_zip64_end_size = 56;
+const size_t k_zip64_locator_size = 20;
+
+void put16(std::string *out, uint16_t v)
+{
+    char buf[2] = { static_cast<char>(v), static_cast<char>(v >> 8) };
+    out->append(buf, 2);
+}
+
+void put32(std::string *out, uint32_t v)
+{
+    put16(out, static_cast<uint16_t>(v));
+    put16(out, static_cast<uint16_t>(v >> 16));
+}
+
+void put64(std::string *out, uint64_t v)
+{
+    put32(out, static_cast<uint32_t>(v));
+    put32(out, static_cast<uint32_t>(v >> 32));
+}
+
+uint32_t clamp32(uint64_t v)
+{
+    return v >= k_max32 ? k_max32 : static_cast<uint32_t>(v);
+}
+
+void dos_time(time_t mtime, uint16_t *time_out, uint16_t *date_out)
+{
+    struct tm tm;
+#ifdef OS_WINDOWS
+    localtime_s(&tm, &mtime);
+#else
+    localtime_r(&mtime, &tm);
+#endif
+    // the format starts in 1980
+    if (tm.tm_year < 80)
+    {
+        *time_out = 0;
+        *date_out = (1 << 5) | 1;
+        return;
+    }
+    *time_out = static_cast<uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+    *date_out = static_cast<uint16_t>(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+}  // namespace
+
+ZipWriter::ZipWriter(bool deflate, int level) : deflate_(deflate)
+{
+    if (!deflate_)
+        return;
+    memset(&strm_, 0, sizeof strm_);
+    // raw deflate, the archive has its own headers
+    if (deflateInit2(&strm_, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+        strm_init_ = true;
+    else
+        XLOG_ERROR("deflateInit2 error!");
+}
+
+ZipWriter::~ZipWriter()
+{
+    if (strm_init_)
+        deflateEnd(&strm_);
+}
+
+bool ZipWriter::needs_zip64(bool deflate, uint64_t size)
+{
+    // deflate may grow incompressible data a little, zlib's compressBound()
+    if (deflate)
+        size += (size >> 12) + (size >> 14) + (size >> 25) + 13;
+    return size >= k_max32;
+}
+
+void ZipWriter::begin_file(const std::string &name, uint64_t size, time_t mtime, std::string *out)
+{
+    Entry entry;
+    entry.name = name;
+    entry.crc = 0;
+    entry.compressed_size = 0;
+    entry.size = 0;
+    entry.offset = offset_;
+    dos_time(mtime, &entry.dos_time, &entry.dos_date);
+    entry.zip64 = needs_zip64(deflate_, size);
+
+    size_t start = out->size();
+    put32(out, k_local_header_sig);
+    put16(out, entry.zip64 ? k_version_zip64 : k_version);
+    put16(out, k_flags);
+    put16(out, deflate_ ? k_method_deflate : k_method_store);
+    put16(out, entry.dos_time);
+    put16(out, entry.dos_date);
+    // crc and sizes are in the data descriptor
+    put32(out, 0);
+    put32(out, entry.zip64 ? k_max32 : 0);
+    put32(out, entry.zip64 ? k_max32 : 0);
+    put16(out, static_cast<uint16_t>(name.size()));
+    put16(out, static_cast<uint16_t>(entry.zip64 ? k_zip64_extra_size : 0));
+    out->append(name);
+    if (entry.zip64)
+    {
+        // the 8 byte sizes, which also makes the data descriptor use 8 byte sizes
+        put16(out, 0x0001);
+        put16(out, 16);
+        put64(out, 0);
+        put64(out, 0);
+    }
+    offset_ += out->size() - start;
+
+    if (strm_init_)
+        deflateReset(&strm_);
+    entries_.push_back(std::move(entry));
+    in_file_ = true;
+}
+
+int ZipWriter::file_data(const char *data, size_t len, std::string *out)
+{
+    Entry &entry = entries_.back();
+    entry.size += len;
+    // crc32() takes an uInt length
+    const char *p = data;
+    size_t rest = len;
+    while (rest > 0)
+    {
+        uInt n = rest > 0x40000000 ? 0x40000000 : static_cast<uInt>(rest);
+        entry.crc = static_cast<uint32_t>(crc32(entry.crc, reinterpret_cast<const Bytef *>(p), n));
+        p += n;
+        rest -= n;
+    }
+
+    if (!deflate_)
+    {
+        entry.compressed_size += len;
+        offset_ += len;
+        return StatusOK;
+    }
+    if (!strm_init_)
+        return StatusCompressError;
+
+    size_t start = out->size();
+    strm_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    strm_.avail_in = static_cast<uInt>(len);
+    do
+    {
+        size_t pos = out->size();
+        out->resize(pos + 64 * 1024);
+        strm_.next_out = reinterpret_cast<Bytef *>(&(*out)[pos]);
+        strm_.avail_out = 64 * 1024;
+        if (deflate(&strm_, Z_NO_FLUSH) == Z_STREAM_ERROR)
+            return StatusCompressError;
+        out->resize(out->size() - strm_.avail_out);
+    } while (strm_.avail_in > 0 || strm_.avail_out == 0);
+
+    entry.compressed_size += out->size() - start;
+    offset_ += out->size() - start;
+    return StatusOK;
+}
+
+int ZipWriter::end_file(std::string *out)
+{
+    Entry &entry = entries_.back();
+    size_t start = out->size();
+    if (deflate_)
+    {
+        if (!strm_init_)
+            return StatusCompressError;
+        int ret;
+        strm_.next_in = nullptr;
+        strm_.avail_in = 0;
+        do
+        {
+            size_t pos = out->size();
+            out->resize(pos + 64 * 1024);
+            strm_.next_out = reinterpret_cast<Bytef *>(&(*out)[pos]);
+            strm_.avail_out = 64 * 1024;
+            ret = deflate(&strm_, Z_FINISH);
+            out->resize(out->size() - strm_.avail_out);
+        } while (ret == Z_OK);
+        if (ret != Z_STREAM_END)
+            return StatusCompressError;
+        entry.compressed_size += out->size() - start;
+    }
+
+    put32(out, k_data_descriptor_sig);
+    put32(out, entry.crc);
+    if (entry.zip64)
+    {
+        put64(out, entry.compressed_size);
+        put64(out, entry.size);
+    }
+    else
+    {
+        put32(out, static_cast<uint32_t>(entry.compressed_size));
+        put32(out, static_cast<uint32_t>(entry.size));
+    }
+    offset_ += out->size() - start;
+    in_file_ = false;
+    return StatusOK;
+}
+
+size_t ZipWriter::central_header_size(const Entry &entry)
+{
+    size_t fields = (entry.size >= k_max32) + (entry.compressed_size >= k_max32) + (entry.offset >= k_max32);
+    return k_central_header_size + entry.name.size() + (fields > 0 ? 4 + 8 * fields : 0);
+}
+
+void ZipWriter::central_header(const Entry &entry, std::string *out)
+{
+    size_t extra = central_header_size(entry) - k_central_header_size - entry.name.size();
+    bool zip64 = entry.zip64 || extra > 0;
+    put32(out, k_central_header_sig);
+    put16(out, k_version_zip64);
+    put16(out, zip64 ? k_version_zip64 : k_version);
+    put16(out, k_flags);
+    put16(out, deflate_ ? k_method_deflate : k_method_store);
+    put16(out, entry.dos_time);
+    put16(out, entry.dos_date);
+    put32(out, entry.crc);
+    put32(out, clamp32(entry.compressed_size));
+    put32(out, clamp32(entry.size));
+    put16(out, static_cast<uint16_t>(entry.name.size()));
+    put16(out, static_cast<uint16_t>(extra));
+    // comment, disk, internal and external attributes
+    put16(out, 0);
+    put16(out, 0);
+    put16(out, 0);
+    put32(out, 0);
+    put32(out, clamp32(entry.offset));
+    out->append(entry.name);
+    if (extra > 0)
+    {
+        // only the fields saturated above, in this order
+        put16(out, 0x0001);
+        put16(out, static_cast<uint16_t>(extra - 4));
+        if (entry.size >= k_max32)
+            put64(out, entry.size);
+        if (entry.compressed_size >= k_max32)
+            put64(out, entry.compressed_size);
+        if (entry.offset >= k_max32)
+            put64(out, entry.offset);
+    }
+}
+
+void ZipWriter::finish(std::string *out)
+{
+    size_t start = out->size();
+    uint64_t cd_offset = offset_;
+    for (const Entry &entry : entries_)
+        this->central_header(entry, out);
+    uint64_t cd_size = out->size() - start;
+    uint64_t count = entries_.size();
+
+    if (count >= k_max16 || cd_size >= k_max32 || cd_offset >= k_max32)
+    {
+        uint64_t zip64_end_offset = cd_offset + cd_size;
+        put32(out, k_zip64_end_sig);
+        put64(out, k_zip64_end_size - 12);
+        put16(out, k_version_zip64);
+        put16(out, k_version_zip64);
+        put32(out, 0);
+        put32(out, 0);
+        put64(out, count);
+        put64(out, count);
+        put64(out, cd_size);
+        put64(out, cd_offset);
+
+        put32(out, k_zip64_locator_sig);
+        put32(out, 0);
+        put64(out, zip64_end_offset);
+        put32(out, 1);
+    }
+
+    put32(out, k_end_sig);
+    put16(out, 0);
+    put16(out, 0);
+    put16(out, count >= k_max16 ? k_max16 : static_cast<uint16_t>(count));
+    put16(out, count >= k_max16 ? k_max16 : static_cast<uint16_t>(count));
+    put32(out, clamp32(cd_size));
+    put32(out, clamp32(cd_offset));
+    put16(out, 0);
+    offset_ += out->size() - start;
+}
+
+uint64_t ZipWriter::stored_size(const std::vector<std::pair<std::string, uint64_t>> &entries)
+{
+    uint64_t offset = 0;
+    uint64_t cd_size = 0;
+    for (const auto &name_size : entries)
+    {
+        Entry entry;
+        entry.name = name_size.first;
+        entry.size = name_size.second;
+        entry.compressed_size = name_size.second;
+        entry.offset = offset;
+        entry.zip64 = needs_zip64(false, entry.size);
+
+        offset += k_local_header_size + entry.name.size() + (entry.zip64 ? k_zip64_extra_size : 0);
+        offset += entry.size;
+        offset += entry.zip64 ? 24 : 16;
+        cd_size += central_header_size(entry);
+    }
+
+    uint64_t size = offset + cd_size + k_end_size;
+    if (entries.size() >= k_max16 || cd_size >= k_max32 || offset >= k_max32)
+        size += k_zip64_end_size + k_zip64_locator_size;
+    return size;
+}
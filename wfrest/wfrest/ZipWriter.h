@@ -0,0 +1,81 @@
+﻿#ifndef WFREST_ZIPWRITER_H_
+#define WFREST_ZIPWRITER_H_
+
+#include <zlib.h>
+#include <time.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "wfrest/Noncopyable.h"
+
+namespace wfrest
+{
+
+// Encoder of a ZIP archive written front to back, for streaming : the CRC and the
+// sizes of an entry follow its data in a data descriptor, nothing is patched later.
+// ZIP64 records are used where a size or an offset needs them.
+// Only the bytes of the format are produced, reading the files is up to the caller.
+class ZipWriter : public Noncopyable
+{
+public:
+    // deflate with zlib at level, or store
+    explicit ZipWriter(bool deflate, int level = Z_DEFAULT_COMPRESSION);
+
+    ~ZipWriter();
+
+    // The local file header of the next entry. size, from stat(), only decides
+    // whether the entry needs ZIP64 sizes.
+    void begin_file(const std::string &name, uint64_t size, time_t mtime, std::string *out);
+
+    // Stored : nothing is appended, data goes to the archive as it is.
+    // Deflate : the compressed bytes so far are appended.
+    // StatusOK, or StatusCompressError
+    int file_data(const char *data, size_t len, std::string *out);
+
+    // the end of the compressed data and the data descriptor
+    int end_file(std::string *out);
+
+    // central directory and end of central directory records
+    void finish(std::string *out);
+
+    // bytes of the archive so far, data given to file_data() included
+    uint64_t offset() const
+    { return offset_; }
+
+    // Exact size of the stored archive of these <name, size> entries,
+    // the Content-Length known before a byte is read.
+    static uint64_t stored_size(const std::vector<std::pair<std::string, uint64_t>> &entries);
+
+private:
+    struct Entry
+    {
+        std::string name;
+        uint32_t crc;
+        uint64_t compressed_size;
+        uint64_t size;
+        uint64_t offset;
+        uint16_t dos_time;
+        uint16_t dos_date;
+        bool zip64;
+    };
+
+    static bool needs_zip64(bool deflate, uint64_t size);
+
+    static size_t central_header_size(const Entry &entry);
+
+    void central_header(const Entry &entry, std::string *out);
+
+private:
+    bool deflate_;
+    z_stream strm_;
+    bool strm_init_ = false;
+    uint64_t offset_ = 0;
+    std::vector<Entry> entries_;
+    // between begin_file() and end_file(), the entry is entries_.back()
+    bool in_file_ = false;
+};
+
+}  // namespace wfrest
+
+#endif  // WFREST_ZIPWRITER_H_
@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "wfrest/Compress.h"
+#include "wfrest/ErrorCode.h"
+#include "wfrest/json.hpp"
+
+using namespace wfrest;
+using Json = nlohmann::json;
+
+// Small json corpus in the shape of our api responses : 1 ~ 4 KB orders
+static std::vector<std::string> make_corpus(size_t count, unsigned int seed)
+{
+    static const char *status_list[] = { "created", "paid", "shipped", "delivered", "refunded" };
+    static const char *sku_list[] = { "BOOK-0001", "PEN-0420", "MUG-1024", "BAG-7788", "CUP-3141" };
+    static const char *city_list[] = { "Shanghai", "Beijing", "Shenzhen", "Hangzhou", "Chengdu" };
+
+    auto rand = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    };
+
+    std::vector<std::string> corpus;
+    corpus.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        Json order;
+        order["code"] = 0;
+        order["msg"] = "success";
+        order["data"]["order_id"] = std::to_string(100000000 + rand() * 1000 + rand() % 1000);
+        order["data"]["status"] = status_list[rand() % 5];
+        order["data"]["created_at"] = "2022-0" + std::to_string(1 + rand() % 9) + "-1"
+                                      + std::to_string(rand() % 10) + "T10:2"
+                                      + std::to_string(rand() % 10) + ":00Z";
+        order["data"]["customer"]["id"] = rand();
+        order["data"]["customer"]["name"] = "customer_" + std::to_string(rand());
+        order["data"]["customer"]["email"] = "customer_" + std::to_string(rand()) + "@example.com";
+        order["data"]["address"]["city"] = city_list[rand() % 5];
+        order["data"]["address"]["street"] = std::to_string(rand() % 999) + " Nanjing Road";
+        order["data"]["address"]["zip"] = std::to_string(200000 + rand() % 1000);
+        int item_cnt = 8 + rand() % 40;
+        for (int j = 0; j < item_cnt; j++)
+        {
+            Json item;
+            item["sku"] = sku_list[rand() % 5];
+            item["quantity"] = 1 + rand() % 5;
+            item["price"] = (rand() % 10000) / 100.0;
+            item["currency"] = "CNY";
+            item["discount"] = rand() % 2 == 0;
+            order["data"]["items"].push_back(item);
+        }
+        corpus.push_back(order.dump());
+    }
+    return corpus;
+}
+
+using CompressFunc = std::function<int(const std::string &, std::string *)>;
+
+static void bench(const char *name, const std::vector<std::string> &corpus, const CompressFunc &func)
+{
+    size_t raw_size = 0;
+    size_t compress_size = 0;
+    std::string compress_data;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &doc : corpus)
+    {
+        if (func(doc, &compress_data) != StatusOK)
+        {
+            fprintf(stderr, "%-12s : not supported\n", name);
+            return;
+        }
+        raw_size += doc.size();
+        compress_size += compress_data.size();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double us = std::chrono::duration<double, std::micro>(end - start).count();
+    fprintf(stderr, "%-12s : ratio %5.2f  avg %6zu -> %5zu bytes  %6.2f us/doc  %7.1f MB/s\n",
+            name,
+            static_cast<double>(raw_size) / compress_size,
+            raw_size / corpus.size(),
+            compress_size / corpus.size(),
+            us / corpus.size(),
+            raw_size / us);
+}
+
+int main()
+{
+    // train on one half, measure on the other, like training offline on yesterday's responses
+    std::vector<std::string> samples = make_corpus(2000, 1);
+    std::vector<std::string> corpus = make_corpus(2000, 2);
+
+    size_t total = 0;
+    for (const auto &doc : corpus)
+        total += doc.size();
+    fprintf(stderr, "corpus : %zu docs, avg %zu bytes\n\n", corpus.size(), total / corpus.size());
+
+    bench("gzip", corpus, [](const std::string &doc, std::string *dest) {
+        return Compressor::gzip(&doc, dest);
+    });
+    bench("brotli", corpus, [](const std::string &doc, std::string *dest) {
+        return Compressor::brotli(&doc, dest);
+    });
+    bench("zstd", corpus, [](const std::string &doc, std::string *dest) {
+        return Compressor::zstd(&doc, dest);
+    });
+
+    std::string dict;
+    unsigned int dict_id = 0;
+    if (Compressor::zstd_train_dict(samples, 16 * 1024, &dict) != StatusOK ||
+        Compressor::zstd_load_dict(dict.data(), dict.size(), &dict_id) != StatusOK)
+    {
+        fprintf(stderr, "zstd + dict  : not supported\n");
+        return 0;
+    }
+    fprintf(stderr, "\ndictionary %u : %zu bytes\n", dict_id, dict.size());
+    bench("zstd + dict", corpus, [dict_id](const std::string &doc, std::string *dest) {
+        return Compressor::zstd(doc.c_str(), doc.size(), dest, dict_id);
+    });
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "workflow/WFFacilities.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "wfrest/FileIO.h"
+
+using namespace wfrest;
+
+// Many concurrent small random reads, default backend (Linux aio) against io_uring. Linux only.
+// usage : FileIO_bench [file_mb] [reads] [concurrency] [read_size]
+
+static void make_file(const std::string &path, size_t size)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    std::string block(1024 * 1024, 'x');
+    for (size_t written = 0; written < size; written += block.size())
+        fwrite(block.data(), 1, std::min(block.size(), size - written), f);
+    fclose(f);
+}
+
+static void bench(const char *name, int fd, size_t file_size, int reads, int concurrency, size_t read_size)
+{
+    WFFacilities::WaitGroup wait_group(reads);
+    std::atomic<int> started(0);
+    std::atomic<int> errors(0);
+    std::vector<void *> bufs(concurrency);
+    for (auto &buf : bufs)
+        buf = FileIO::alloc_buffer(read_size);
+
+    size_t blocks = file_size / read_size;
+    std::function<void (int)> next;
+    next = [&](int slot)
+    {
+        if (started++ >= reads)
+            return;
+        // per read, the generator is not thread safe
+        thread_local std::mt19937_64 rng(std::random_device{}());
+        off_t offset = static_cast<off_t>(rng() % blocks) * read_size;
+        FileIOTask *task = FileIO::create_pread_task(fd, bufs[slot], read_size, offset,
+            [&, slot](FileIOTask *task)
+            {
+                if (task->get_retval() != static_cast<long>(read_size))
+                    errors++;
+                next(slot);
+                wait_group.done();
+            });
+        task->start();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < concurrency; i++)
+        next(i);
+    wait_group.wait();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    fprintf(stderr, "%-10s : %10.0f reads/s  %8.1f MB/s  %d errors\n",
+            name, reads / sec, reads * read_size / sec / 1024 / 1024, errors.load());
+    for (auto buf : bufs)
+        FileIO::free_buffer(buf);
+}
+
+int main(int argc, char **argv)
+{
+    size_t file_mb = argc > 1 ? atoi(argv[1]) : 1024;
+    int reads = argc > 2 ? atoi(argv[2]) : 200000;
+    int concurrency = argc > 3 ? atoi(argv[3]) : 128;
+    size_t read_size = argc > 4 ? atoi(argv[4]) : 4096;
+
+    std::string path = "./fileio_bench.dat";
+    make_file(path, file_mb * 1024 * 1024);
+    // O_DIRECT would measure the disk, the page cache is what a busy server reads from
+    int fd = open(path.c_str(), O_RDONLY);
+    fprintf(stderr, "file %zu MB, %d reads of %zu bytes, %d in flight\n\n",
+            file_mb, reads, read_size, concurrency);
+
+    bench("default", fd, file_mb * 1024 * 1024, reads, concurrency, read_size);
+    if (FileIO::use_io_uring() == 0)
+        bench("io_uring", fd, file_mb * 1024 * 1024, reads, concurrency, read_size);
+    else
+        fprintf(stderr, "io_uring    : unavailable, errno %d\n", errno);
+
+    close(fd);
+    remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/WFTaskFactory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "wfrest/HttpServer.h"
+
+using namespace wfrest;
+
+// Large file throughput and memory of File() responses, Linux only (reads /proc).
+// usage : File_bench [file_mb] [requests] [concurrency]
+
+static const unsigned short k_port = 8888;
+
+// kB, "VmRSS" is the current resident set, "VmHWM" the peak.
+// VmRSS = RssAnon (heap) + RssFile (resident pages of mapped files) + RssShmem
+static long proc_status_kb(const char *key)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+    char line[256];
+    long value = -1;
+    size_t key_len = strlen(key);
+    while (fgets(line, sizeof line, f))
+    {
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == ':')
+        {
+            value = atol(line + key_len + 1);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+static void make_file(const std::string &path, size_t size)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    std::string block(1024 * 1024, 'x');
+    for (size_t written = 0; written < size; written += block.size())
+        fwrite(block.data(), 1, std::min(block.size(), size - written), f);
+    fclose(f);
+}
+
+static void bench(const char *name, const std::string &url, int requests, int concurrency)
+{
+    WFFacilities::WaitGroup wait_group(requests);
+    std::mutex mutex;
+    size_t total = 0;
+    long peak_rss = 0;
+    long peak_anon = 0;
+    long peak_file = 0;
+    std::function<void(WFHttpTask *)> callback;
+    std::atomic<int> started(0);
+
+    callback = [&](WFHttpTask *task)
+    {
+        const void *body;
+        size_t len = 0;
+        if (task->get_state() == WFT_STATE_SUCCESS)
+            task->get_resp()->get_parsed_body(&body, &len);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            total += len;
+            peak_rss = std::max(peak_rss, proc_status_kb("VmRSS"));
+            peak_anon = std::max(peak_anon, proc_status_kb("RssAnon"));
+            peak_file = std::max(peak_file, proc_status_kb("RssFile"));
+        }
+        // keep `concurrency` requests in flight
+        if (started++ < requests)
+            WFTaskFactory::create_http_task(url, 0, 0, callback)->start();
+        wait_group.done();
+    };
+
+    long rss_before = proc_status_kb("VmRSS");
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < concurrency && started++ < requests; i++)
+        WFTaskFactory::create_http_task(url, 0, 0, callback)->start();
+    wait_group.wait();
+    auto end = std::chrono::steady_clock::now();
+    double sec = std::chrono::duration<double>(end - start).count();
+
+    // The client holds the received bodies too, so compare the two rows,
+    // not the absolute numbers.
+    // Mapped pages the kernel may drop are in RssFile, they count in VmRSS all the same.
+    fprintf(stderr, "%-10s : %8.1f MB/s  rss before %7ld kB  peak %7ld kB (anon %7ld kB, file %7ld kB)\n",
+            name, total / sec / 1024 / 1024, rss_before, peak_rss, peak_anon, peak_file);
+}
+
+int main(int argc, char **argv)
+{
+    size_t file_mb = argc > 1 ? atoi(argv[1]) : 512;
+    int requests = argc > 2 ? atoi(argv[2]) : 16;
+    int concurrency = argc > 3 ? atoi(argv[3]) : 4;
+
+    std::string path = "./file_bench.dat";
+    make_file(path, file_mb * 1024 * 1024);
+
+    HttpServer svr;
+    svr.request_size_limit(1024 * 1024);
+
+    // streamed through the read windows (send_file of a large file)
+    svr.GET("/file", [&path](const HttpReq *, HttpResp *resp)
+    {
+        resp->File(path);
+    });
+
+    // the whole file mapped and given to writev(), as large files were before the windows
+    svr.GET("/mapped", [&path](const HttpReq *, HttpResp *resp)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        off_t size = lseek(fd, 0, SEEK_END);
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        resp->append_output_body_nocopy(addr, size);
+        task_of(resp)->add_callback([addr, size](HttpTask *) { munmap(addr, size); });
+    });
+
+    // what send_file used to do : the whole file in a heap buffer
+    svr.GET("/buffered", [&path](const HttpReq *, HttpResp *resp)
+    {
+        FILE *f = fopen(path.c_str(), "rb");
+        fseek(f, 0, SEEK_END);
+        size_t size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        void *buf = malloc(size);
+        size_t len = fread(buf, 1, size, f);
+        fclose(f);
+        resp->append_output_body_nocopy(buf, len);
+        task_of(resp)->add_callback([buf](HttpTask *) { free(buf); });
+    });
+
+    if (svr.start(k_port) != 0)
+    {
+        fprintf(stderr, "start server on %d failed\n", k_port);
+        return 1;
+    }
+    fprintf(stderr, "file %zu MB, %d requests, %d in flight\n\n", file_mb, requests, concurrency);
+
+    std::string base = "http://127.0.0.1:" + std::to_string(k_port);
+    bench("stream", base + "/file", requests, concurrency);
+    bench("mapped", base + "/mapped", requests, concurrency);
+    bench("buffered", base + "/buffered", requests, concurrency);
+
+    svr.stop();
+    remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include "wfrest/HttpContent.h"
+#include "wfrest/ErrorCode.h"
+
+using namespace wfrest;
+
+// The multipart parsers on a large body : the byte by byte state machine copying the parts
+// into a Form (parse_multipart), against the boundary search returning views (parse_view).
+// usage : MultiPart_bench [body_mb] [rounds]
+
+static std::string make_body(const std::string &boundary, size_t size, int parts)
+{
+    std::mt19937 rng(1);
+    std::string body;
+    size_t part_size = size / parts;
+    for (int i = 0; i < parts; i++)
+    {
+        body += "--" + boundary + "\r\n";
+        body += "Content-Disposition: form-data; name=\"file" + std::to_string(i) +
+                "\"; filename=\"file" + std::to_string(i) + ".bin\"\r\n";
+        body += "Content-Type: application/octet-stream\r\n\r\n";
+        // random bytes, as a compressed file : '\r' and '-' show up often
+        for (size_t j = 0; j < part_size; j++)
+            body.push_back(static_cast<char>(rng()));
+        body += "\r\n";
+    }
+    body += "--" + boundary + "--\r\n";
+    return body;
+}
+
+template<typename Fn>
+static void bench(const char *name, size_t body_size, int rounds, Fn &&fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t parts = 0;
+    for (int i = 0; i < rounds; i++)
+        parts += fn();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%-16s %8.2f ms/body %10.1f MB/s  parts %zu\n", name,
+            secs * 1000 / rounds, body_size * rounds / secs / 1024 / 1024, parts / rounds);
+}
+
+int main(int argc, char **argv)
+{
+    size_t body_mb = argc > 1 ? atoi(argv[1]) : 10;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    MultiPartForm multi_part;
+    multi_part.set_boundary(MultiPartForm::k_default_boundary);
+
+    for (int parts : { 1, 100 })
+    {
+        std::string body = make_body(MultiPartForm::k_default_boundary, body_mb * 1024 * 1024, parts);
+        fprintf(stderr, "%zu MB body, %d parts\n", body_mb, parts);
+
+        bench("parse_multipart", body.size(), rounds, [&]()
+        {
+            return multi_part.parse_multipart(body).size();
+        });
+        bench("parse_view", body.size(), rounds, [&]()
+        {
+            FormView form;
+            if (multi_part.parse_view(body, &form) != StatusOK)
+                fprintf(stderr, "parse_view error\n");
+            return form.size();
+        });
+    }
+    return 0;
+}
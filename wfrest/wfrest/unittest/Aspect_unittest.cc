@@ -0,0 +1,150 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/WFTaskFactory.h"
+#include "workflow/HttpUtil.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <string>
+#include "gtest/gtest.h"
+#include "wfrest/HttpServer.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+const unsigned short k_port = 8941;
+
+struct Reply
+{
+    int status = 0;
+    std::string body;
+};
+
+Reply get(const std::string &path, bool refuse)
+{
+    Reply reply;
+    WFFacilities::WaitGroup wait_group(1);
+    std::string url = "http://127.0.0.1:" + std::to_string(k_port) + path;
+    WFHttpTask *task = WFTaskFactory::create_http_task(url, 0, 0, [&](WFHttpTask *task)
+    {
+        if (task->get_state() == WFT_STATE_SUCCESS)
+        {
+            const void *body;
+            size_t len;
+            reply.status = atoi(task->get_resp()->get_status_code());
+            task->get_resp()->get_parsed_body(&body, &len);
+            reply.body.assign(static_cast<const char *>(body), len);
+        }
+        wait_group.done();
+    });
+    if (refuse)
+        task->get_req()->add_header_pair("X-Refuse", "1");
+    task->start();
+    wait_group.wait();
+    return reply;
+}
+
+struct RefuseAspect : public Aspect
+{
+    bool before(const HttpReq *req, HttpResp *resp) const override
+    {
+        if (!req->has_header("X-Refuse"))
+            return true;
+        resp->set_status(403);
+        resp->String("refused");
+        return false;
+    }
+
+    bool after(const HttpReq *req, HttpResp *resp) const override
+    { return true; }
+};
+
+// with X-Refuse, waits for a timer and never decides
+struct UndecidedAspect : public AsyncAspect
+{
+    void before(const HttpReq *req, HttpResp *resp, SeriesWork *series, AspectGate *gate) override
+    {
+        bool decide = !req->has_header("X-Refuse");
+        series->push_back(WFTaskFactory::create_timer_task(1000, [decide, resp, gate](WFTimerTask *)
+        {
+            if (!decide)
+            {
+                resp->String("undecided");
+                return;
+            }
+            gate->pass();
+        }));
+    }
+};
+
+std::atomic<int> g_handled{0};
+
+}  // namespace
+
+// a global aspect refusing a route without aspects of its own
+TEST(Aspect, global_refuses_plain_route)
+{
+    HttpServer svr;
+    svr.Use(RefuseAspect());
+    svr.GET("/plain", [](const HttpReq *, HttpResp *resp)
+    {
+        g_handled++;
+        resp->String("handled");
+    });
+    svr.GET("/compute", 1, [](const HttpReq *, HttpResp *resp)
+    {
+        g_handled++;
+        resp->String("handled");
+    });
+    svr.GET("/series", [](const HttpReq *, HttpResp *resp, SeriesWork *)
+    {
+        g_handled++;
+        resp->String("handled");
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    for (const char *path : { "/plain", "/compute", "/series" })
+    {
+        Reply reply = get(path, true);
+        EXPECT_EQ(reply.status, 403);
+        EXPECT_EQ(reply.body, "refused");
+    }
+    EXPECT_EQ(g_handled, 0);
+
+    for (const char *path : { "/plain", "/compute", "/series" })
+    {
+        Reply reply = get(path, false);
+        EXPECT_EQ(reply.status, 200);
+        EXPECT_EQ(reply.body, "handled");
+    }
+    EXPECT_EQ(g_handled, 3);
+
+    svr.stop();
+}
+
+// a series ending before the async aspect decides is refused
+TEST(Aspect, async_undecided_fails_closed)
+{
+    static std::atomic<int> handled{0};
+    HttpServer svr;
+    svr.UseAsync(new UndecidedAspect);
+    svr.GET("/plain", [](const HttpReq *, HttpResp *resp)
+    {
+        handled++;
+        resp->String("handled");
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    Reply reply = get("/plain", true);
+    EXPECT_EQ(reply.status, 500);
+    EXPECT_EQ(reply.body.find("undecided"), std::string::npos);
+    EXPECT_EQ(handled, 0);
+
+    reply = get("/plain", false);
+    EXPECT_EQ(reply.status, 200);
+    EXPECT_EQ(reply.body, "handled");
+    EXPECT_EQ(handled, 1);
+
+    svr.stop();
+}
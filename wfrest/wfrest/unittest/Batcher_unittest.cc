@@ -0,0 +1,132 @@
+#include "workflow/WFFacilities.h"
+
+#include <atomic>
+#include <vector>
+#include "gtest/gtest.h"
+#include "wfrest/Batcher.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+std::atomic<int> g_calls{0};
+
+void twice(std::vector<int> &inputs, std::vector<int> *outputs)
+{
+    g_calls++;
+    for (size_t i = 0; i < inputs.size(); i++)
+        (*outputs)[i] = inputs[i] * 2;
+}
+
+// n items, each in a series of its own, their outputs in results
+void run(Batcher<int, int> *batcher, int n, std::vector<int> *results)
+{
+    results->assign(n, -1);
+    WFFacilities::WaitGroup wait_group(n);
+    for (int i = 0; i < n; i++)
+    {
+        WFCounterTask *task = batcher->create_task(i, [results, i, &wait_group](int *out)
+        {
+            if (out)
+                (*results)[i] = *out;
+            wait_group.done();
+        });
+        task->start();
+    }
+    wait_group.wait();
+}
+
+}  // namespace
+
+TEST(Batcher, max_items)
+{
+    BatcherOptions options;
+    options.max_items = 4;
+    options.max_wait_us = 10 * 1000 * 1000;
+    // static, its timer may fire after the test
+    static Batcher<int, int> batcher(options, twice);
+    std::vector<int> results;
+
+    g_calls = 0;
+    run(&batcher, 8, &results);
+    for (int i = 0; i < 8; i++)
+        EXPECT_EQ(results[i], i * 2);
+    EXPECT_EQ(g_calls, 2);
+
+    BatcherStats stats = batcher.stats();
+    EXPECT_EQ(stats.batches, 2);
+    EXPECT_EQ(stats.items, 8);
+    EXPECT_EQ(stats.max_batch_size, 4);
+    EXPECT_EQ(stats.rejected, 0);
+}
+
+TEST(Batcher, max_wait)
+{
+    BatcherOptions options;
+    options.max_items = 100;
+    options.max_wait_us = 20 * 1000;
+    // static, its timer may fire after the test
+    static Batcher<int, int> batcher(options, twice);
+    std::vector<int> results;
+
+    g_calls = 0;
+    run(&batcher, 3, &results);
+    for (int i = 0; i < 3; i++)
+        EXPECT_EQ(results[i], i * 2);
+    EXPECT_EQ(g_calls, 1);
+
+    BatcherStats stats = batcher.stats();
+    EXPECT_EQ(stats.batches, 1);
+    EXPECT_EQ(stats.max_batch_size, 3);
+    // the first item waited for the timer
+    EXPECT_GE(stats.max_wait_us, 10 * 1000);
+}
+
+TEST(Batcher, flush)
+{
+    BatcherOptions options;
+    options.max_items = 100;
+    options.max_wait_us = 10 * 1000 * 1000;
+    // static, its timer may fire after the test
+    static Batcher<int, int> batcher(options, twice);
+    WFFacilities::WaitGroup wait_group(2);
+    int results[2] = { -1, -1 };
+
+    for (int i = 0; i < 2; i++)
+    {
+        batcher.create_task(i + 1, [&results, i, &wait_group](int *out)
+        {
+            results[i] = out ? *out : 0;
+            wait_group.done();
+        })->start();
+    }
+    batcher.flush();
+    wait_group.wait();
+    EXPECT_EQ(results[0], 2);
+    EXPECT_EQ(results[1], 4);
+    EXPECT_EQ(batcher.stats().batches, 1);
+}
+
+TEST(Batcher, rejected)
+{
+    ComputePoolOptions pool_options;
+    pool_options.max_queued = 1;
+    ComputePool *pool = ComputePool::configure(200, pool_options);
+    // the queue of the pool is full
+    WFGoTask *pending = pool->create_go_task([] {});
+    ASSERT_TRUE(pending != nullptr);
+
+    BatcherOptions options;
+    options.max_items = 2;
+    options.compute_queue_id = 200;
+    // static, its timer may fire after the test
+    static Batcher<int, int> batcher(options, twice);
+    std::vector<int> results;
+
+    run(&batcher, 2, &results);
+    EXPECT_EQ(results[0], -1);
+    EXPECT_EQ(results[1], -1);
+    EXPECT_EQ(batcher.stats().rejected, 1);
+    pending->dismiss();
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "wfrest/Compress.h"
+#include "wfrest/ErrorCode.h"
 
 using namespace wfrest;
 
@@ -26,6 +27,63 @@ TEST(gzip, longText)
     EXPECT_EQ(str, decompress_str);
 }
 
+TEST(gzip, sizeLimit)
+{
+    // 10 MB of zeros compresses to about 10 KB
+    std::string str(10 * 1024 * 1024, '\0');
+    std::string compress_str;
+    EXPECT_EQ(Compressor::gzip(str.c_str(), str.size(), &compress_str), StatusOK);
+
+    std::string decompress_str;
+    int ret = Compressor::ungzip(compress_str.c_str(), compress_str.size(), 
+                                 &decompress_str, 1024 * 1024);
+    EXPECT_EQ(ret, StatusUncompressTooLarge);
+    EXPECT_TRUE(decompress_str.empty());
+
+    ret = Compressor::ungzip(compress_str.c_str(), compress_str.size(), 
+                             &decompress_str, str.size());
+    EXPECT_EQ(ret, StatusOK);
+    EXPECT_EQ(str, decompress_str);
+}
+
+TEST(gzip, truncated)
+{
+    std::string str = "WFREST compress : Just for test....";
+    std::string compress_str;
+    EXPECT_EQ(Compressor::gzip(str.c_str(), str.size(), &compress_str), StatusOK);
+
+    std::string decompress_str;
+    int ret = Compressor::ungzip(compress_str.c_str(), compress_str.size() / 2, 
+                                 &decompress_str, 1024);
+    EXPECT_EQ(ret, StatusUncompressError);
+}
+
+TEST(deflate, zlibAndRaw)
+{
+    std::string str;
+    for (size_t i = 0; i < 10000; i++)
+    {
+        str.append(std::to_string(i));
+    }
+    std::string zlib_str(compressBound(str.size()), '\0');
+    uLongf zlib_len = zlib_str.size();
+    ASSERT_EQ(compress(reinterpret_cast<Bytef *>(&zlib_str[0]), &zlib_len, 
+                       reinterpret_cast<const Bytef *>(str.data()), str.size()), Z_OK);
+    zlib_str.resize(zlib_len);
+
+    std::string decompress_str;
+    EXPECT_EQ(Compressor::undeflate(zlib_str.c_str(), zlib_str.size(), &decompress_str), StatusOK);
+    EXPECT_EQ(str, decompress_str);
+
+    // strip the 2 bytes zlib header and the 4 bytes adler32 trailer
+    std::string raw_str = zlib_str.substr(2, zlib_str.size() - 6);
+    EXPECT_EQ(Compressor::undeflate(raw_str.c_str(), raw_str.size(), &decompress_str), StatusOK);
+    EXPECT_EQ(str, decompress_str);
+
+    EXPECT_EQ(Compressor::undeflate(zlib_str.c_str(), zlib_str.size(), &decompress_str, 100), 
+              StatusUncompressTooLarge);
+}
+
 
 #ifdef USE_BROTLI
 TEST(brotli, shortText)
@@ -51,6 +109,74 @@ TEST(brotli, longText)
             = Compressor::unbrotli(compress_str.c_str(), compress_str.size());
     EXPECT_EQ(str, decompress_str);
 }
+
+TEST(brotli, sizeLimit)
+{
+    std::string str(10 * 1024 * 1024, 'a');
+    std::string compress_str;
+    EXPECT_EQ(Compressor::brotli(str.c_str(), str.size(), &compress_str), StatusOK);
+
+    std::string decompress_str;
+    int ret = Compressor::unbrotli(compress_str.c_str(), compress_str.size(), 
+                                   &decompress_str, 1024 * 1024);
+    EXPECT_EQ(ret, StatusUncompressTooLarge);
+
+    ret = Compressor::unbrotli(compress_str.c_str(), compress_str.size(), 
+                               &decompress_str, str.size());
+    EXPECT_EQ(ret, StatusOK);
+    EXPECT_EQ(str, decompress_str);
+}
+#endif
+
+#ifdef USE_ZSTD
+TEST(zstd, shortText)
+{
+    std::string str = "WFREST compress : Just for test....";
+    std::string compress_str;
+    int ret = Compressor::zstd(str.c_str(), str.size(), &compress_str);
+    EXPECT_EQ(ret, StatusOK);
+    EXPECT_TRUE(compress_str.empty() == false);
+    std::string decompress_str;
+    ret = Compressor::unzstd(compress_str.c_str(), compress_str.size(), &decompress_str);
+    EXPECT_EQ(ret, StatusOK);
+    EXPECT_EQ(str, decompress_str);
+}
+
+TEST(zstd, dictionary)
+{
+    std::vector<std::string> samples;
+    for (size_t i = 0; i < 1000; i++)
+    {
+        samples.push_back(R"({"id":)" + std::to_string(i) + 
+                          R"(,"name":"user)" + std::to_string(i * 7) + 
+                          R"(","email":"user@example.com","active":true,"roles":["reader","writer"]})");
+    }
+    std::string dict;
+    int ret = Compressor::zstd_train_dict(samples, 4096, &dict);
+    ASSERT_EQ(ret, StatusOK);
+
+    unsigned int dict_id = 0;
+    ret = Compressor::zstd_load_dict(dict.data(), dict.size(), &dict_id);
+    ASSERT_EQ(ret, StatusOK);
+    EXPECT_NE(dict_id, 0u);
+
+    EXPECT_EQ(Compressor::zstd_negotiate_dict("1, " + std::to_string(dict_id)), dict_id);
+    EXPECT_EQ(Compressor::zstd_negotiate_dict("1, 2"), 0u);
+    EXPECT_EQ(Compressor::zstd_negotiate_dict(""), 0u);
+
+    const std::string &str = samples[42];
+    std::string plain_str;
+    std::string dict_str;
+    Compressor::zstd(str.c_str(), str.size(), &plain_str);
+    ret = Compressor::zstd(str.c_str(), str.size(), &dict_str, dict_id);
+    EXPECT_EQ(ret, StatusOK);
+    EXPECT_LT(dict_str.size(), plain_str.size());
+
+    std::string decompress_str;
+    ret = Compressor::unzstd(&dict_str, &decompress_str);
+    EXPECT_EQ(ret, StatusOK);
+    EXPECT_EQ(str, decompress_str);
+}
 #endif
 
 int main(int argc, char **argv) {
@@ -0,0 +1,132 @@
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include "gtest/gtest.h"
+#include "wfrest/ComputePool.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+struct Concurrency
+{
+    std::atomic<int> now{0};
+    std::atomic<int> max{0};
+
+    void enter()
+    {
+        int n = ++now;
+        int m = max;
+        while (n > m && !max.compare_exchange_weak(m, n))
+            ;
+    }
+
+    void leave()
+    {
+        --now;
+    }
+};
+
+void run(ComputePool *pool, Concurrency *concurrency, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        WFGoTask *task = pool->create_go_task([concurrency]
+        {
+            concurrency->enter();
+            usleep(20 * 1000);
+            concurrency->leave();
+        });
+        ASSERT_TRUE(task != nullptr);
+        task->start();
+    }
+}
+
+void wait_completed(ComputePool *pool, size_t n)
+{
+    for (int i = 0; i < 5000 && pool->stats().completed < n; i++)
+        usleep(1000);
+}
+
+}  // namespace
+
+TEST(ComputePool, get)
+{
+    EXPECT_EQ(ComputePool::get(1), ComputePool::get(1));
+    EXPECT_NE(ComputePool::get(1), ComputePool::get(2));
+    EXPECT_EQ(ComputePool::get(1)->name(), "wfrest1");
+}
+
+TEST(ComputePool, max_queued)
+{
+    ComputePoolOptions options;
+    options.max_queued = 2;
+    ComputePool *pool = ComputePool::configure(100, options);
+
+    WFGoTask *first = pool->create_go_task([] {});
+    WFGoTask *second = pool->create_go_task([] {});
+    ASSERT_TRUE(first != nullptr);
+    ASSERT_TRUE(second != nullptr);
+    EXPECT_TRUE(pool->create_go_task([] {}) == nullptr);
+    EXPECT_EQ(pool->stats().queued, 2);
+    EXPECT_EQ(pool->stats().rejected, 1);
+
+    first->dismiss();
+    WFGoTask *third = pool->create_go_task([] {});
+    ASSERT_TRUE(third != nullptr);
+    second->dismiss();
+    third->dismiss();
+    EXPECT_EQ(pool->stats().queued, 0);
+}
+
+TEST(ComputePool, max_running)
+{
+    ComputePoolOptions options;
+    options.max_running = 2;
+    ComputePool *pool = ComputePool::configure(101, options);
+    Concurrency concurrency;
+
+    run(pool, &concurrency, 8);
+    wait_completed(pool, 8);
+    EXPECT_EQ(pool->stats().completed, 8);
+    EXPECT_LE(concurrency.max, 2);
+}
+
+TEST(ComputePool, threads)
+{
+    ComputePoolOptions options;
+    options.threads = 3;
+    ComputePool *pool = ComputePool::configure(102, options);
+    Concurrency concurrency;
+
+    run(pool, &concurrency, 9);
+    wait_completed(pool, 9);
+    EXPECT_EQ(pool->stats().completed, 9);
+    EXPECT_LE(concurrency.max, 3);
+}
+
+TEST(ComputePool, batch)
+{
+    ComputePoolOptions options;
+    options.priority = ComputePriority::BATCH;
+    ComputePool *report = ComputePool::configure(103, options);
+    ComputePool *export_ = ComputePool::configure(104, options);
+    ComputePool *login = ComputePool::get(105);
+    ComputePool::set_batch_limit(1);
+    Concurrency batch;
+    Concurrency interactive;
+
+    run(report, &batch, 4);
+    run(export_, &batch, 4);
+    run(login, &interactive, 2);
+    // login does not wait for the batch tasks
+    wait_completed(login, 2);
+    EXPECT_EQ(login->stats().completed, 2);
+    EXPECT_LT(report->stats().completed + export_->stats().completed, 8);
+
+    wait_completed(report, 4);
+    wait_completed(export_, 4);
+    EXPECT_EQ(report->stats().completed + export_->stats().completed, 8);
+    EXPECT_EQ(batch.max, 1);
+}
@@ -0,0 +1,91 @@
+#include "gtest/gtest.h"
+#include "wfrest/ConcurrencyLimiter.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+ConcurrencyLimitOptions window_options()
+{
+    ConcurrencyLimitOptions options;
+    options.initial_limit = 100;
+    options.min_limit = 10;
+    options.max_limit = 1000;
+    options.window_ms = 0;
+    options.window_samples = 10;
+    return options;
+}
+
+// the limit of requests in flight, all answered in latency_us
+void saturate(ConcurrencyLimiter *limiter, int64_t latency_us)
+{
+    size_t n = 0;
+    while (limiter->try_acquire())
+        n++;
+    for (size_t i = 0; i < n; i++)
+        limiter->release(latency_us);
+}
+
+}  // namespace
+
+TEST(ConcurrencyLimiter, fixed)
+{
+    ConcurrencyLimitOptions options;
+    options.initial_limit = 2;
+    options.adaptive = false;
+    ConcurrencyLimiter limiter(options);
+
+    EXPECT_TRUE(limiter.try_acquire());
+    EXPECT_TRUE(limiter.try_acquire());
+    EXPECT_FALSE(limiter.try_acquire());
+    limiter.release(1000);
+    EXPECT_TRUE(limiter.try_acquire());
+
+    ConcurrencyLimiterStats stats = limiter.stats();
+    EXPECT_EQ(stats.limit, 2);
+    EXPECT_EQ(stats.inflight, 2);
+    EXPECT_EQ(stats.accepted, 3);
+    EXPECT_EQ(stats.rejected, 1);
+}
+
+TEST(ConcurrencyLimiter, grows)
+{
+    ConcurrencyLimiter limiter(window_options());
+    for (int i = 0; i < 10; i++)
+        saturate(&limiter, 1000);
+    EXPECT_GT(limiter.limit(), 100);
+    EXPECT_EQ(limiter.stats().long_latency_us, 1000);
+    EXPECT_EQ(limiter.stats().inflight, 0);
+}
+
+TEST(ConcurrencyLimiter, queueing)
+{
+    ConcurrencyLimiter limiter(window_options());
+    for (int i = 0; i < 10; i++)
+        saturate(&limiter, 1000);
+    size_t limit = limiter.limit();
+
+    // latency ten times the usual
+    saturate(&limiter, 10000);
+    EXPECT_LT(limiter.limit(), limit);
+    limit = limiter.limit();
+
+    // and getting worse
+    for (int i = 0; i < 5; i++)
+        saturate(&limiter, 100000);
+    EXPECT_LT(limiter.limit(), limit);
+    EXPECT_GE(limiter.limit(), 10);
+}
+
+TEST(ConcurrencyLimiter, app_limited)
+{
+    ConcurrencyLimiter limiter(window_options());
+    // never more than one in flight, the limit is not what holds them back
+    for (int i = 0; i < 100; i++)
+    {
+        ASSERT_TRUE(limiter.try_acquire());
+        limiter.release(1000);
+    }
+    EXPECT_EQ(limiter.limit(), 100);
+}
@@ -0,0 +1,51 @@
+#include <unistd.h>
+#include "gtest/gtest.h"
+#include "wfrest/Deadline.h"
+#include "wfrest/HttpMsg.h"
+
+using namespace wfrest;
+
+TEST(Deadline, none)
+{
+    HttpReq req;
+    req.mark_received();
+    EXPECT_FALSE(req.has_deadline());
+    EXPECT_FALSE(req.expired());
+}
+
+TEST(Deadline, budget)
+{
+    HttpReq req;
+    req.mark_received();
+    req.set_budget(1000);
+    EXPECT_TRUE(req.has_deadline());
+    EXPECT_EQ(req.deadline(), req.receive_time() + 1000);
+    EXPECT_GT(req.remaining_ms(), 0);
+    EXPECT_LE(req.remaining_ms(), 1000);
+
+    // the earliest wins
+    req.set_budget(5000);
+    EXPECT_EQ(req.deadline(), req.receive_time() + 1000);
+    req.set_budget(20);
+    EXPECT_EQ(req.deadline(), req.receive_time() + 20);
+
+    usleep(30 * 1000);
+    EXPECT_TRUE(req.expired());
+    EXPECT_LE(req.remaining_ms(), 0);
+}
+
+TEST(Deadline, aspect)
+{
+    HttpReq req;
+    HttpResp resp;
+    req.mark_received();
+    req.set_budget(1000);
+
+    DeadlineAspect route_budget(100);
+    EXPECT_TRUE(route_budget.before(&req, &resp));
+    EXPECT_EQ(req.deadline(), req.receive_time() + 100);
+
+    DeadlineAspect longer(2000);
+    EXPECT_TRUE(longer.before(&req, &resp));
+    EXPECT_EQ(req.deadline(), req.receive_time() + 100);
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "wfrest/HttpContent.h"
+#include "wfrest/ErrorCode.h"
 
 using namespace wfrest;
 
@@ -8,9 +9,107 @@ TEST(Urlencode, parse_post_kv)
     
 }
 
+static const char *k_boundary = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+
+TEST(MultiPartForm, parse_view)
+{
+    std::string body = "--" + std::string(k_boundary) + "\r\n"
+        "Content-Disposition: form-data; name=\"key\"\r\n"
+        "\r\n"
+        "value\r\n"
+        "--" + std::string(k_boundary) + "\r\n"
+        "Content-Disposition: form-data; name=\"file\"; filename=\"a;b=c.txt\"\r\n"
+        "Content-Type: text/plain\r\n"
+        "\r\n"
+        "line 1\r\n--not the boundary\r\n\r\n"
+        "--" + std::string(k_boundary) + "--\r\n";
+
+    MultiPartForm multi_part;
+    multi_part.set_boundary(k_boundary);
+    FormView form;
+    EXPECT_EQ(multi_part.parse_view(body, &form), StatusOK);
+    ASSERT_EQ(form.size(), 2);
+
+    const FormPart *key = form.get("key");
+    ASSERT_NE(key, nullptr);
+    EXPECT_EQ(key->data.as_string(), "value");
+    EXPECT_FALSE(key->is_file());
+
+    const FormPart *file = form.get("file");
+    ASSERT_NE(file, nullptr);
+    EXPECT_EQ(file->filename.as_string(), "a;b=c.txt");
+    EXPECT_EQ(file->content_type.as_string(), "text/plain");
+    EXPECT_EQ(file->data.as_string(), "line 1\r\n--not the boundary\r\n");
+    // views into the body
+    EXPECT_GE(file->data.data(), body.data());
+    EXPECT_LE(file->data.end(), body.data() + body.size());
+}
+
+TEST(MultiPartForm, binary_data)
+{
+    std::string data;
+    for (int i = 0; i < 100000; i++)
+        data.push_back(static_cast<char>(i * 7 % 256));
+    data += "\r\n--";
+    data += std::string(k_boundary).substr(0, 20);
+
+    std::string body = "preamble\r\n--" + std::string(k_boundary) + "\r\n"
+        "Content-Disposition: form-data; name=\"bin\"; filename=\"bin\"\r\n"
+        "\r\n" + data + "\r\n--" + k_boundary + "--";
+
+    MultiPartForm multi_part;
+    multi_part.set_boundary(k_boundary);
+    FormView form;
+    EXPECT_EQ(multi_part.parse_view(body, &form), StatusOK);
+    ASSERT_EQ(form.size(), 1);
+    EXPECT_EQ(form.get("bin")->data.as_string(), data);
+}
+
+TEST(MultiPartForm, to_form)
+{
+    std::string body = "--" + std::string(k_boundary) + "\r\n"
+        "Content-Disposition: form-data; name=\"key\"\r\n"
+        "\r\n"
+        "value\r\n"
+        "--" + std::string(k_boundary) + "\r\n"
+        "Content-Disposition: form-data; name=\"file\"; filename=\"user.jpg\"\r\n"
+        "Content-Type: image/jpeg\r\n"
+        "\r\n"
+        "jpeg\r\n"
+        "--" + std::string(k_boundary) + "--\r\n";
+
+    MultiPartForm multi_part;
+    multi_part.set_boundary(k_boundary);
+    FormView form;
+    EXPECT_EQ(multi_part.parse_view(body, &form), StatusOK);
+    EXPECT_EQ(form.to_form(), multi_part.parse_multipart(body));
+}
+
+TEST(MultiPartForm, invalid)
+{
+    std::string body = "--" + std::string(k_boundary) + "\r\n"
+        "Content-Disposition: form-data; name=\"key\"\r\n"
+        "\r\n"
+        "value\r\n"
+        "--" + std::string(k_boundary) + "\r\n"
+        "Content-Disposition: form-data; name=\"cut\"\r\n"
+        "\r\n"
+        "no end";
+
+    MultiPartForm multi_part;
+    multi_part.set_boundary(k_boundary);
+    FormView form;
+    EXPECT_EQ(multi_part.parse_view(body, &form), StatusMultiPartInvalid);
+    // the parts before the error
+    ASSERT_EQ(form.size(), 1);
+    EXPECT_EQ(form.get("key")->data.as_string(), "value");
+
+    form.clear();
+    EXPECT_EQ(multi_part.parse_view("no boundary at all", &form), StatusMultiPartInvalid);
+    EXPECT_TRUE(form.empty());
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
-
-
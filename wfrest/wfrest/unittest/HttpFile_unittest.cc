@@ -0,0 +1,795 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/WFTaskFactory.h"
+#include "workflow/HttpUtil.h"
+
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "wfrest/HttpServer.h"
+#include "wfrest/HttpFile.h"
+#include "wfrest/HttpContent.h"
+#include "wfrest/ErrorCode.h"
+#include "wfrest/StrUtil.h"
+#include "wfrest/ZipWriter.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+const unsigned short k_port = 8944;
+
+struct Reply
+{
+    int status = 0;
+    std::string connection;
+    std::string content_encoding;
+    std::map<std::string, std::string, MapStringCaseLess> headers;
+    std::string body;
+};
+
+// GET path, with the request header name if not empty
+Reply get(const std::string &path, const std::string &name, const std::string &value)
+{
+    Reply reply;
+    WFFacilities::WaitGroup wait_group(1);
+    std::string url = "http://127.0.0.1:" + std::to_string(k_port) + path;
+    WFHttpTask *task = WFTaskFactory::create_http_task(url, 0, 0, [&](WFHttpTask *task)
+    {
+        if (task->get_state() == WFT_STATE_SUCCESS)
+        {
+            const void *body;
+            size_t len;
+            std::string name, value;
+            reply.status = atoi(task->get_resp()->get_status_code());
+            protocol::HttpHeaderCursor cursor(task->get_resp());
+            while (cursor.next(name, value))
+                reply.headers[name] = value;
+            reply.connection = reply.headers["Connection"];
+            reply.content_encoding = reply.headers["Content-Encoding"];
+            task->get_resp()->get_parsed_body(&body, &len);
+            reply.body.assign(static_cast<const char *>(body), len);
+        }
+        wait_group.done();
+    });
+    if (!name.empty())
+        task->get_req()->add_header_pair(name, value);
+    task->start();
+    wait_group.wait();
+    return reply;
+}
+
+void write_file(const std::string &path, const std::string &content)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(f != NULL);
+    ASSERT_EQ(fwrite(content.data(), 1, content.size(), f), content.size());
+    fclose(f);
+}
+
+bool file_exists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+std::string read_file(const std::string &path)
+{
+    std::string content;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+        return content;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+        content.append(buf, n);
+    fclose(f);
+    return content;
+}
+
+// the temporary files of the saves left in dir
+std::vector<std::string> tmp_files(const std::string &dir)
+{
+    std::vector<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL)
+        return names;
+    while (struct dirent *entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+            names.push_back(name);
+    }
+    closedir(d);
+    return names;
+}
+
+// self signed certificate of the TLS server
+bool write_cert(const std::string &cert_path, const std::string &key_path)
+{
+    EVP_PKEY *pkey = EVP_PKEY_new();
+    RSA *rsa = RSA_new();
+    BIGNUM *e = BN_new();
+    X509 *x509 = X509_new();
+    bool ok = false;
+    BN_set_word(e, RSA_F4);
+    if (RSA_generate_key_ex(rsa, 2048, e, nullptr) == 1 && EVP_PKEY_assign_RSA(pkey, rsa) == 1)
+    {
+        rsa = nullptr;
+        ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+        X509_gmtime_adj(X509_get_notBefore(x509), 0);
+        X509_gmtime_adj(X509_get_notAfter(x509), 3600);
+        X509_set_pubkey(x509, pkey);
+        X509_NAME *name = X509_get_subject_name(x509);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char *>("127.0.0.1"), -1, -1, 0);
+        X509_set_issuer_name(x509, name);
+        if (X509_sign(x509, pkey, EVP_sha256()) > 0)
+        {
+            FILE *cert = fopen(cert_path.c_str(), "wb");
+            FILE *key = fopen(key_path.c_str(), "wb");
+            ok = cert && key && PEM_write_X509(cert, x509) == 1 &&
+                 PEM_write_PrivateKey(key, pkey, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+            if (cert) fclose(cert);
+            if (key) fclose(key);
+        }
+    }
+    X509_free(x509);
+    BN_free(e);
+    RSA_free(rsa);
+    EVP_PKEY_free(pkey);
+    return ok;
+}
+
+std::string dechunk(const std::string &body)
+{
+    std::string out;
+    size_t pos = 0;
+    while (pos < body.size())
+    {
+        size_t eol = body.find("\r\n", pos);
+        if (eol == std::string::npos)
+            break;
+        size_t len = strtoul(body.c_str() + pos, nullptr, 16);
+        if (len == 0)
+            break;
+        out.append(body, eol + 2, len);
+        pos = eol + 2 + len + 2;
+    }
+    return out;
+}
+
+// GET path over TLS with a small receive buffer, reading slowly at first :
+// the server fills the socket and has to wait for it to drain.
+Reply tls_get(const std::string &path, const std::string &name, const std::string &value)
+{
+    Reply reply;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 4096;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(k_port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL *ssl = SSL_new(ctx);
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0 &&
+        SSL_set_fd(ssl, fd) == 1 && SSL_connect(ssl) == 1)
+    {
+        std::string req = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n";
+        if (!name.empty())
+            req += name + ": " + value + "\r\n";
+        req += "\r\n";
+        SSL_write(ssl, req.data(), static_cast<int>(req.size()));
+
+        std::string raw;
+        char buf[4096];
+        int ret;
+        for (int i = 0; (ret = SSL_read(ssl, buf, sizeof buf)) > 0; i++)
+        {
+            raw.append(buf, ret);
+            if (i < 200)
+                usleep(1000);
+        }
+
+        size_t header_end = raw.find("\r\n\r\n");
+        if (header_end != std::string::npos)
+        {
+            reply.status = atoi(raw.c_str() + raw.find(' ') + 1);
+            size_t pos = raw.find("\r\n") + 2;
+            while (pos < header_end)
+            {
+                size_t eol = raw.find("\r\n", pos);
+                size_t colon = raw.find(':', pos);
+                if (colon < eol)
+                    reply.headers[raw.substr(pos, colon - pos)] = raw.substr(colon + 2, eol - colon - 2);
+                pos = eol + 2;
+            }
+            reply.connection = reply.headers["Connection"];
+            reply.content_encoding = reply.headers["Content-Encoding"];
+            reply.body = raw.substr(header_end + 4);
+            if (strcasecmp(reply.headers["Transfer-Encoding"].c_str(), "chunked") == 0)
+                reply.body = dechunk(reply.body);
+        }
+    }
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    close(fd);
+    return reply;
+}
+
+// the parts of a streamed multipart/form-data reply, in order
+void expect_multipart(const Reply &reply, const std::string &boundary,
+                      const std::vector<std::pair<std::string, std::string>> &params,
+                      const std::vector<std::pair<std::string, std::string>> &files)
+{
+    EXPECT_EQ(reply.status, 200);
+    auto it = reply.headers.find("Content-Length");
+    ASSERT_TRUE(it != reply.headers.end());
+    EXPECT_EQ(it->second, std::to_string(reply.body.size()));
+    it = reply.headers.find("Content-Type");
+    ASSERT_TRUE(it != reply.headers.end());
+    EXPECT_EQ(it->second, "multipart/form-data; boundary=" + boundary);
+
+    MultiPartForm parser;
+    parser.set_boundary(boundary);
+    FormView form;
+    ASSERT_EQ(parser.parse_view(reply.body, &form), StatusOK);
+    ASSERT_EQ(form.size(), params.size() + files.size());
+    auto part = form.begin();
+    for (const auto &param : params)
+    {
+        EXPECT_EQ(part->name.as_string(), param.first);
+        EXPECT_FALSE(part->is_file());
+        EXPECT_EQ(part->data.as_string(), param.second);
+        ++part;
+    }
+    for (const auto &file : files)
+    {
+        EXPECT_EQ(part->filename.as_string(), file.first);
+        EXPECT_TRUE(part->data.as_string() == file.second);
+        ++part;
+    }
+    // nothing after the close delimiter
+    EXPECT_EQ(reply.body.compare(reply.body.size() - boundary.size() - 6, std::string::npos,
+                                 "\r\n--" + boundary + "--\r\n"), 0);
+}
+
+}  // namespace
+
+TEST(HttpFile, parse_range_single)
+{
+    std::vector<ByteRange> ranges;
+    EXPECT_EQ(HttpFile::parse_range("bytes=0-499", 1000, ranges), StatusOK);
+    ASSERT_EQ(ranges.size(), 1);
+    EXPECT_EQ(ranges[0].start, 0);
+    EXPECT_EQ(ranges[0].end, 500);
+
+    // open ended and suffix
+    EXPECT_EQ(HttpFile::parse_range("bytes=900-", 1000, ranges), StatusOK);
+    ASSERT_EQ(ranges.size(), 1);
+    EXPECT_EQ(ranges[0].start, 900);
+    EXPECT_EQ(ranges[0].end, 1000);
+
+    EXPECT_EQ(HttpFile::parse_range("bytes=-100", 1000, ranges), StatusOK);
+    ASSERT_EQ(ranges.size(), 1);
+    EXPECT_EQ(ranges[0].start, 900);
+    EXPECT_EQ(ranges[0].end, 1000);
+
+    // clamped to the file
+    EXPECT_EQ(HttpFile::parse_range("bytes=-5000", 1000, ranges), StatusOK);
+    ASSERT_EQ(ranges.size(), 1);
+    EXPECT_EQ(ranges[0].start, 0);
+    EXPECT_EQ(ranges[0].end, 1000);
+
+    EXPECT_EQ(HttpFile::parse_range("bytes=500-5000", 1000, ranges), StatusOK);
+    ASSERT_EQ(ranges.size(), 1);
+    EXPECT_EQ(ranges[0].end, 1000);
+}
+
+TEST(HttpFile, parse_range_multi)
+{
+    std::vector<ByteRange> ranges;
+    EXPECT_EQ(HttpFile::parse_range("bytes=500-599, 0-99", 1000, ranges), StatusOK);
+    ASSERT_EQ(ranges.size(), 2);
+    EXPECT_EQ(ranges[0].start, 0);
+    EXPECT_EQ(ranges[0].end, 100);
+    EXPECT_EQ(ranges[1].start, 500);
+    EXPECT_EQ(ranges[1].end, 600);
+
+    // overlapping and adjacent ranges are coalesced
+    EXPECT_EQ(HttpFile::parse_range("bytes=0-99,100-199,150-299", 1000, ranges), StatusOK);
+    ASSERT_EQ(ranges.size(), 1);
+    EXPECT_EQ(ranges[0].start, 0);
+    EXPECT_EQ(ranges[0].end, 300);
+
+    // unsatisfiable ones are dropped
+    EXPECT_EQ(HttpFile::parse_range("bytes=0-9,2000-", 1000, ranges), StatusOK);
+    ASSERT_EQ(ranges.size(), 1);
+}
+
+TEST(HttpFile, parse_range_ignored)
+{
+    std::vector<ByteRange> ranges;
+    EXPECT_EQ(HttpFile::parse_range("", 1000, ranges), StatusOK);
+    EXPECT_TRUE(ranges.empty());
+    EXPECT_EQ(HttpFile::parse_range("items=0-9", 1000, ranges), StatusOK);
+    EXPECT_TRUE(ranges.empty());
+    EXPECT_EQ(HttpFile::parse_range("bytes=9-0", 1000, ranges), StatusOK);
+    EXPECT_TRUE(ranges.empty());
+    EXPECT_EQ(HttpFile::parse_range("bytes=a-b", 1000, ranges), StatusOK);
+    EXPECT_TRUE(ranges.empty());
+    EXPECT_EQ(HttpFile::parse_range("bytes=-", 1000, ranges), StatusOK);
+    EXPECT_TRUE(ranges.empty());
+
+    std::string many = "bytes=";
+    for (size_t i = 0; i <= HttpFile::k_max_ranges; i++)
+        many += std::to_string(i * 10) + "-" + std::to_string(i * 10 + 1) + ",";
+    EXPECT_EQ(HttpFile::parse_range(many, 1000, ranges), StatusOK);
+    EXPECT_TRUE(ranges.empty());
+}
+
+TEST(HttpFile, parse_range_unsatisfiable)
+{
+    std::vector<ByteRange> ranges;
+    EXPECT_EQ(HttpFile::parse_range("bytes=1000-", 1000, ranges), StatusFileRangeInvalid);
+    EXPECT_EQ(HttpFile::parse_range("bytes=-0", 1000, ranges), StatusFileRangeInvalid);
+    EXPECT_EQ(HttpFile::parse_range("bytes=0-", 0, ranges), StatusFileRangeInvalid);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+// Files of a few windows are streamed, the windows come back in file order
+TEST(HttpFile, stream_large_file)
+{
+    std::string path = "./HttpFile_unittest.dat";
+    std::string content(3 * 1024 * 1024 + 123, '\0');
+    for (size_t i = 0; i < content.size(); i++)
+        content[i] = static_cast<char>(i * 31 % 251);
+    write_file(path, content);
+
+    HttpServer svr;
+    svr.GET("/file", [&path](const HttpReq *, HttpResp *resp)
+    {
+        resp->File(path);
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    Reply reply = get("/file", "", "");
+    EXPECT_EQ(reply.status, 200);
+    // set by the stream only, a failure half way can only close the connection
+    EXPECT_EQ(reply.connection, "close");
+    EXPECT_TRUE(reply.body == content);
+
+    reply = get("/file", "Range", "bytes=1000-2500000");
+    EXPECT_EQ(reply.status, 206);
+    EXPECT_EQ(reply.connection, "close");
+    EXPECT_TRUE(reply.body == content.substr(1000, 2500001 - 1000));
+
+    // below the windows, sent in one piece on a kept alive connection
+    reply = get("/file", "Range", "bytes=0-99999");
+    EXPECT_EQ(reply.status, 206);
+    EXPECT_NE(reply.connection, "close");
+    EXPECT_TRUE(reply.body == content.substr(0, 100000));
+
+    svr.stop();
+    remove(path.c_str());
+}
+
+// the first request is not held by the compression, the variant comes later
+TEST(HttpFile, precompress_in_background)
+{
+    std::string dir = "./HttpFile_unittest_static";
+    std::string path = dir + "/app.js";
+    mkdir(dir.c_str(), 0755);
+    std::string content;
+    for (int i = 0; i < 10000; i++)
+        content += "console.log(" + std::to_string(i) + ");\n";
+    write_file(path, content);
+    remove((path + ".gz").c_str());
+
+    HttpServer svr;
+    // no negative entry of app.js.gz to wait for
+    svr.open_file_cache_size(0);
+    StaticOptions options;
+    options.generate_precompressed = true;
+    options.cache = false;
+    svr.Static("/static", dir.c_str(), options);
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    Reply reply = get("/static/app.js", "Accept-Encoding", "gzip");
+    EXPECT_EQ(reply.status, 200);
+    EXPECT_TRUE(reply.content_encoding.empty());
+    EXPECT_TRUE(reply.body == content);
+
+    for (int i = 0; i < 500 && !file_exists(path + ".gz"); i++)
+        usleep(10 * 1000);
+    ASSERT_TRUE(file_exists(path + ".gz"));
+
+    reply = get("/static/app.js", "Accept-Encoding", "gzip");
+    EXPECT_EQ(reply.status, 200);
+    EXPECT_EQ(reply.content_encoding, "gzip");
+    EXPECT_LT(reply.body.size(), content.size());
+
+    svr.stop();
+    remove((path + ".gz").c_str());
+    remove(path.c_str());
+    rmdir(dir.c_str());
+}
+
+// Over TLS large files are read before they are sent, more than the socket holds at once
+TEST(HttpFile, stream_large_file_tls)
+{
+    std::string path = "./HttpFile_unittest_tls.dat";
+    std::string cert = "./HttpFile_unittest.crt";
+    std::string key = "./HttpFile_unittest.key";
+    ASSERT_TRUE(write_cert(cert, key));
+    std::string content(3 * 1024 * 1024 + 123, '\0');
+    for (size_t i = 0; i < content.size(); i++)
+        content[i] = static_cast<char>(i * 31 % 251);
+    write_file(path, content);
+
+    HttpServer svr;
+    svr.GET("/file", [&path](const HttpReq *, HttpResp *resp)
+    {
+        resp->File(path);
+    });
+    ASSERT_EQ(svr.start(k_port, cert.c_str(), key.c_str()), 0);
+
+    Reply reply = tls_get("/file", "", "");
+    EXPECT_EQ(reply.status, 200);
+    EXPECT_EQ(reply.headers["Content-Length"], std::to_string(content.size()));
+    EXPECT_TRUE(reply.body == content);
+
+    reply = tls_get("/file", "Range", "bytes=1000-2500000");
+    EXPECT_EQ(reply.status, 206);
+    EXPECT_TRUE(reply.body == content.substr(1000, 2500001 - 1000));
+
+    // the parts are sent, not the whole file
+    reply = tls_get("/file", "Range", "bytes=0-1499999,2000000-3099999");
+    EXPECT_EQ(reply.status, 206);
+    EXPECT_EQ(reply.headers["Content-Type"].find("multipart/byteranges"), 0);
+    std::string total = "/" + std::to_string(content.size());
+    EXPECT_NE(reply.body.find("Content-Range: bytes 0-1499999" + total), std::string::npos);
+    EXPECT_NE(reply.body.find("Content-Range: bytes 2000000-3099999" + total), std::string::npos);
+    EXPECT_GT(reply.body.size(), 2600000);
+    EXPECT_LT(reply.body.size(), content.size());
+
+    svr.stop();
+    remove(path.c_str());
+    remove(cert.c_str());
+    remove(key.c_str());
+}
+
+// The file shrinks between the open and the first read : an error,
+// without the Content-Length or Content-Range of the file that is not sent
+TEST(HttpFile, stream_truncated_file)
+{
+    std::string path = "./HttpFile_unittest_truncated.dat";
+    std::string content(2 * 1024 * 1024, 'x');
+
+    HttpServer svr;
+    svr.GET("/file", [&path](const HttpReq *, HttpResp *resp)
+    {
+        resp->File(path);
+        ASSERT_EQ(truncate(path.c_str(), 0), 0);
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    write_file(path, content);
+    Reply reply = get("/file", "", "");
+    EXPECT_EQ(reply.status, 503);
+    EXPECT_EQ(reply.headers["Content-Length"], std::to_string(reply.body.size()));
+    EXPECT_TRUE(reply.headers.find("ETag") == reply.headers.end());
+    EXPECT_TRUE(reply.headers.find("Last-Modified") == reply.headers.end());
+    EXPECT_NE(reply.body.find("503"), std::string::npos);
+
+    write_file(path, content);
+    reply = get("/file", "Range", "bytes=0-1999999");
+    EXPECT_EQ(reply.status, 503);
+    EXPECT_EQ(reply.headers["Content-Length"], std::to_string(reply.body.size()));
+    EXPECT_TRUE(reply.headers.find("Content-Range") == reply.headers.end());
+
+    svr.stop();
+    remove(path.c_str());
+}
+
+// The archive streams push() like the files do, over TLS a full socket is waited for as well
+TEST(HttpFile, zip_stream_tls)
+{
+    std::string big = "./HttpFile_unittest_big.bin";
+    std::string small = "./HttpFile_unittest_small.txt";
+    std::string cert = "./HttpFile_unittest.crt";
+    std::string key = "./HttpFile_unittest.key";
+    ASSERT_TRUE(write_cert(cert, key));
+    std::string big_content(3 * 1024 * 1024 + 123, '\0');
+    for (size_t i = 0; i < big_content.size(); i++)
+        big_content[i] = static_cast<char>(i * 31 % 251);
+    std::string small_content;
+    for (int i = 0; i < 5000; i++)
+        small_content += "line " + std::to_string(i) + "\n";
+    write_file(big, big_content);
+    write_file(small, small_content);
+
+    HttpServer svr;
+    svr.GET("/stored", [&](const HttpReq *, HttpResp *resp)
+    {
+        resp->Zip({ big, small });
+    });
+    svr.GET("/deflated", [&](const HttpReq *, HttpResp *resp)
+    {
+        ZipOptions options;
+        options.deflate = true;
+        resp->Zip({ big, small }, options);
+    });
+    ASSERT_EQ(svr.start(k_port, cert.c_str(), key.c_str()), 0);
+
+    std::string big_name = big.substr(big.find_last_of('/') + 1);
+    std::vector<std::pair<std::string, uint64_t>> entries = {
+        { big_name, big_content.size() },
+        { small.substr(small.find_last_of('/') + 1), small_content.size() }
+    };
+    Reply reply = tls_get("/stored", "", "");
+    EXPECT_EQ(reply.status, 200);
+    EXPECT_EQ(reply.headers["Content-Length"], std::to_string(ZipWriter::stored_size(entries)));
+    ASSERT_EQ(reply.body.size(), ZipWriter::stored_size(entries));
+    // the first entry is stored as it is after its local header
+    EXPECT_EQ(reply.body.compare(30 + big_name.size(), big_content.size(), big_content), 0);
+    EXPECT_EQ(reply.body.compare(reply.body.size() - 22, 4, "PK\x05\x06"), 0);
+
+    reply = tls_get("/deflated", "", "");
+    EXPECT_EQ(reply.status, 200);
+    ASSERT_GT(reply.body.size(), 22);
+    EXPECT_EQ(reply.body.compare(0, 4, "PK\x03\x04"), 0);
+    EXPECT_EQ(reply.body.compare(reply.body.size() - 22, 4, "PK\x05\x06"), 0);
+
+    svr.stop();
+    remove(big.c_str());
+    remove(small.c_str());
+    remove(cert.c_str());
+    remove(key.c_str());
+}
+
+// The Content-Length is computed before the files are read, it has to match what the stream sends
+TEST(HttpFile, multipart_stream)
+{
+    std::string big = "./HttpFile_unittest_part.bin";
+    std::string small = "./HttpFile_unittest_part.txt";
+    std::string cert = "./HttpFile_unittest.crt";
+    std::string key = "./HttpFile_unittest.key";
+    ASSERT_TRUE(write_cert(cert, key));
+    std::string big_content(2 * 1024 * 1024 + 7, '\0');
+    for (size_t i = 0; i < big_content.size(); i++)
+        big_content[i] = static_cast<char>(i * 31 % 251);
+    std::string small_content = "hello multipart\n";
+    write_file(big, big_content);
+    write_file(small, small_content);
+
+    std::string boundary = "wfrest-unittest-boundary";
+    std::vector<std::pair<std::string, std::string>> params = { { "user", "wfrest" }, { "empty", "" } };
+    std::vector<std::pair<std::string, std::string>> files = {
+        { "HttpFile_unittest_part.bin", big_content },
+        { "HttpFile_unittest_part.txt", small_content }
+    };
+    auto handler = [&](const HttpReq *, HttpResp *resp)
+    {
+        MultiPartEncoder encoder;
+        encoder.set_boundary(boundary);
+        for (const auto &param : params)
+            encoder.add_param(param.first, param.second);
+        encoder.add_file("bin", big);
+        encoder.add_file("txt", small);
+        // not a regular file, skipped
+        encoder.add_file("missing", "./HttpFile_unittest_missing");
+        resp->String(encoder);
+    };
+
+    {
+        HttpServer svr;
+        svr.GET("/multipart", handler);
+        ASSERT_EQ(svr.start(k_port), 0);
+        expect_multipart(get("/multipart", "", ""), boundary, params, files);
+        svr.stop();
+    }
+    {
+        // read until the server closes : every byte sent is counted
+        HttpServer svr;
+        svr.GET("/multipart", handler);
+        ASSERT_EQ(svr.start(k_port, cert.c_str(), key.c_str()), 0);
+        expect_multipart(tls_get("/multipart", "", ""), boundary, params, files);
+        svr.stop();
+    }
+
+    remove(big.c_str());
+    remove(small.c_str());
+    remove(cert.c_str());
+    remove(key.c_str());
+}
+
+// the new content replaces the old one through a temporary file, which does not stay behind
+TEST(HttpFile, save_overwrite)
+{
+    std::string dir = "./HttpFile_unittest_save";
+    std::string dst = dir + "/data.txt";
+    mkdir(dir.c_str(), 0755);
+
+    HttpServer svr;
+    svr.GET("/save", [&dst](const HttpReq *req, HttpResp *resp)
+    {
+        SaveOptions options;
+        options.sync = req->has_query("sync");
+        options.group_commit = req->has_query("group");
+        resp->Save(dst, "new content " + req->query("n"), options);
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    const char *queries[] = { "?n=1", "?n=2&sync=1", "?n=3&sync=1&group=1" };
+    for (const char *query : queries)
+    {
+        write_file(dst, std::string(100000, 'o'));
+        Reply reply = get(std::string("/save") + query, "", "");
+        EXPECT_EQ(reply.status, 200);
+        EXPECT_NE(reply.body.find("\"msg\":\"success\""), std::string::npos);
+        EXPECT_EQ(read_file(dst), std::string("new content ") + std::string(query).substr(3, 1));
+        EXPECT_TRUE(tmp_files(dir).empty());
+    }
+
+    svr.stop();
+    remove(dst.c_str());
+    rmdir(dir.c_str());
+}
+
+// a save which can not be written or renamed answers 503 and removes its temporary file
+TEST(HttpFile, save_failure)
+{
+    std::string dir = "./HttpFile_unittest_save_failure";
+    std::string dst = dir + "/data.txt";
+    mkdir(dir.c_str(), 0755);
+
+    HttpServer svr;
+    svr.GET("/save", [&dst](const HttpReq *req, HttpResp *resp)
+    {
+        SaveOptions options;
+        options.sync = req->has_query("sync");
+        resp->Save(dst, std::string(64 * 1024, 'x'), options);
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    // the rename over a directory fails
+    mkdir(dst.c_str(), 0755);
+    write_file(dst + "/keep", "keep");
+    for (const char *path : { "/save", "/save?sync=1" })
+    {
+        Reply reply = get(path, "", "");
+        EXPECT_EQ(reply.status, 503);
+        EXPECT_NE(reply.body.find("data.txt"), std::string::npos);
+        EXPECT_TRUE(tmp_files(dir).empty());
+        EXPECT_EQ(read_file(dst + "/keep"), "keep");
+    }
+    remove((dst + "/keep").c_str());
+    rmdir(dst.c_str());
+
+    // a short write : the file size limit stops it at 4 KB
+    struct rlimit old_limit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &old_limit), 0);
+    struct rlimit limit = old_limit;
+    limit.rlim_cur = 4096;
+    signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+    Reply reply = get("/save", "", "");
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, SIG_DFL);
+    EXPECT_EQ(reply.status, 503);
+    EXPECT_TRUE(tmp_files(dir).empty());
+    EXPECT_FALSE(file_exists(dst));
+
+    svr.stop();
+    rmdir(dir.c_str());
+}
+
+// concurrent saves share the commit rounds, each one still gets its own content
+TEST(HttpFile, save_group_commit)
+{
+    std::string dir = "./HttpFile_unittest_save_group";
+    mkdir(dir.c_str(), 0755);
+    const int k_saves = 32;
+
+    HttpServer svr;
+    svr.GET("/save", [&dir](const HttpReq *req, HttpResp *resp)
+    {
+        SaveOptions options;
+        options.sync = true;
+        options.group_commit = true;
+        const std::string &n = req->query("n");
+        resp->Save(dir + "/file" + n, std::string(1000 + atoi(n.c_str()), 'a' + atoi(n.c_str()) % 26), options);
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    std::vector<int> status(k_saves, 0);
+    WFFacilities::WaitGroup wait_group(k_saves);
+    for (int i = 0; i < k_saves; i++)
+    {
+        std::string url = "http://127.0.0.1:" + std::to_string(k_port) + "/save?n=" + std::to_string(i);
+        WFHttpTask *task = WFTaskFactory::create_http_task(url, 0, 0, [&status, &wait_group, i](WFHttpTask *task)
+        {
+            if (task->get_state() == WFT_STATE_SUCCESS)
+                status[i] = atoi(task->get_resp()->get_status_code());
+            wait_group.done();
+        });
+        task->start();
+    }
+    wait_group.wait();
+
+    for (int i = 0; i < k_saves; i++)
+    {
+        std::string path = dir + "/file" + std::to_string(i);
+        EXPECT_EQ(status[i], 200);
+        EXPECT_TRUE(read_file(path) == std::string(1000 + i, 'a' + i % 26));
+        remove(path.c_str());
+    }
+    EXPECT_TRUE(tmp_files(dir).empty());
+
+    svr.stop();
+    rmdir(dir.c_str());
+}
+
+// a file over precompress_max_size is not read into memory to be compressed
+TEST(HttpFile, precompress_max_size)
+{
+    std::string dir = "./HttpFile_unittest_static_max";
+    std::string small = dir + "/small.js";
+    std::string large = dir + "/large.js";
+    mkdir(dir.c_str(), 0755);
+    write_file(small, std::string(1000, 'a'));
+    write_file(large, std::string(100000, 'a'));
+
+    HttpServer svr;
+    svr.open_file_cache_size(0);
+    StaticOptions options;
+    options.generate_precompressed = true;
+    options.cache = false;
+    options.precompress_max_size = 50000;
+    svr.Static("/static", dir.c_str(), options);
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    Reply reply = get("/static/large.js", "Accept-Encoding", "gzip");
+    EXPECT_EQ(reply.status, 200);
+    EXPECT_EQ(reply.body.size(), 100000);
+    reply = get("/static/small.js", "Accept-Encoding", "gzip");
+    EXPECT_EQ(reply.status, 200);
+
+    for (int i = 0; i < 500 && !file_exists(small + ".gz"); i++)
+        usleep(10 * 1000);
+    EXPECT_TRUE(file_exists(small + ".gz"));
+    usleep(100 * 1000);
+    EXPECT_FALSE(file_exists(large + ".gz"));
+
+    reply = get("/static/large.js", "Accept-Encoding", "gzip");
+    EXPECT_TRUE(reply.content_encoding.empty());
+    EXPECT_EQ(reply.body.size(), 100000);
+
+    svr.stop();
+    remove((small + ".gz").c_str());
+    remove((large + ".gz").c_str());
+    remove(small.c_str());
+    remove(large.c_str());
+    rmdir(dir.c_str());
+}
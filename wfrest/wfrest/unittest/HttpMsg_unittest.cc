@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "wfrest/HttpMsg.h"
+#include "wfrest/Compress.h"
+#include "wfrest/ErrorCode.h"
+
+using namespace wfrest;
+
+// a request as the server receives it, parsed from the wire
+class RawReq : public HttpReq
+{
+public:
+    using HttpReq::append;
+
+    bool parse(const std::string &raw)
+    {
+        size_t size = raw.size();
+        if (this->append(raw.data(), &size) != 1)
+            return false;
+        this->fill_header_map();
+        return true;
+    }
+};
+
+static std::string make_request(const std::string &headers, const std::string &body)
+{
+    return "POST /echo HTTP/1.1\r\nHost: 127.0.0.1\r\n" + headers + "\r\n" + body;
+}
+
+static std::string chunked(const std::string &body, size_t step)
+{
+    char size[32];
+    std::string out;
+    for (size_t pos = 0; pos < body.size(); pos += step)
+    {
+        size_t len = std::min(step, body.size() - pos);
+        snprintf(size, sizeof size, "%zx\r\n", len);
+        out += size;
+        out.append(body, pos, len);
+        out += "\r\n";
+    }
+    return out + "0\r\n\r\n";
+}
+
+static std::string content()
+{
+    std::string body;
+    for (int i = 0; i < 1000; i++)
+        body += "field" + std::to_string(i) + "=value" + std::to_string(i) + "&";
+    return body;
+}
+
+TEST(HttpMsg, body_view_plain)
+{
+    std::string body = content();
+    RawReq req;
+    ASSERT_TRUE(req.parse(make_request("Content-Length: " + std::to_string(body.size()) + "\r\n", body)));
+    // a view into the parser buffer first, body() copies it
+    EXPECT_EQ(req.body_view().as_string(), body);
+    EXPECT_EQ(req.body(), body);
+    EXPECT_EQ(req.body_view().as_string(), req.body());
+}
+
+TEST(HttpMsg, body_view_chunked)
+{
+    std::string body = content();
+    RawReq req;
+    ASSERT_TRUE(req.parse(make_request("Transfer-Encoding: chunked\r\n", chunked(body, 1000))));
+    EXPECT_EQ(req.body_view().as_string(), body);
+    EXPECT_EQ(req.body(), body);
+}
+
+TEST(HttpMsg, body_view_compressed)
+{
+    std::string body = content();
+    std::string gzip;
+    ASSERT_EQ(Compressor::gzip(&body, &gzip), StatusOK);
+
+    RawReq req;
+    ASSERT_TRUE(req.parse(make_request("Content-Encoding: gzip\r\nContent-Length: " +
+                                       std::to_string(gzip.size()) + "\r\n", gzip)));
+    EXPECT_EQ(req.decode_body(), StatusOK);
+    EXPECT_EQ(req.body_view().as_string(), body);
+    EXPECT_EQ(req.body(), body);
+
+    // chunked and compressed
+    RawReq chunked_req;
+    ASSERT_TRUE(chunked_req.parse(make_request("Content-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n",
+                                               chunked(gzip, 100))));
+    EXPECT_EQ(chunked_req.body_view().as_string(), body);
+    EXPECT_EQ(chunked_req.body(), body);
+}
+
+TEST(HttpMsg, body_view_compressed_error)
+{
+    std::string body = content();
+    std::string gzip;
+    ASSERT_EQ(Compressor::gzip(&body, &gzip), StatusOK);
+
+    // not gzip : the raw body is kept, the same in both
+    std::string garbage = "this is not gzip";
+    RawReq bad;
+    ASSERT_TRUE(bad.parse(make_request("Content-Encoding: gzip\r\nContent-Length: " +
+                                       std::to_string(garbage.size()) + "\r\n", garbage)));
+    EXPECT_EQ(bad.decode_body(), StatusUncompressError);
+    EXPECT_EQ(bad.body_view().as_string(), garbage);
+    EXPECT_EQ(bad.body(), garbage);
+
+    // over the request size limit once decoded : both empty
+    RawReq large;
+    large.set_size_limit(body.size() / 2);
+    ASSERT_TRUE(large.parse(make_request("Content-Encoding: gzip\r\nContent-Length: " +
+                                         std::to_string(gzip.size()) + "\r\n", gzip)));
+    EXPECT_EQ(large.decode_body(), StatusUncompressTooLarge);
+    EXPECT_TRUE(large.body_view().empty());
+    EXPECT_TRUE(large.body().empty());
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
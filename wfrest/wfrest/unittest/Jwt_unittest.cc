@@ -0,0 +1,315 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/WFTaskFactory.h"
+
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/obj_mac.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include "gtest/gtest.h"
+#include "wfrest/HttpServer.h"
+#include "wfrest/Jwt.h"
+#include "wfrest/ErrorCode.h"
+#include "wfrest/base64.h"
+#include "wfrest/json.hpp"
+
+using namespace wfrest;
+
+namespace
+{
+
+std::string base64url(const std::string &data)
+{
+    std::string out = Base64::encode(reinterpret_cast<const unsigned char *>(data.data()),
+                                     static_cast<unsigned int>(data.size()));
+    while (!out.empty() && out.back() == '=')
+        out.pop_back();
+    for (char &c : out)
+    {
+        if (c == '+')
+            c = '-';
+        else if (c == '/')
+            c = '_';
+    }
+    return out;
+}
+
+std::string signing_input(const std::string &alg, const Json &claims, const std::string &kid = "")
+{
+    Json header;
+    header["alg"] = alg;
+    header["typ"] = "JWT";
+    if (!kid.empty())
+        header["kid"] = kid;
+    return base64url(header.dump()) + "." + base64url(claims.dump());
+}
+
+std::string hs256(const Json &claims, const std::string &secret)
+{
+    std::string input = signing_input("HS256", claims);
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_len = 0;
+    HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()),
+         reinterpret_cast<const unsigned char *>(input.data()), input.size(), mac, &mac_len);
+    return input + "." + base64url(std::string(reinterpret_cast<char *>(mac), mac_len));
+}
+
+EVP_PKEY *generate(int type)
+{
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(type, nullptr);
+    EVP_PKEY *pkey = nullptr;
+    EVP_PKEY_keygen_init(ctx);
+    if (type == EVP_PKEY_RSA)
+        EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048);
+    else
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(ctx, &pkey);
+    EVP_PKEY_CTX_free(ctx);
+    return pkey;
+}
+
+std::string public_pem(EVP_PKEY *pkey)
+{
+    BIO *bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_PUBKEY(bio, pkey);
+    char *data;
+    long len = BIO_get_mem_data(bio, &data);
+    std::string pem(data, len);
+    BIO_free(bio);
+    return pem;
+}
+
+std::string sign(const std::string &alg, EVP_PKEY *pkey, const Json &claims, const std::string &kid = "")
+{
+    std::string input = signing_input(alg, claims, kid);
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    size_t len = 0;
+    EVP_DigestSignInit(ctx, nullptr, EVP_sha256(), nullptr, pkey);
+    EVP_DigestSign(ctx, nullptr, &len, reinterpret_cast<const unsigned char *>(input.data()), input.size());
+    std::string sig(len, '\0');
+    EVP_DigestSign(ctx, reinterpret_cast<unsigned char *>(&sig[0]), &len,
+                   reinterpret_cast<const unsigned char *>(input.data()), input.size());
+    sig.resize(len);
+    EVP_MD_CTX_free(ctx);
+
+    if (alg == "ES256")
+    {
+        // DER to the r || s of a JWS
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(sig.data());
+        ECDSA_SIG *ecdsa = d2i_ECDSA_SIG(nullptr, &p, static_cast<long>(sig.size()));
+        const BIGNUM *r;
+        const BIGNUM *s;
+        ECDSA_SIG_get0(ecdsa, &r, &s);
+        unsigned char raw[64];
+        BN_bn2binpad(r, raw, 32);
+        BN_bn2binpad(s, raw + 32, 32);
+        ECDSA_SIG_free(ecdsa);
+        sig.assign(reinterpret_cast<char *>(raw), sizeof raw);
+    }
+    return input + "." + base64url(sig);
+}
+
+Json claims_until(int64_t exp)
+{
+    Json claims;
+    claims["sub"] = "user-1";
+    claims["exp"] = exp;
+    return claims;
+}
+
+JwtOptions hs256_options(const std::string &secret)
+{
+    JwtOptions options;
+    JwtKey key;
+    key.alg = "HS256";
+    key.key = secret;
+    options.keys.push_back(key);
+    options.leeway = 0;
+    return options;
+}
+
+const unsigned short k_port = 8942;
+
+struct Reply
+{
+    int status = 0;
+    std::string body;
+};
+
+// GET path, with the token if any
+Reply get(const std::string &path, const std::string &token)
+{
+    Reply reply;
+    WFFacilities::WaitGroup wait_group(1);
+    std::string url = "http://127.0.0.1:" + std::to_string(k_port) + path;
+    WFHttpTask *task = WFTaskFactory::create_http_task(url, 0, 0, [&](WFHttpTask *task)
+    {
+        if (task->get_state() == WFT_STATE_SUCCESS)
+        {
+            const void *body;
+            size_t len;
+            reply.status = atoi(task->get_resp()->get_status_code());
+            task->get_resp()->get_parsed_body(&body, &len);
+            reply.body.assign(static_cast<const char *>(body), len);
+        }
+        wait_group.done();
+    });
+    if (!token.empty())
+        task->get_req()->add_header_pair("Authorization", "Bearer " + token);
+    task->start();
+    wait_group.wait();
+    return reply;
+}
+
+}  // namespace
+
+TEST(Jwt, hs256)
+{
+    JwtVerifier verifier(hs256_options("secret"));
+    std::shared_ptr<const Json> claims;
+    int64_t now = time(nullptr);
+
+    EXPECT_EQ(verifier.verify(hs256(claims_until(now + 60), "secret"), &claims), StatusOK);
+    ASSERT_TRUE(claims != nullptr);
+    EXPECT_EQ((*claims)["sub"], "user-1");
+
+    EXPECT_EQ(verifier.verify(hs256(claims_until(now + 60), "other"), &claims), StatusUnauthorized);
+    EXPECT_EQ(verifier.verify(hs256(claims_until(now - 1), "secret"), &claims), StatusUnauthorized);
+    EXPECT_EQ(verifier.verify("", &claims), StatusUnauthorized);
+    EXPECT_EQ(verifier.verify("a.b", &claims), StatusUnauthorized);
+
+    // the signature of other claims
+    std::string token = hs256(claims_until(now + 60), "secret");
+    std::string forged = hs256(claims_until(now + 3600), "secret");
+    std::string tampered = forged.substr(0, forged.rfind('.')) + token.substr(token.rfind('.'));
+    EXPECT_EQ(verifier.verify(tampered, &claims), StatusUnauthorized);
+
+    // alg none is never configured
+    std::string none = signing_input("none", claims_until(now + 60)) + ".";
+    EXPECT_EQ(verifier.verify(none, &claims), StatusUnauthorized);
+}
+
+TEST(Jwt, claims)
+{
+    JwtOptions options = hs256_options("secret");
+    options.issuer = "wfrest";
+    options.audience = "api";
+    JwtVerifier verifier(options);
+    std::shared_ptr<const Json> claims;
+    int64_t now = time(nullptr);
+
+    Json good = claims_until(now + 60);
+    good["iss"] = "wfrest";
+    good["aud"] = { "web", "api" };
+    EXPECT_EQ(verifier.verify(hs256(good, "secret"), &claims), StatusOK);
+
+    Json wrong_iss = good;
+    wrong_iss["iss"] = "other";
+    EXPECT_EQ(verifier.verify(hs256(wrong_iss, "secret"), &claims), StatusUnauthorized);
+
+    Json wrong_aud = good;
+    wrong_aud["aud"] = "web";
+    EXPECT_EQ(verifier.verify(hs256(wrong_aud, "secret"), &claims), StatusUnauthorized);
+
+    Json not_yet = good;
+    not_yet["nbf"] = now + 60;
+    EXPECT_EQ(verifier.verify(hs256(not_yet, "secret"), &claims), StatusUnauthorized);
+
+    Json bad_exp = good;
+    bad_exp["exp"] = "tomorrow";
+    EXPECT_EQ(verifier.verify(hs256(bad_exp, "secret"), &claims), StatusUnauthorized);
+}
+
+TEST(Jwt, cached)
+{
+    JwtVerifier verifier(hs256_options("secret"));
+    std::shared_ptr<const Json> first;
+    std::shared_ptr<const Json> second;
+    std::string token = hs256(claims_until(time(nullptr) + 60), "secret");
+
+    EXPECT_EQ(verifier.verify(token, &first), StatusOK);
+    EXPECT_EQ(verifier.verify(token, &second), StatusOK);
+    EXPECT_EQ(first, second);
+    ShardedCacheStats stats = verifier.stats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.entries, 1);
+
+    // refused tokens and tokens without exp are not kept
+    Json no_exp;
+    no_exp["sub"] = "user-2";
+    EXPECT_EQ(verifier.verify(hs256(no_exp, "secret"), &first), StatusOK);
+    EXPECT_EQ(verifier.verify(hs256(no_exp, "other"), &first), StatusUnauthorized);
+    EXPECT_EQ(verifier.stats().entries, 1);
+}
+
+TEST(Jwt, rs256_es256)
+{
+    EVP_PKEY *rsa = generate(EVP_PKEY_RSA);
+    EVP_PKEY *ec = generate(EVP_PKEY_EC);
+    ASSERT_TRUE(rsa != nullptr);
+    ASSERT_TRUE(ec != nullptr);
+
+    JwtOptions options;
+    options.keys.push_back({ "RS256", public_pem(rsa), "rsa" });
+    options.keys.push_back({ "ES256", public_pem(ec), "ec" });
+    options.keys.push_back({ "ES256", "not a key", "bad" });
+    options.leeway = 0;
+    JwtVerifier verifier(options);
+    EXPECT_EQ(verifier.key_count(), 2);
+
+    std::shared_ptr<const Json> claims;
+    int64_t now = time(nullptr);
+    for (int i = 0; i < 3; i++)
+    {
+        // new claims every time, the contexts are reused, not the cache
+        EXPECT_EQ(verifier.verify(sign("RS256", rsa, claims_until(now + 60 + i), "rsa"), &claims), StatusOK);
+        EXPECT_EQ(verifier.verify(sign("ES256", ec, claims_until(now + 60 + i), "ec"), &claims), StatusOK);
+    }
+    EXPECT_EQ(verifier.stats().hits, 0);
+
+    // a key of another kid, or of another alg
+    EXPECT_EQ(verifier.verify(sign("ES256", ec, claims_until(now + 60), "rsa"), &claims), StatusUnauthorized);
+    EXPECT_EQ(verifier.verify(sign("RS256", rsa, claims_until(now + 60), "ec"), &claims), StatusUnauthorized);
+    EXPECT_EQ(verifier.verify(sign("RS256", rsa, claims_until(now - 1), "rsa"), &claims), StatusUnauthorized);
+
+    std::string token = sign("ES256", ec, claims_until(now + 60), "ec");
+    token[token.rfind('.') + 1] ^= 1;
+    EXPECT_EQ(verifier.verify(token, &claims), StatusUnauthorized);
+
+    EVP_PKEY_free(rsa);
+    EVP_PKEY_free(ec);
+}
+
+// svr.Use() guards the routes without aspects of their own as well
+TEST(Jwt, aspect_global)
+{
+    static std::atomic<int> handled{0};
+    HttpServer svr;
+    svr.Use(JwtAspect(hs256_options("secret")));
+    svr.GET("/me", [](const HttpReq *req, HttpResp *resp)
+    {
+        handled++;
+        resp->String(req->claims()["sub"].get<std::string>());
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    int64_t now = time(nullptr);
+    EXPECT_EQ(get("/me", "").status, 401);
+    EXPECT_EQ(get("/me", hs256(claims_until(now + 60), "other")).status, 401);
+    EXPECT_EQ(get("/me", hs256(claims_until(now - 1), "secret")).status, 401);
+    EXPECT_EQ(handled, 0);
+
+    Reply reply = get("/me", hs256(claims_until(now + 60), "secret"));
+    EXPECT_EQ(reply.status, 200);
+    EXPECT_EQ(reply.body, "user-1");
+    EXPECT_EQ(handled, 1);
+
+    svr.stop();
+}
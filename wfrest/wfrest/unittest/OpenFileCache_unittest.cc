@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fstream>
+#include <string>
+#include "wfrest/OpenFileCache.h"
+
+using namespace wfrest;
+
+static void write_file(const std::string &path, const std::string &content)
+{
+    std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+    file << content;
+}
+
+TEST(OpenFileCache, hit)
+{
+    write_file("open_hit.txt", "hello");
+
+    OpenFileCache cache;
+    const OpenFileCache::OpenFileHandle *handle = cache.get("open_hit.txt");
+    ASSERT_TRUE(handle != nullptr);
+    EXPECT_EQ(handle->value.error, 0);
+    EXPECT_FALSE(handle->value.is_dir);
+    EXPECT_EQ(handle->value.size, 5);
+
+    // shared while it is valid
+    const OpenFileCache::OpenFileHandle *again = cache.get("open_hit.txt");
+    EXPECT_EQ(again, handle);
+    EXPECT_EQ(again->value.fd, handle->value.fd);
+    cache.release(again);
+    cache.release(handle);
+
+    OpenFileCacheStats stats = cache.stats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.entries, 1);
+    remove("open_hit.txt");
+}
+
+TEST(OpenFileCache, negative)
+{
+    OpenFileCache cache;
+    cache.set_negative_time(60 * 1000);
+    const OpenFileCache::OpenFileHandle *handle = cache.get("open_not_exist.txt");
+    ASSERT_TRUE(handle != nullptr);
+    EXPECT_EQ(handle->value.error, ENOENT);
+    cache.release(handle);
+
+    // created meanwhile, still not found until the negative entry expires
+    write_file("open_not_exist.txt", "x");
+    handle = cache.get("open_not_exist.txt");
+    EXPECT_EQ(handle->value.error, ENOENT);
+    cache.release(handle);
+    EXPECT_EQ(cache.stats().misses, 1);
+
+    cache.set_negative_time(0);
+    cache.set_max_size(0);
+    EXPECT_TRUE(cache.get("open_not_exist.txt") == nullptr);
+    EXPECT_EQ(cache.stats().entries, 0);
+    remove("open_not_exist.txt");
+}
+
+TEST(OpenFileCache, expire)
+{
+    write_file("open_change.txt", "old");
+
+    OpenFileCache cache;
+    cache.set_valid_time(0);
+    const OpenFileCache::OpenFileHandle *old_handle = cache.get("open_change.txt");
+    ASSERT_TRUE(old_handle != nullptr);
+    EXPECT_EQ(old_handle->value.size, 3);
+
+    write_file("open_change.txt", "changed");
+    const OpenFileCache::OpenFileHandle *handle = cache.get("open_change.txt");
+    EXPECT_NE(handle, old_handle);
+    EXPECT_EQ(handle->value.size, 7);
+    // the replaced entry stays usable until it is released
+    EXPECT_EQ(old_handle->value.size, 3);
+    cache.release(old_handle);
+    cache.release(handle);
+    EXPECT_EQ(cache.stats().entries, 1);
+    remove("open_change.txt");
+}
+
+TEST(OpenFileCache, map)
+{
+    write_file("open_map.txt", "mapped");
+
+    OpenFileCache cache;
+    // opened without a mapping, mapped once it is asked for
+    const OpenFileCache::OpenFileHandle *handle = cache.get("open_map.txt");
+    EXPECT_TRUE(handle->value.addr == nullptr);
+    cache.release(handle);
+
+    handle = cache.get("open_map.txt", true);
+#ifndef _WIN32
+    ASSERT_TRUE(handle->value.addr != nullptr);
+    EXPECT_EQ(std::string(static_cast<const char *>(handle->value.addr), handle->value.size), "mapped");
+
+    // unchanged, the same mapping is shared
+    const OpenFileCache::OpenFileHandle *again = cache.get("open_map.txt", true);
+    EXPECT_EQ(again, handle);
+    cache.release(again);
+
+    // too large to map, read instead
+    cache.set_map_max_size(1);
+    write_file("open_map_big.txt", "not mapped");
+    again = cache.get("open_map_big.txt", true);
+    EXPECT_TRUE(again->value.addr == nullptr);
+    cache.release(again);
+    remove("open_map_big.txt");
+#endif
+    cache.release(handle);
+    remove("open_map.txt");
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
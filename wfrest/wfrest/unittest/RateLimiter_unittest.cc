@@ -0,0 +1,161 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/WFTaskFactory.h"
+#include "workflow/HttpUtil.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "wfrest/HttpServer.h"
+#include "wfrest/RateLimiter.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+RateLimitOptions options_of(double rate, double burst, size_t max_keys = 1024)
+{
+    RateLimitOptions options;
+    options.rate = rate;
+    options.burst = burst;
+    options.max_keys = max_keys;
+    return options;
+}
+
+const unsigned short k_port = 8943;
+
+struct Reply
+{
+    int status = 0;
+    std::string retry_after;
+};
+
+Reply get(const std::string &path)
+{
+    Reply reply;
+    WFFacilities::WaitGroup wait_group(1);
+    std::string url = "http://127.0.0.1:" + std::to_string(k_port) + path;
+    WFHttpTask *task = WFTaskFactory::create_http_task(url, 0, 0, [&](WFHttpTask *task)
+    {
+        if (task->get_state() == WFT_STATE_SUCCESS)
+        {
+            reply.status = atoi(task->get_resp()->get_status_code());
+            protocol::HttpHeaderCursor cursor(task->get_resp());
+            cursor.find("Retry-After", reply.retry_after);
+        }
+        wait_group.done();
+    });
+    task->start();
+    wait_group.wait();
+    return reply;
+}
+
+}  // namespace
+
+TEST(RateLimiter, burst)
+{
+    // 10 a second, 5 at once
+    RateLimiter limiter(options_of(10, 5));
+    uint64_t key = RateLimiter::hash("127.0.0.1");
+    int64_t now = 1000000000;
+    int64_t wait_us = 0;
+
+    for (int i = 0; i < 5; i++)
+        EXPECT_TRUE(limiter.try_acquire(key, now, &wait_us));
+    EXPECT_FALSE(limiter.try_acquire(key, now, &wait_us));
+    EXPECT_EQ(wait_us, 100000);
+    EXPECT_EQ(limiter.stats().limited, 1);
+
+    // the refill of one request
+    EXPECT_FALSE(limiter.try_acquire(key, now + 99999, &wait_us));
+    EXPECT_TRUE(limiter.try_acquire(key, now + 100000, &wait_us));
+    EXPECT_FALSE(limiter.try_acquire(key, now + 100000, &wait_us));
+
+    // full again, not more than the burst
+    for (int i = 0; i < 5; i++)
+        EXPECT_TRUE(limiter.try_acquire(key, now + 10000000, &wait_us));
+    EXPECT_FALSE(limiter.try_acquire(key, now + 10000000, &wait_us));
+}
+
+TEST(RateLimiter, keys)
+{
+    RateLimiter limiter(options_of(1, 1));
+    int64_t now = 1000000000;
+
+    EXPECT_TRUE(limiter.try_acquire(RateLimiter::hash("10.0.0.1"), now, nullptr));
+    EXPECT_FALSE(limiter.try_acquire(RateLimiter::hash("10.0.0.1"), now, nullptr));
+    EXPECT_TRUE(limiter.try_acquire(RateLimiter::hash("10.0.0.2"), now, nullptr));
+    EXPECT_TRUE(limiter.try_acquire(RateLimiter::hash("api-key"), now, nullptr));
+}
+
+TEST(RateLimiter, eviction)
+{
+    // a single group of 4 buckets
+    RateLimiter limiter(options_of(1, 1, 4));
+    int64_t now = 1000000000;
+
+    for (uint64_t key = 1; key <= 4; key++)
+        EXPECT_TRUE(limiter.try_acquire(key, now + key, nullptr));
+    EXPECT_EQ(limiter.stats().evicted, 0);
+
+    // the bucket of key 1 is the oldest, taken over before it is full
+    EXPECT_TRUE(limiter.try_acquire(5, now + 5, nullptr));
+    EXPECT_EQ(limiter.stats().evicted, 1);
+    EXPECT_FALSE(limiter.try_acquire(2, now + 6, nullptr));
+
+    // full buckets are free, nothing is lost
+    now += 10000000;
+    for (uint64_t key = 6; key <= 9; key++)
+        EXPECT_TRUE(limiter.try_acquire(key, now, nullptr));
+    EXPECT_EQ(limiter.stats().evicted, 1);
+}
+
+TEST(RateLimiter, threads)
+{
+    RateLimiter limiter(options_of(1, 1000));
+    uint64_t key = RateLimiter::hash("shared");
+    int64_t now = 1000000000;
+    std::atomic<int> allowed{0};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; i++)
+    {
+        threads.emplace_back([&]
+        {
+            for (int j = 0; j < 1000; j++)
+            {
+                if (limiter.try_acquire(key, now, nullptr))
+                    allowed++;
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    EXPECT_EQ(allowed, 1000);
+    EXPECT_EQ(limiter.stats().limited, 7000);
+}
+
+// svr.Use() limits the routes without aspects of their own as well
+TEST(RateLimiter, aspect_global)
+{
+    static std::atomic<int> handled{0};
+    HttpServer svr;
+    svr.Use(RateLimitAspect(options_of(1, 1)));
+    svr.GET("/plain", [](const HttpReq *, HttpResp *resp)
+    {
+        handled++;
+        resp->String("handled");
+    });
+    ASSERT_EQ(svr.start(k_port), 0);
+
+    EXPECT_EQ(get("/plain").status, 200);
+    Reply reply = get("/plain");
+    EXPECT_EQ(reply.status, 429);
+    EXPECT_FALSE(reply.retry_after.empty());
+    EXPECT_GE(atoi(reply.retry_after.c_str()), 1);
+    EXPECT_EQ(handled, 1);
+
+    svr.stop();
+}
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "wfrest/ShardedCache.h"
+
+using namespace wfrest;
+
+TEST(ShardedCache, get_put)
+{
+    ShardedCache<int> cache(100);
+    int value = 0;
+    EXPECT_FALSE(cache.get("a", &value));
+    cache.put("a", 1, 60 * 1000);
+    EXPECT_TRUE(cache.get("a", &value));
+    EXPECT_EQ(value, 1);
+
+    cache.put("a", 2, 60 * 1000);
+    EXPECT_TRUE(cache.get("a", &value));
+    EXPECT_EQ(value, 2);
+
+    cache.remove("a");
+    EXPECT_FALSE(cache.get("a", &value));
+
+    // not kept
+    cache.put("b", 1, 0);
+    EXPECT_FALSE(cache.get("b", &value));
+}
+
+TEST(ShardedCache, expire)
+{
+    ShardedCache<bool> cache(100);
+    bool value;
+    cache.put("a", true, 20);
+    EXPECT_TRUE(cache.get("a", &value));
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    EXPECT_FALSE(cache.get("a", &value));
+    EXPECT_EQ(cache.stats().entries, 0);
+}
+
+TEST(ShardedCache, bounded)
+{
+    ShardedCache<int> cache(64, 4);
+    for (int i = 0; i < 10000; i++)
+        cache.put(std::to_string(i), i, 60 * 1000);
+    EXPECT_LE(cache.stats().entries, 64);
+
+    // the last one of its shard is kept
+    int value;
+    EXPECT_TRUE(cache.get("9999", &value));
+    EXPECT_EQ(value, 9999);
+}
+
+TEST(ShardedCache, threads)
+{
+    ShardedCache<int> cache(1000);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++)
+    {
+        threads.emplace_back([&cache, t]()
+        {
+            int value;
+            for (int i = 0; i < 10000; i++)
+            {
+                std::string key = std::to_string((i * 7 + t) % 2000);
+                if (!cache.get(key, &value))
+                    cache.put(key, i, 60 * 1000);
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    ShardedCacheStats stats = cache.stats();
+    EXPECT_EQ(stats.hits + stats.misses, 80000);
+    EXPECT_LE(stats.entries, 1008);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
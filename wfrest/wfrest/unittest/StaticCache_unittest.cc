@@ -0,0 +1,104 @@
+﻿#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include "wfrest/StaticCache.h"
+#include "wfrest/HttpFile.h"
+
+using namespace wfrest;
+
+static void write_file(const std::string &path, const std::string &content)
+{
+    std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+    file << content;
+}
+
+TEST(StaticCache, hit)
+{
+    write_file("cache_hit.html", "<html></html>");
+
+    StaticCache cache;
+    StaticCache::EntryPtr entry = cache.get("cache_hit.html");
+    ASSERT_TRUE(entry != nullptr);
+    EXPECT_EQ(entry->content, "<html></html>");
+    EXPECT_EQ(entry->content_type, "text/html");
+
+    EXPECT_EQ(cache.get("cache_hit.html"), entry);
+    StaticCacheStats stats = cache.stats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.entries, 1);
+    EXPECT_EQ(stats.bytes, 13);
+    EXPECT_DOUBLE_EQ(stats.hit_ratio(), 0.5);
+
+    EXPECT_TRUE(cache.get("not_exist.html") == nullptr);
+}
+
+TEST(StaticCache, capacity)
+{
+    write_file("cache_a.txt", std::string(600, 'a'));
+    write_file("cache_b.txt", std::string(600, 'b'));
+    write_file("cache_big.txt", std::string(2000, 'c'));
+
+    StaticCache cache;
+    cache.set_capacity(1000);
+
+    StaticCache::EntryPtr a = cache.get("cache_a.txt");
+    ASSERT_TRUE(a != nullptr);
+    ASSERT_TRUE(cache.get("cache_b.txt") != nullptr);
+    // a is evicted, but the response holding it can still use it
+    StaticCacheStats stats = cache.stats();
+    EXPECT_EQ(stats.entries, 1);
+    EXPECT_EQ(stats.bytes, 600);
+    EXPECT_EQ(stats.evictions, 1);
+    EXPECT_EQ(a->content, std::string(600, 'a'));
+
+    // larger than the whole cache
+    EXPECT_TRUE(cache.get("cache_big.txt") == nullptr);
+}
+
+TEST(StaticCache, revalidate)
+{
+    write_file("cache_change.txt", "old");
+
+    StaticCache cache;
+    cache.set_revalidate_interval(0);
+    StaticCache::EntryPtr entry = cache.get("cache_change.txt");
+    ASSERT_TRUE(entry != nullptr);
+    EXPECT_EQ(entry->content, "old");
+
+    write_file("cache_change.txt", "changed");
+    entry = cache.get("cache_change.txt");
+    ASSERT_TRUE(entry != nullptr);
+    EXPECT_EQ(entry->content, "changed");
+    EXPECT_EQ(cache.stats().bytes, 7);
+
+    remove("cache_change.txt");
+    EXPECT_TRUE(cache.get("cache_change.txt") == nullptr);
+    EXPECT_EQ(cache.stats().entries, 0);
+}
+
+TEST(StaticCache, validators)
+{
+    write_file("cache_etag.txt", "abc");
+
+    StaticCache cache;
+    cache.set_revalidate_interval(0);
+    StaticCache::EntryPtr entry = cache.get("cache_etag.txt");
+    ASSERT_TRUE(entry != nullptr);
+    EXPECT_EQ(entry->etag, HttpFile::etag(entry->ino, 3, entry->mtime));
+    EXPECT_EQ(entry->etag.front(), '"');
+    EXPECT_EQ(entry->etag.back(), '"');
+    EXPECT_EQ(entry->last_modified, HttpFile::last_modified(entry->mtime));
+
+    write_file("cache_etag.txt", "abcd");
+    StaticCache::EntryPtr changed = cache.get("cache_etag.txt");
+    ASSERT_TRUE(changed != nullptr);
+    EXPECT_NE(changed->etag, entry->etag);
+
+    remove("cache_etag.txt");
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -13,6 +13,23 @@ TEST(Timestamp, format_str)
     EXPECT_EQ("Sun, 12 Dec 2021 11:17:12 GMT", ts.to_format_str("%a, %d %b %Y %H:%M:%S GMT"));
 }
 
+TEST(Timestamp, http_date)
+{
+    Timestamp ts(1639279032782231L);
+    EXPECT_EQ("Sun, 12 Dec 2021 03:17:12 GMT", ts.to_http_date());
+
+    Timestamp parsed = Timestamp::from_http_date("Sun, 12 Dec 2021 03:17:12 GMT");
+    EXPECT_EQ(parsed.micro_sec_since_epoch(), 1639279032L * Timestamp::k_micro_sec_per_sec);
+
+    EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", 
+              Timestamp::from_http_date("Sun, 06 Nov 1994 08:49:37 GMT").to_http_date());
+    EXPECT_EQ("Thu, 29 Feb 2024 23:59:59 GMT", 
+              Timestamp::from_http_date("Thu, 29 Feb 2024 23:59:59 GMT").to_http_date());
+
+    EXPECT_FALSE(Timestamp::from_http_date("Sunday, 06-Nov-94 08:49:37 GMT").valid());
+    EXPECT_FALSE(Timestamp::from_http_date("").valid());
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "wfrest/Upload.h"
+
+using namespace wfrest;
+
+static const std::string k_boundary = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+
+static std::string make_body(const std::string &content)
+{
+    std::string body;
+    body += "--" + k_boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"title\"\r\n\r\n";
+    body += "holiday\r\n";
+    body += "--" + k_boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"photo\"; filename=\"beach.jpg\"\r\n";
+    body += "Content-Type: image/jpeg\r\n\r\n";
+    body += content + "\r\n";
+    body += "--" + k_boundary + "--\r\n";
+    return body;
+}
+
+// feed the body in small pieces, as the network does
+static int feed(Upload &upload, const std::string &body, size_t step)
+{
+    int ret = 0;
+    for (size_t pos = 0; pos < body.size() && ret == 0; pos += step)
+    {
+        size_t len = std::min(step, body.size() - pos);
+        ret = upload.append(body.data() + pos, &len);
+    }
+    return ret;
+}
+
+static std::string read_file(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+class StringSink : public UploadSink
+{
+public:
+    StringSink(std::string *data, bool *complete) : data_(data), complete_(complete) {}
+
+    bool write(const char *data, size_t len) override
+    {
+        data_->append(data, len);
+        return true;
+    }
+
+    void close(bool complete) override
+    { *complete_ = complete; }
+
+private:
+    std::string *data_;
+    bool *complete_;
+};
+
+TEST(Upload, sink)
+{
+    std::string content(100000, 'x');
+    std::string body = make_body(content);
+    std::string received;
+    bool complete = false;
+
+    UploadOptions options;
+    options.sink = [&](const UploadFile &file) -> UploadSink *
+    {
+        EXPECT_EQ(file.name, "photo");
+        EXPECT_EQ(file.filename, "beach.jpg");
+        EXPECT_EQ(file.content_type, "image/jpeg");
+        return new StringSink(&received, &complete);
+    };
+    auto upload = std::make_shared<Upload>(options, k_boundary, body.size());
+    EXPECT_EQ(feed(*upload, body, 7), 1);
+
+    EXPECT_EQ(upload->fields()["title"].second, "holiday");
+    ASSERT_EQ(upload->files().size(), 1);
+    EXPECT_EQ(upload->files()[0].size, content.size());
+    EXPECT_TRUE(upload->files()[0].path.empty());
+    EXPECT_EQ(received, content);
+    EXPECT_TRUE(complete);
+}
+
+TEST(Upload, temp_file)
+{
+    std::string content;
+    for (int i = 0; i < 1000; i++)
+        content += std::to_string(i);
+    std::string body = make_body(content);
+
+    UploadOptions options;
+    options.dir = ".";
+    options.write_size = 64;
+    // blocking writes only, no file tasks
+    options.max_pending_writes = 0;
+    auto upload = std::make_shared<Upload>(options, k_boundary, body.size());
+    EXPECT_EQ(feed(*upload, body, 100), 1);
+    EXPECT_EQ(upload->status(), 0);
+
+    ASSERT_EQ(upload->files().size(), 1);
+    const UploadFile &file = upload->files()[0];
+    EXPECT_GE(file.fd, 0);
+    EXPECT_EQ(file.size, content.size());
+    EXPECT_EQ(read_file(file.path), content);
+
+    // removed with the request
+    std::string path = file.path;
+    upload.reset();
+    EXPECT_FALSE(std::ifstream(path).good());
+}
+
+TEST(Upload, field_too_large)
+{
+    std::string body = make_body("x");
+    UploadOptions options;
+    options.max_field_size = 3;
+    auto upload = std::make_shared<Upload>(options, k_boundary, body.size());
+    EXPECT_EQ(feed(*upload, body, 1000), -1);
+    EXPECT_EQ(errno, EMSGSIZE);
+}
+
+TEST(Upload, truncated)
+{
+    std::string body = make_body("x");
+    // the closing boundary is missing
+    body.resize(body.size() - k_boundary.size() - 6);
+    UploadOptions options;
+    options.sink = [](const UploadFile &) -> UploadSink * { return nullptr; };
+    auto upload = std::make_shared<Upload>(options, k_boundary, body.size());
+    EXPECT_EQ(feed(*upload, body, 1000), -1);
+    EXPECT_EQ(errno, EBADMSG);
+
+    // the rest of the connection is not part of the body
+    std::string whole = make_body("x");
+    std::string next = whole + "GET / HTTP/1.1\r\n\r\n";
+    upload = std::make_shared<Upload>(options, k_boundary, whole.size());
+    size_t len = next.size();
+    EXPECT_EQ(upload->append(next.data(), &len), 1);
+    EXPECT_EQ(len, whole.size());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
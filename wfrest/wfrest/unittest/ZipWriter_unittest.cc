@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include "wfrest/ZipWriter.h"
+
+using namespace wfrest;
+
+static uint32_t get32(const std::string &buf, size_t pos)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buf.data()) + pos;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// files are fed in pieces, as the windows of a download
+static std::string make_zip(bool deflate, const std::vector<std::pair<std::string, std::string>> &files)
+{
+    ZipWriter writer(deflate);
+    std::string zip;
+    for (const auto &file : files)
+    {
+        writer.begin_file(file.first, file.second.size(), 1700000000, &zip);
+        for (size_t pos = 0; pos < file.second.size(); pos += 1000)
+        {
+            size_t len = std::min<size_t>(1000, file.second.size() - pos);
+            if (!deflate)
+                zip.append(file.second, pos, len);
+            EXPECT_EQ(writer.file_data(file.second.data() + pos, len, &zip), 0);
+        }
+        EXPECT_EQ(writer.end_file(&zip), 0);
+    }
+    writer.finish(&zip);
+    EXPECT_EQ(writer.offset(), zip.size());
+    return zip;
+}
+
+static std::vector<std::pair<std::string, std::string>> test_files()
+{
+    std::string text;
+    for (int i = 0; i < 5000; i++)
+        text += "line " + std::to_string(i) + "\n";
+    return { { "a.txt", text }, { "empty", "" }, { "dir/b.bin", std::string(3000, '\x7f') } };
+}
+
+TEST(ZipWriter, stored)
+{
+    auto files = test_files();
+    std::string zip = make_zip(false, files);
+
+    std::vector<std::pair<std::string, uint64_t>> entries;
+    for (const auto &file : files)
+        entries.emplace_back(file.first, file.second.size());
+    EXPECT_EQ(ZipWriter::stored_size(entries), zip.size());
+
+    // local header, then the data as it is
+    EXPECT_EQ(get32(zip, 0), 0x04034b50u);
+    EXPECT_EQ(zip.compare(30 + 5, files[0].second.size(), files[0].second), 0);
+    // data descriptor : crc, sizes
+    size_t desc = 30 + 5 + files[0].second.size();
+    EXPECT_EQ(get32(zip, desc), 0x08074b50u);
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(files[0].second.data()), files[0].second.size());
+    EXPECT_EQ(get32(zip, desc + 4), crc);
+    EXPECT_EQ(get32(zip, desc + 8), files[0].second.size());
+
+    // end of central directory : 3 entries
+    size_t end = zip.size() - 22;
+    EXPECT_EQ(get32(zip, end), 0x06054b50u);
+    EXPECT_EQ(get32(zip, end + 8), 0x00030003u);
+}
+
+TEST(ZipWriter, deflate)
+{
+    auto files = test_files();
+    std::string zip = make_zip(true, files);
+    EXPECT_LT(zip.size(), files[0].second.size());
+
+    // the first entry inflates back
+    z_stream strm = {};
+    ASSERT_EQ(inflateInit2(&strm, -MAX_WBITS), Z_OK);
+    std::string out(files[0].second.size(), '\0');
+    strm.next_in = reinterpret_cast<Bytef *>(&zip[30 + 5]);
+    strm.avail_in = static_cast<uInt>(zip.size() - 35);
+    strm.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    strm.avail_out = static_cast<uInt>(out.size());
+    EXPECT_EQ(inflate(&strm, Z_FINISH), Z_STREAM_END);
+    size_t compressed = strm.total_in;
+    inflateEnd(&strm);
+    EXPECT_EQ(out, files[0].second);
+
+    size_t desc = 30 + 5 + compressed;
+    EXPECT_EQ(get32(zip, desc), 0x08074b50u);
+    EXPECT_EQ(get32(zip, desc + 8), compressed);
+    EXPECT_EQ(get32(zip, desc + 12), files[0].second.size());
+}
+
+TEST(ZipWriter, zip64_size)
+{
+    // a 5 GB entry : ZIP64 local extra, 8 byte descriptor sizes, ZIP64 central extra
+    std::vector<std::pair<std::string, uint64_t>> entries = { { "big.iso", 5ULL << 30 } };
+    uint64_t expect = (30 + 7 + 20) + (5ULL << 30) + 24 + (46 + 7 + 4 + 16) + 56 + 20 + 22;
+    EXPECT_EQ(ZipWriter::stored_size(entries), expect);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}